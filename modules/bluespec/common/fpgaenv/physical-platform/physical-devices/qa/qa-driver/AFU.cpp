@@ -35,6 +35,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
 
 #include "awb/provides/qa_device.h"
 #include "awb/provides/qa_cci_mpf_hw.h"
@@ -43,21 +46,48 @@
 #include "awb/provides/physical_platform.h"
 
 
-AFU AFU_CLASS::instance = NULL;
-
-AFU_CLASS::AFU_CLASS(const char* afuID, uint32_t dsmSizeBytes)
+std::vector<AFU> AFU_CLASS::instances;
+std::mutex AFU_CLASS::instancesLock;
+AFU_RUNTIME_CLIENT AFU_CLASS::sharedRuntimeClient = NULL;
+uint32_t AFU_CLASS::sharedRuntimeRefs = 0;
+
+AFU_CLASS::AFU_CLASS(const char* afuID, uint32_t dsmSizeBytes, int pciBus) :
+    memTestLevel((QA_PLATFORM_MEMTEST != 0) ? QA_MEMTEST_QUICK : QA_MEMTEST_OFF),
+    mpfClockMHz(QA_MPF_CLOCK_MHZ),
+    sregSnapshotTag(0),
+    bufferPoolBytes(0),
+    statBufferPoolHits(0),
+    statBufferPoolMisses(0),
+    statBufferPinnedBytes(0),
+    statBufferPinnedBytesPeak(0)
 {
-    // There should be one global instance of the AFU
-    assert(instance == NULL);
-    instance = this;
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    startupStartNs = uint64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+
+    // Record the AFU so that services can find it
+    {
+        std::lock_guard<std::mutex> lock(instancesLock);
+        instanceIdx = instances.size();
+        instances.push_back(this);
+
+        // Start the AAL runtime with the first AFU
+        if (sharedRuntimeRefs++ == 0)
+        {
+            sharedRuntimeClient = new AFU_RUNTIME_CLIENT_CLASS();
+        }
+        afuRuntimeClient = sharedRuntimeClient;
+    }
+    MarkStartupPhase("AAL runtime started");
 
     // Instantiate the accelerator
-    afuRuntimeClient = new AFU_RUNTIME_CLIENT_CLASS();
+
     afuClient = new AFU_CLIENT_CLASS(this, afuRuntimeClient);
-    afuClient->InitService(afuID);
+    afuClient->InitService(afuID, pciBus);
 
     // create buffer for DSM
     dsmBuffer = CreateSharedBuffer(dsmSizeBytes);
+    MarkStartupPhase("DSM buffer allocated");
 
     // reset AFU
     ResetAFU();
@@ -72,44 +102,274 @@ AFU_CLASS::AFU_CLASS(const char* afuID, uint32_t dsmSizeBytes)
     printf("Waiting for DSM update...\n");
 
     // poll AFU_ID until it is non-zero
-
+    uint32_t trips = 0;
     while (ReadDSM64(0) == 0)
     {
-        printf("Polling DSM...\n"); sleep(1);
+        if (qaBackoff(trips))
+        {
+            printf("Polling DSM...\n");
+        }
     }
 
+    MarkStartupPhase("DSM handshake");
     printf("AFU Ready (0x%016llx)\n", ReadDSM64(0));
 }
 
 
+void
+AFU_CLASS::MarkStartupPhase(const char* phase)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    uint64_t now = uint64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+
+    startupPhases.push_back(std::make_pair(phase, now - startupStartNs));
+}
+
+
+void
+AFU_CLASS::PrintStartupTimeline()
+{
+    printf("AFU %d startup timeline:\n", instanceIdx);
+
+    uint64_t prev = 0;
+    for (size_t i = 0; i < startupPhases.size(); i++)
+    {
+        uint64_t t = startupPhases[i].second;
+        printf("  %10.3f ms  (+%10.3f ms)  %s\n",
+               t / 1000000.0, (t - prev) / 1000000.0, startupPhases[i].first);
+        prev = t;
+    }
+}
+
+
 AFU_CLASS::~AFU_CLASS() {
-    // release all workspace buffers
-    for (int i = 0; i < buffers.size(); i++)
+    // VTP page table pages are shared buffers.  Release them through VTP
+    // before the sweep below so none is freed twice.
+    afuClient->ReleaseMPF();
+
+    // release all workspace buffers, both in use and pooled
+    for (std::map<uint64_t, AFU_BUFFER>::iterator b = buffers.begin();
+         b != buffers.end();
+         b++)
+    {
+        afuClient->FreeSharedBuffer(b->second);
+        delete b->second;
+    }
+
+    for (std::map<uint64_t, std::vector<AFU_BUFFER> >::iterator c = bufferPool.begin();
+         c != bufferPool.end();
+         c++)
     {
-        afuClient->FreeSharedBuffer(buffers[i]);
+        for (int i = 0; i < c->second.size(); i++)
+        {
+            afuClient->FreeSharedBuffer(c->second[i]);
+            delete c->second[i];
+        }
     }
 
     // release the CCI device factory and device
     afuClient->UninitService();
     delete afuClient;
-    delete afuRuntimeClient;
+
+    // Leave the slot so that indices of other AFUs remain stable
+    {
+        std::lock_guard<std::mutex> lock(instancesLock);
+        instances[instanceIdx] = NULL;
+
+        // Stop the AAL runtime with the last AFU
+        if (--sharedRuntimeRefs == 0)
+        {
+            sharedRuntimeClient->end();
+            delete sharedRuntimeClient;
+            sharedRuntimeClient = NULL;
+        }
+    }
 
     cout << "AFU released\n";
 }
 
 
+AFU
+AFU_CLASS::GetInstance(uint32_t idx)
+{
+    std::lock_guard<std::mutex> lock(instancesLock);
+    return (idx < instances.size()) ? instances[idx] : NULL;
+}
+
+
+uint32_t
+AFU_CLASS::NumInstances()
+{
+    std::lock_guard<std::mutex> lock(instancesLock);
+    return instances.size();
+}
+
+
 AFU_BUFFER 
-AFU_CLASS::CreateSharedBuffer(ssize_t size_bytes) {
-    AFU_BUFFER buffer = afuClient->CreateSharedBuffer(size_bytes);
+AFU_CLASS::CreateSharedBuffer(ssize_t size_bytes, bool zero) {
+    uint64_t class_bytes = BufferSizeClass(size_bytes);
+    AFU_BUFFER buffer = NULL;
 
-    // store buffer in vector, so it can be released later
-    buffers.push_back(buffer);
+    {
+        std::lock_guard<std::mutex> lock(bufferLock);
+
+        // Is a buffer of the right size class available in the pool?
+        std::map<uint64_t, std::vector<AFU_BUFFER> >::iterator c =
+            bufferPool.find(class_bytes);
+        if ((c != bufferPool.end()) && ! c->second.empty())
+        {
+            buffer = c->second.back();
+            c->second.pop_back();
+            bufferPoolBytes -= class_bytes;
+            statBufferPoolHits += 1;
+
+            // The pooled descriptor is owned here.  Record the new request.
+            const_cast<AFU_BUFFER_CLASS*>(buffer)->numBytes = size_bytes;
+
+            buffers[uint64_t(buffer->virtualAddress)] = buffer;
+        }
+        else
+        {
+            statBufferPoolMisses += 1;
+        }
+    }
+
+    if (buffer != NULL)
+    {
+        // Recycled buffers still hold their previous contents.  They are
+        // zeroed only when the caller asks for it, so a caller passing
+        // zero == false may see stale data.
+        afuClient->ZeroSharedBuffer(buffer->virtualAddress, size_bytes, zero);
+        return buffer;
+    }
+
+    buffer = afuClient->CreateSharedBuffer(class_bytes, zero);
+    if (buffer == NULL) return NULL;
+    const_cast<AFU_BUFFER_CLASS*>(buffer)->numBytes = size_bytes;
+
+    std::lock_guard<std::mutex> lock(bufferLock);
+
+    // store buffer in the live set, so it can be released later
+    buffers[uint64_t(buffer->virtualAddress)] = buffer;
+
+    statBufferPinnedBytes += buffer->allocBytes;
+    if (statBufferPinnedBytes > statBufferPinnedBytesPeak)
+    {
+        statBufferPinnedBytesPeak = statBufferPinnedBytes;
+    }
 
     // return buffer struct
     return buffer;
 }
 
 
+void
+AFU_CLASS::FreeSharedBuffer(AFU_BUFFER buffer)
+{
+    if (buffer == NULL) return;
+
+    {
+        std::lock_guard<std::mutex> lock(bufferLock);
+
+        std::map<uint64_t, AFU_BUFFER>::iterator b =
+            buffers.find(uint64_t(buffer->virtualAddress));
+        if ((b == buffers.end()) || (b->second != buffer))
+        {
+            fprintf(stderr, "ERROR: FreeSharedBuffer of unknown buffer (VA %p)\n",
+                    buffer->virtualAddress);
+            return;
+        }
+        buffers.erase(b);
+
+        // Keep the buffer for reuse if the pool has room
+        if (bufferPoolBytes + buffer->allocBytes <= MB(uint64_t(QA_BUFFER_POOL_MAX_MB)))
+        {
+            bufferPool[buffer->allocBytes].push_back(buffer);
+            bufferPoolBytes += buffer->allocBytes;
+            return;
+        }
+
+        statBufferPinnedBytes -= buffer->allocBytes;
+    }
+
+    afuClient->FreeSharedBuffer(buffer);
+    delete buffer;
+}
+
+
+//
+// Buffers up to 16KB are rounded to 4KB pages.  Up to 2MB there are four
+// size classes per power of 2, so rounding pins less than 25% more than
+// requested.  Larger buffers are rounded to a multiple of 2MB so that
+// huge startup buffers don't waste pinned memory.
+//
+uint64_t
+AFU_CLASS::BufferSizeClass(uint64_t size_bytes)
+{
+    if (size_bytes > MB(2))
+    {
+        return (size_bytes + MB(2) - 1) & ~uint64_t(MB(2) - 1);
+    }
+
+    if (size_bytes <= 16384)
+    {
+        return (size_bytes + 4095) & ~uint64_t(4095);
+    }
+
+    // Step is a quarter of the largest power of 2 below size_bytes
+    uint64_t step = 4096;
+    while ((step << 3) < size_bytes)
+    {
+        step <<= 1;
+    }
+
+    return (size_bytes + step - 1) & ~(step - 1);
+}
+
+
+void
+AFU_CLASS::EmitStats(ofstream &statsFile)
+{
+    for (size_t i = 0; i < startupPhases.size(); i++)
+    {
+        statsFile << "QA_STARTUP_PHASE_" << i << "_NS,"
+                  << "\"Startup: " << startupPhases[i].first << " (ns)\","
+                  << startupPhases[i].second
+                  << endl;
+    }
+
+    statsFile << "QA_BUFFER_POOL_HITS,"
+              << "\"Shared buffer allocations satisfied by the pool\","
+              << statBufferPoolHits
+              << endl;
+    statsFile << "QA_BUFFER_POOL_MISSES,"
+              << "\"Shared buffer allocations passed to the driver\","
+              << statBufferPoolMisses
+              << endl;
+    statsFile << "QA_BUFFER_POOL_BYTES,"
+              << "\"Bytes held in the shared buffer pool\","
+              << bufferPoolBytes
+              << endl;
+    statsFile << "QA_BUFFER_PINNED_BYTES,"
+              << "\"Bytes of pinned shared buffers (in use and pooled)\","
+              << statBufferPinnedBytes
+              << endl;
+    statsFile << "QA_BUFFER_PINNED_BYTES_PEAK,"
+              << "\"Peak bytes of pinned shared buffers\","
+              << statBufferPinnedBytesPeak
+              << endl;
+}
+
+
+void
+AFU_CLASS::ResetStats()
+{
+    statBufferPoolHits = 0;
+    statBufferPoolMisses = 0;
+}
+
+
 void*
 AFU_CLASS::CreateSharedBufferInVM(ssize_t size_bytes)
 {
@@ -117,13 +377,136 @@ AFU_CLASS::CreateSharedBufferInVM(ssize_t size_bytes)
 }
 
 
+void
+AFU_CLASS::FreeSharedBufferInVM(void* va)
+{
+    if (va == NULL) return;
+
+    afuClient->FreeSharedBufferInVM(va);
+}
+
+
 btPhysAddr
 AFU_CLASS::SharedBufferVAtoPA(const void* va)
 {
+    // Buffers from CreateSharedBuffer are physically contiguous
+    AFU_BUFFER buffer = FindSharedBuffer(va);
+    if (buffer != NULL)
+    {
+        return buffer->physicalAddress +
+               (uint64_t(va) - uint64_t(buffer->virtualAddress));
+    }
+
     return afuClient->SharedBufferVAtoPA(va);
 }
 
 
+AFU_BUFFER
+AFU_CLASS::FindSharedBuffer(const void* va)
+{
+    std::lock_guard<std::mutex> lock(bufferLock);
+
+    // Find the last buffer starting at or below va
+    std::map<uint64_t, AFU_BUFFER>::iterator b =
+        buffers.upper_bound(uint64_t(va));
+    if (b == buffers.begin()) return NULL;
+    b--;
+
+    AFU_BUFFER buffer = b->second;
+    if (uint64_t(va) - b->first >= buffer->numBytes) return NULL;
+
+    return buffer;
+}
+
+
+void
+AFU_CLASS::DetachSharedBuffer(AFU_BUFFER buffer)
+{
+    std::lock_guard<std::mutex> lock(bufferLock);
+
+    std::map<uint64_t, AFU_BUFFER>::iterator b =
+        buffers.find(uint64_t(buffer->virtualAddress));
+    if ((b != buffers.end()) && (b->second == buffer))
+    {
+        buffers.erase(b);
+    }
+}
+
+
+bool
+AFU_CLASS::TestSharedBufferInVM()
+{
+    size_t n_indexed;
+    {
+        std::lock_guard<std::mutex> lock(bufferLock);
+        n_indexed = buffers.size();
+    }
+
+    // Two large pages.  On CCI-S the pages are moved from the VAs
+    // returned by AAL.
+    const size_t len = MB(4);
+    uint8_t* va = (uint8_t*)CreateSharedBufferInVM(len);
+    if (va == NULL)
+    {
+        printf("  VM buffer allocation failed\n");
+        return false;
+    }
+
+    bool ok = true;
+
+    // Moved pages must not be left in the CreateSharedBuffer index
+    {
+        std::lock_guard<std::mutex> lock(bufferLock);
+        if (buffers.size() != n_indexed)
+        {
+            printf("  VM buffer allocation changed the buffer index (%ld to %ld)\n",
+                   long(n_indexed), long(buffers.size()));
+            ok = false;
+        }
+    }
+
+    // Addresses translate relative to the PA of their 4KB page.  VTP may
+    // back the region with either page size.
+    const size_t offsets[] = { CL(1), 4096 + CL(1), MB(2) - CL(1),
+                               MB(2) + CL(1), len - CL(1) };
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++)
+    {
+        size_t page_off = offsets[i] & ~size_t(4095);
+        btPhysAddr page_pa = SharedBufferVAtoPA(va + page_off);
+        btPhysAddr pa = SharedBufferVAtoPA(va + offsets[i]);
+
+        if ((FindSharedBuffer(va + offsets[i]) != NULL) ||
+            (page_pa == 0) ||
+            (pa != page_pa + (offsets[i] - page_off)))
+        {
+            printf("  VM buffer VA %p translated to 0x%llx\n",
+                   va + offsets[i], (long long)pa);
+            ok = false;
+        }
+    }
+
+    // A new buffer may be placed by the driver near a VA vacated by
+    // the move.  It must translate through its own descriptor.
+    AFU_BUFFER b = CreateSharedBuffer(MB(2));
+    for (size_t off = 0; (b != NULL) && (off < MB(2)); off += 4096)
+    {
+        const void* bva = (const void*)(b->virtualAddress + off);
+        if ((FindSharedBuffer(bva) != b) ||
+            (SharedBufferVAtoPA(bva) != b->physicalAddress + off))
+        {
+            printf("  Buffer VA %p translated to 0x%llx\n",
+                   bva, (long long)SharedBufferVAtoPA(bva));
+            ok = false;
+            break;
+        }
+    }
+    FreeSharedBuffer(b);
+    FreeSharedBufferInVM(va);
+
+    return ok;
+}
+
+
 void
 AFU_CLASS::ResetAFU()
 {
@@ -199,79 +582,205 @@ AFU_CLASS::ReadSREG64(uint32_t n)
 }
 
 
+uint32_t
+AFU_CLASS::MaxSnapshotSREGs() const
+{
+    // Data lines follow the header to the end of DSM
+    return (dsmBuffer->numBytes / CL(1) - DSM_SREG_SNAPSHOT_DATA_LINE) *
+           (CL(1) / sizeof(uint64_t));
+}
+
+
+bool
+AFU_CLASS::SnapshotSREG64(uint32_t first, uint32_t num,
+                          std::vector<uint64_t>& values)
+{
+    if ((num > MaxSnapshotSREGs()) || (num > 0xffff))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(sregSnapshotLock);
+
+    // A new tag each time distinguishes this response from a stale header
+    sregSnapshotTag += 1;
+    uint64_t tag = sregSnapshotTag;
+
+    volatile uint64_t* hdr =
+        (volatile uint64_t*)DSMAddress(CL(DSM_SREG_SNAPSHOT_HDR_LINE));
+    *hdr = 0;
+
+    WriteCSR64(CSR_AFU_SREG_SNAPSHOT,
+               (tag << 48) | (uint64_t(first) << 16) | num);
+
+    // The header is written after all data lines are visible
+    uint32_t trips = 0;
+    const uint64_t done = (uint64_t(1) << 32) | (uint64_t(num) << 16) | tag;
+    while ((*hdr & 0x1ffffffffULL) != done)
+    {
+        if (qaBackoff(trips))
+        {
+            printf("  Waiting for status register snapshot...\n");
+        }
+    }
+
+    volatile uint64_t* data =
+        (volatile uint64_t*)DSMAddress(CL(DSM_SREG_SNAPSHOT_DATA_LINE));
+    values.resize(num);
+    for (uint32_t i = 0; i < num; i++)
+    {
+        values[i] = data[i];
+    }
+
+    return true;
+}
+
+
 void
 AFU_CLASS::RunTests(QA_HOST_CHANNELS_DEVICE qa)
 {
-#if (QA_PLATFORM_MEMTEST != 0)
-    void* base = CreateSharedBufferInVM(MB(64));
-    // Send base PA
+    if (memTestLevel == QA_MEMTEST_OFF)
+    {
+        return;
+    }
+
+    if (QA_PLATFORM_MEMTEST == 0)
+    {
+        printf("Memory test requested but the FPGA was built without the tester (QA_PLATFORM_MEMTEST)\n");
+        return;
+    }
+
+    // The tester cycles through lines within a 2MB page
+    void* base = CreateSharedBufferInVM(MB(2));
     uint64_t base_line = uint64_t(base) >> 6;
-    uint64_t pa_line = SharedBufferVAtoPA(base) >> 6;
-    printf("Host VA: 0x%p, VA line: 0x%016llx\n", base, base_line);
-    printf("Host PA: 0x%016llx, PA line: 0x%016llx\n", SharedBufferVAtoPA(base), pa_line);
+    printf("Memory test host VA: 0x%p, PA: 0x%016llx\n",
+           base, SharedBufferVAtoPA(base));
 
     // Send 30 bits at a time, high part first.  Low 2 bits must be 0 and
     // aren't part of the address.
     ReadSREG64(uint32_t((base_line >> 30) << 2));
     ReadSREG64(uint32_t(base_line << 2));
 
-    uint32_t cached = 4;
-    uint32_t check_order = 8;
-    uint32_t trips = 0x3ffff00 | cached | check_order;
-//    trips = 8192 | cached | check_order;
-    uint64_t cycles;
-    uint64_t rdWrCnt;
-    uint64_t totalActiveRd;
-
-    printf("Trips %d, %scached, %sordered\n",
-           trips & ~3,
-           trips & 4 ? "" : "not ",
-           trips & 8 ? "" : "not ");
-
-    double gb;
-    double sec;
-
-    cycles = ReadSREG64(trips | 1);
-    rdWrCnt = ReadSREG64(0);
-    totalActiveRd = ReadSREG64(0);
-    gb = 64.0 * double(rdWrCnt >> 32) / (1024.0 * 1024.0 * 1024.0);
-    sec = 5.0 * double(cycles) * 1.0e-9;
-    printf("Read %ld in %lld cycles (%0.4f GB/s), latency %lld cycles (%d ns)\n",
-           rdWrCnt >> 32, cycles,
-           gb / sec,
-           totalActiveRd / cycles, 5 * totalActiveRd / cycles);
-
-    *(uint64_t*)base = 0xdeadbeef;
-    cycles = ReadSREG64(trips | 2);
-    rdWrCnt = ReadSREG64(0);
-    totalActiveRd = ReadSREG64(0);
-    gb = 64.0 * double(rdWrCnt & 0xffffffff) / (1024.0 * 1024.0 * 1024.0);
-    sec = 5.0 * double(cycles) * 1.0e-9;
-    printf("Write %ld in %lld cycles (%0.4f GB/s)\n",
-           rdWrCnt & 0xffffffff, cycles,
-           gb / sec);
-
-    *(uint64_t*)base = 0xdeadbeef;
-    cycles = ReadSREG64(trips | 2);
-    rdWrCnt = ReadSREG64(0);
-    totalActiveRd = ReadSREG64(0);
-    gb = 64.0 * double(rdWrCnt & 0xffffffff) / (1024.0 * 1024.0 * 1024.0);
-    sec = 5.0 * double(cycles) * 1.0e-9;
-    printf("Write %ld in %lld cycles (%0.4f GB/s)\n",
-           rdWrCnt & 0xffffffff, cycles,
-           gb / sec);
-
-    cycles = ReadSREG64(trips | 3);
-    rdWrCnt = ReadSREG64(0);
-    totalActiveRd = ReadSREG64(0);
-    gb = 64.0 * (double(rdWrCnt >> 32) + double(rdWrCnt & 0xffffffff)) / (1024.0 * 1024.0 * 1024.0);
-    sec = 5.0 * double(cycles) * 1.0e-9;
-    printf("Read %ld in %lld cycles\n",
-           rdWrCnt >> 32, cycles);
-    printf("Write %ld in %lld cycles\n",
-           rdWrCnt & 0xffffffff, cycles);
-    printf("Total throughput %0.4f GB/s)\n", gb / sec);
-#endif
+    //
+    // Derive the FPGA clock period from host time.  Two runs of different
+    // lengths cancel fixed request overheads.
+    //
+    QA_MEMTEST_RESULT cal_short, cal_long;
+    RunMemTest(MEMTEST_READ, 15, true, false, 1 << 20, cal_short);
+    RunMemTest(MEMTEST_READ, 15, true, false, 1 << 23, cal_long);
+
+    double ns_per_cycle = 0;
+    if (cal_long.cycles > cal_short.cycles)
+    {
+        ns_per_cycle = double(cal_long.wallNs - cal_short.wallNs) /
+                       double(cal_long.cycles - cal_short.cycles);
+    }
+    printf("Memory test clock: %0.3f ns/cycle (%0.1f MHz)\n",
+           ns_per_cycle, ns_per_cycle ? 1000.0 / ns_per_cycle : 0.0);
+
+    //
+    // Sweep the working set size, FPGA-side caching and ordering for
+    // read, write and mixed traffic.  Each result is a CSV row prefixed
+    // with "memtest," for easy extraction from the log.
+    //
+    printf("memtest,mode,set_bytes,cached,ordered,trips,cycles,lines_rd,lines_wr,"
+           "rd_gbs,wr_gbs,total_gbs,rd_lat_cycles,rd_lat_ns\n");
+
+    const uint32_t quick_sets[] = { 15 };
+    const uint32_t full_sets[] = { 6, 9, 12, 15 };
+    const uint32_t* sets = (memTestLevel == QA_MEMTEST_SWEEP) ? full_sets : quick_sets;
+    uint32_t n_sets = (memTestLevel == QA_MEMTEST_SWEEP) ?
+                          sizeof(full_sets) / sizeof(full_sets[0]) :
+                          sizeof(quick_sets) / sizeof(quick_sets[0]);
+
+    const char* mode_names[] = { "", "read", "write", "mixed" };
+
+    for (uint32_t s = 0; s < n_sets; s++)
+    {
+        for (int cached = 0; cached < 2; cached++)
+        {
+            for (int ordered = 0; ordered < 2; ordered++)
+            {
+                for (uint32_t mode = MEMTEST_READ; mode <= MEMTEST_MIXED; mode++)
+                {
+                    QA_MEMTEST_RESULT r;
+                    uint32_t trips = 1 << 22;
+                    RunMemTest(QA_MEMTEST_TYPE(mode), sets[s], cached, ordered,
+                               trips, r);
+
+                    double ns = ns_per_cycle * double(r.cycles);
+                    double rd_gbs = ns ? CL(1) * double(r.linesRead) / ns : 0;
+                    double wr_gbs = ns ? CL(1) * double(r.linesWritten) / ns : 0;
+
+                    // Little's Law: latency is the average number of reads
+                    // in flight divided by the read rate.
+                    double lat = r.linesRead ?
+                                     double(r.readsActive) / double(r.linesRead) : 0;
+
+                    printf("memtest,%s,%lld,%d,%d,%u,%lld,%lld,%lld,"
+                           "%0.4f,%0.4f,%0.4f,%0.1f,%0.1f\n",
+                           mode_names[mode],
+                           (long long)(CL(1) << sets[s]),
+                           cached, ordered,
+                           trips,
+                           (long long)r.cycles,
+                           (long long)r.linesRead,
+                           (long long)r.linesWritten,
+                           rd_gbs, wr_gbs, rd_gbs + wr_gbs,
+                           lat, lat * ns_per_cycle);
+                }
+            }
+        }
+    }
+
+    FreeSharedBufferInVM(base);
+}
+
+
+//
+// Run one memory test on the FPGA-side tester.  The working set is
+// 2^log_lines lines.  The request blocks until the test completes.
+//
+void
+AFU_CLASS::RunMemTest(QA_MEMTEST_TYPE mode,
+                      uint32_t log_lines,
+                      bool cached,
+                      bool ordered,
+                      uint32_t trips,
+                      QA_MEMTEST_RESULT& result)
+{
+    // Request encoding must match mkPhysicalPlatformMemTester:
+    //   [1:0]  - test mode
+    //   [2]    - cached
+    //   [3]    - enforce order
+    //   [7:4]  - log2 of working set lines (0 means 15)
+    //   [31:8] - trips (multiple of 256)
+    uint32_t req = (trips & ~0xff) |
+                   ((log_lines & 0xf) << 4) |
+                   (ordered ? 8 : 0) |
+                   (cached ? 4 : 0) |
+                   uint32_t(mode);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    result.cycles = ReadSREG64(req);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    result.wallNs = uint64_t(t1.tv_sec - t0.tv_sec) * 1000000000 +
+                    t1.tv_nsec - t0.tv_nsec;
+
+    // The next two status registers hold the result.  The tester ignores
+    // the register index so fetch both in one snapshot.
+    std::vector<uint64_t> v;
+    if (! SnapshotSREG64(0, 2, v))
+    {
+        fprintf(stderr, "ERROR: Memory test result snapshot failed\n");
+        exit(1);
+    }
+
+    result.linesRead = v[0] >> 32;
+    result.linesWritten = v[0] & 0xffffffff;
+    result.readsActive = v[1];
 }
 
 
@@ -287,12 +796,24 @@ AFU_CLIENT_CLASS::AFU_CLIENT_CLASS(AFU afu, AFU_RUNTIME_CLIENT rtc) :
     m_runtimeClient(rtc),
 #if (CCI_S_IFC != 0)
     m_Service(NULL),
+    afu_ccis_compat(NULL),
 #else
     m_pALIBufferService(NULL),
     m_pALIMMIOService(NULL),
     m_pALIResetService(NULL),
+    m_mpf_vtp(NULL),
+    m_mpf_vc_map(NULL),
+    m_mpf_wro(NULL),
+    m_mpf_pwrite(NULL),
 #endif
     m_Result(0),
+    m_statZeroBytes(0),
+    m_statZeroWallNs(0),
+    m_statZeroThreadNs(0),
+    m_statZeroSkippedBytes(0),
+    m_mmioStats(NULL),
+    m_mpfSampler(NULL),
+    m_mpfSamplerStop(false),
     m_WrkVA(NULL),
     m_WrkPA(0),
     m_WrkBytes(0)
@@ -308,16 +829,21 @@ AFU_CLIENT_CLASS::AFU_CLIENT_CLASS(AFU afu, AFU_RUNTIME_CLIENT rtc) :
 
     m_Sem.Create(0, 1);
     m_SemWrk.Create(0, 1);
+
+    m_mmioStats = new MMIO_OFFSET_STATS[MMIO_STATS_OFFSETS];
+    ResetStats();
 }
 
 AFU_CLIENT_CLASS::~AFU_CLIENT_CLASS()
 {
     m_Sem.Destroy();
     m_SemWrk.Destroy();
+
+    delete[] m_mmioStats;
 }
 
 btInt
-AFU_CLIENT_CLASS::InitService(const char* afuID)
+AFU_CLIENT_CLASS::InitService(const char* afuID, int pciBus)
 {
     // Request our AFU.
     //
@@ -344,10 +870,22 @@ AFU_CLIENT_CLASS::InitService(const char* afuID)
 
     config_record.Add(keyRegAFU_ID, afuID);
 
+    // Pick a specific FPGA when more than one is present
+    if (pciBus != QA_ANY_PCI_BUS)
+    {
+        config_record.Add(keyRegBusNumber, btUnsigned32bitInt(pciBus));
+    }
+
 #else
     // Use ASE based RTL simulation
     manifest.Add(keyRegHandle, 20);
 
+    // ASE simulates a single FPGA
+    if (pciBus != QA_ANY_PCI_BUS)
+    {
+        fprintf(stderr, "WARNING: PCI bus %d ignored in ASE simulation\n", pciBus);
+    }
+
   #if (CCI_S_IFC != 0)
     // CCI-S
     config_record.Add(AAL_FACTORY_CREATE_CONFIGRECORD_FULL_SERVICE_NAME, "libASECCIAFU");
@@ -372,6 +910,7 @@ AFU_CLIENT_CLASS::InitService(const char* afuID)
     m_runtimeClient->getRuntime()->allocService(dynamic_cast<IBase *>(this),
                                                 manifest);
     m_Sem.Wait();
+    afu->MarkStartupPhase("AFU service allocated");
 
 
 #if (CCI_S_IFC != 0)
@@ -415,7 +954,41 @@ AFU_CLIENT_CLASS::InitService(const char* afuID)
         m_mpf_vc_map = new MPFVCMAP(m_pALIMMIOService, m_VCMAPDFHOffset);
         assert(m_mpf_vc_map->isOK());
     }
+
+    //
+    // Write/read ordering and partial write features are managed entirely
+    // in hardware.  They are found only to read their statistics.
+    //
+    NamedValueSet wro_filter;
+    wro_filter.Add(ALI_GETFEATURE_TYPE_KEY, static_cast<ALI_GETFEATURE_TYPE_DATATYPE>(ALI_DFH_TYPE_BBB));
+    wro_filter.Add(ALI_GETFEATURE_ID_KEY, static_cast<ALI_GETFEATURE_ID_DATATYPE>(1));
+    wro_filter.Add(ALI_GETFEATURE_GUID_KEY, (ALI_GETFEATURE_GUID_DATATYPE)MPF_WRO_BBB_GUID);
+
+    m_mpf_wro = NULL;
+    if (m_pALIMMIOService->mmioGetFeatureOffset(&m_WRODFHOffset, wro_filter))
+    {
+        m_mpf_wro = new MPFWRO(m_pALIMMIOService, m_WRODFHOffset);
+        assert(m_mpf_wro->isOK());
+    }
+
+    NamedValueSet pwrite_filter;
+    pwrite_filter.Add(ALI_GETFEATURE_TYPE_KEY, static_cast<ALI_GETFEATURE_TYPE_DATATYPE>(ALI_DFH_TYPE_BBB));
+    pwrite_filter.Add(ALI_GETFEATURE_ID_KEY, static_cast<ALI_GETFEATURE_ID_DATATYPE>(1));
+    pwrite_filter.Add(ALI_GETFEATURE_GUID_KEY, (ALI_GETFEATURE_GUID_DATATYPE)MPF_PWRITE_BBB_GUID);
+
+    m_mpf_pwrite = NULL;
+    if (m_pALIMMIOService->mmioGetFeatureOffset(&m_PWRITEDFHOffset, pwrite_filter))
+    {
+        m_mpf_pwrite = new MPFPWRITE(m_pALIMMIOService, m_PWRITEDFHOffset);
+        assert(m_mpf_pwrite->isOK());
+    }
 #endif
+    afu->MarkStartupPhase("VTP initialized");
+
+    if (QA_MPF_SAMPLE_MS != 0)
+    {
+        StartMPFSampler();
+    }
 
     return m_Result;
 }
@@ -424,10 +997,33 @@ AFU_CLIENT_CLASS::InitService(const char* afuID)
 btInt
 AFU_CLIENT_CLASS::UninitService()
 {
+    ReleaseMPF();
+
     (dynamic_ptr<IAALService>(iidService, m_pAALService))->Release(TransactionID());
     m_Sem.Wait();
+}
 
-    m_runtimeClient->end();
+
+void
+AFU_CLIENT_CLASS::ReleaseMPF()
+{
+    // The sampler reads MPF counters
+    StopMPFSampler();
+
+#if (CCI_S_IFC != 0)
+    delete afu_ccis_compat;
+    afu_ccis_compat = NULL;
+#else
+    // Deleting VTP stops translation and frees the page table
+    delete m_mpf_vtp;
+    m_mpf_vtp = NULL;
+    delete m_mpf_vc_map;
+    m_mpf_vc_map = NULL;
+    delete m_mpf_wro;
+    m_mpf_wro = NULL;
+    delete m_mpf_pwrite;
+    m_mpf_pwrite = NULL;
+#endif
 }
 
 
@@ -451,6 +1047,8 @@ AFU_CLIENT_CLASS::ResetAFU()
     csr &= ~CIPUCTL_RESET_BIT;
     WriteCSR(CSR_CIPUCTL, csr);
 #else
+    auto lock = LockMMIO();
+
     if (m_pALIResetService->afuReset())
     {
         fprintf(stderr, "ERROR: Failed AFU reset\n");
@@ -465,7 +1063,7 @@ AFU_CLIENT_CLASS::ResetAFU()
 
 
 AFU_BUFFER
-AFU_CLIENT_CLASS::CreateSharedBuffer(ssize_t size_bytes)
+AFU_CLIENT_CLASS::CreateSharedBuffer(ssize_t size_bytes, bool zero)
 {
 #if (CCI_S_IFC != 0)
 
@@ -506,11 +1104,12 @@ AFU_CLIENT_CLASS::CreateSharedBuffer(ssize_t size_bytes)
     buffer->virtualAddress = m_WrkVA;
     buffer->physicalAddress = m_WrkPA;
     buffer->numBytes = m_WrkBytes;
+    buffer->allocBytes = m_WrkBytes;
 
     // set contents of buffer to 0
     if (buffer->virtualAddress != NULL)
     {
-        memset((void *)buffer->virtualAddress, 0, size_bytes);
+        ZeroSharedBuffer(buffer->virtualAddress, size_bytes, zero);
         return buffer;
     }
 
@@ -520,6 +1119,82 @@ AFU_CLIENT_CLASS::CreateSharedBuffer(ssize_t size_bytes)
 }
 
 
+//
+// Buffers at least this large are zeroed in parallel.
+//
+#define ZERO_PARALLEL_MIN_BYTES MB(64)
+#define ZERO_MAX_THREADS 8
+
+static inline uint64_t
+zeroNowNs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return uint64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
+void
+AFU_CLIENT_CLASS::ZeroSharedBuffer(volatile void* va, size_t size_bytes, bool zero)
+{
+    if (! zero)
+    {
+        m_statZeroSkippedBytes += size_bytes;
+        return;
+    }
+
+    uint64_t start = zeroNowNs();
+
+    size_t n_threads = std::thread::hardware_concurrency();
+    if (n_threads > ZERO_MAX_THREADS) n_threads = ZERO_MAX_THREADS;
+
+    if ((size_bytes < ZERO_PARALLEL_MIN_BYTES) || (n_threads <= 1))
+    {
+        memset((void *)va, 0, size_bytes);
+
+        uint64_t t = zeroNowNs() - start;
+        m_statZeroWallNs += t;
+        m_statZeroThreadNs += t;
+    }
+    else
+    {
+        //
+        // Split the buffer into page-aligned slices, one per thread.
+        // The first touch of each page is the expensive part, so the
+        // speedup comes mostly from faulting pages in parallel.
+        //
+        size_t slice = (size_bytes / n_threads + 4095) & ~size_t(4095);
+        std::vector<std::thread> workers;
+        std::vector<uint64_t> thread_ns(n_threads, 0);
+
+        for (size_t i = 0; i < n_threads; i++)
+        {
+            size_t offset = i * slice;
+            if (offset >= size_bytes) break;
+            size_t len = (size_bytes - offset < slice) ? size_bytes - offset : slice;
+            uint8_t* p = (uint8_t*)va + offset;
+            uint64_t* ns = &thread_ns[i];
+
+            workers.push_back(std::thread([p, len, ns]()
+                {
+                    uint64_t t0 = zeroNowNs();
+                    memset(p, 0, len);
+                    *ns = zeroNowNs() - t0;
+                }));
+        }
+
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            workers[i].join();
+            m_statZeroThreadNs += thread_ns[i];
+        }
+
+        m_statZeroWallNs += zeroNowNs() - start;
+    }
+
+    m_statZeroBytes += size_bytes;
+}
+
+
 void
 AFU_CLIENT_CLASS::FreeSharedBuffer(AFU_BUFFER buffer)
 {
@@ -545,6 +1220,7 @@ AFU_CLIENT_CLASS::CreateSharedBufferInVM(ssize_t size_bytes)
     ali_errnum_e st;
     btVirtAddr va;
 
+    auto lock = LockMMIO();
     st = m_mpf_vtp->bufferAllocate(size_bytes, &va);
     assert(st == ali_errnumOK);
 
@@ -553,6 +1229,19 @@ AFU_CLIENT_CLASS::CreateSharedBufferInVM(ssize_t size_bytes)
 }
 
 
+void
+AFU_CLIENT_CLASS::FreeSharedBufferInVM(void* va)
+{
+#if (CCI_S_IFC != 0)
+    afu_ccis_compat->FreeSharedBuffer(va);
+#else
+    auto lock = LockMMIO();
+    ali_errnum_e st = m_mpf_vtp->bufferFree(btVirtAddr(va));
+    assert(st == ali_errnumOK);
+#endif
+}
+
+
 btPhysAddr
 AFU_CLIENT_CLASS::SharedBufferVAtoPA(const void* va)
 {
@@ -705,6 +1394,47 @@ void AFU_CLIENT_CLASS::OnWorkspaceFreeFailed(const IEvent &rEvent)
 void
 AFU_CLIENT_CLASS::EmitStats(ofstream &statusFile)
 {
+    //
+    // Shared buffer zeroing.  The time saved by parallel zeroing is the
+    // difference between the total thread time and the elapsed time.
+    // The time saved by skipping zeroing is estimated from the measured
+    // single thread zeroing rate.
+    //
+    uint64_t zero_saved_ns = 0;
+    if (m_statZeroThreadNs > m_statZeroWallNs)
+    {
+        zero_saved_ns = m_statZeroThreadNs - m_statZeroWallNs;
+    }
+    if (m_statZeroBytes != 0)
+    {
+        double ns_per_byte = double(m_statZeroThreadNs) / m_statZeroBytes;
+        zero_saved_ns += uint64_t(ns_per_byte * m_statZeroSkippedBytes);
+    }
+
+    statusFile << "QA_BUFFER_ZERO_BYTES,"
+               << "\"Shared buffer bytes zeroed\","
+               << m_statZeroBytes
+               << endl;
+    statusFile << "QA_BUFFER_ZERO_SKIPPED_BYTES,"
+               << "\"Shared buffer bytes not zeroed by request\","
+               << m_statZeroSkippedBytes
+               << endl;
+    statusFile << "QA_BUFFER_ZERO_TIME_NS,"
+               << "\"Elapsed time zeroing shared buffers (ns)\","
+               << m_statZeroWallNs
+               << endl;
+    statusFile << "QA_BUFFER_ZERO_SAVED_NS,"
+               << "\"Estimated zeroing time saved by threads and skipping (ns)\","
+               << zero_saved_ns
+               << endl;
+
+    if (QA_MMIO_STATS)
+    {
+        EmitMMIOStats(statusFile);
+    }
+
+    auto lock = LockMMIO();
+
     statusFile << "CCI_MPF_VTP_CSR_STAT_4KB_TLB_NUM_HITS,"
                << "\"VTP 4KB TLB Hits\","
                << GetStatVTP(CCI_MPF_VTP_CSR_STAT_4KB_TLB_NUM_HITS)
@@ -721,6 +1451,14 @@ AFU_CLIENT_CLASS::EmitStats(ofstream &statusFile)
                << "\"VTP 2MB TLB Misses\","
                << GetStatVTP(CCI_MPF_VTP_CSR_STAT_2MB_TLB_NUM_MISSES)
                << endl;
+    statusFile << "CCI_MPF_VTP_CSR_STAT_1GB_TLB_NUM_HITS,"
+               << "\"VTP 1GB TLB Hits\","
+               << GetStatVTP(CCI_MPF_VTP_CSR_STAT_1GB_TLB_NUM_HITS)
+               << endl;
+    statusFile << "CCI_MPF_VTP_CSR_STAT_1GB_TLB_NUM_MISSES,"
+               << "\"VTP 1GB TLB Misses\","
+               << GetStatVTP(CCI_MPF_VTP_CSR_STAT_1GB_TLB_NUM_MISSES)
+               << endl;
     statusFile << "CCI_MPF_VTP_CSR_STAT_PT_WALK_BUSY_CYCLES,"
                << "\"VTP Page Table Walk Busy Cycles\","
                << GetStatVTP(CCI_MPF_VTP_CSR_STAT_PT_WALK_BUSY_CYCLES)
@@ -751,8 +1489,294 @@ AFU_CLIENT_CLASS::EmitStats(ofstream &statusFile)
 void
 AFU_CLIENT_CLASS::ResetStats()
 {
+    for (uint32_t i = 0; i < MMIO_STATS_OFFSETS; i++)
+    {
+        m_mmioStats[i].reads = 0;
+        m_mmioStats[i].writes = 0;
+        m_mmioStats[i].readNs = 0;
+        m_mmioStats[i].readMaxNs = 0;
+    }
+
+    for (uint32_t i = 0; i < MMIO_LAT_BUCKETS; i++)
+    {
+        m_mmioReadLatHist[i] = 0;
+    }
+}
+
+
+//
+// Record a completed MMIO read.  Counters are relaxed atomics, so they
+// are cheap compared to the MMIO read itself and may be left enabled.
+//
+void
+AFU_CLIENT_CLASS::NoteMMIORead(btCSROffset offset, uint64_t start_ns)
+{
+    uint64_t ns = MMIONowNs() - start_ns;
+    MMIO_OFFSET_STATS& st = m_mmioStats[MMIOStatsIdx(offset)];
+
+    st.reads.fetch_add(1, std::memory_order_relaxed);
+    st.readNs.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t max_ns = st.readMaxNs.load(std::memory_order_relaxed);
+    while ((ns > max_ns) &&
+           ! st.readMaxNs.compare_exchange_weak(max_ns, ns,
+                                                std::memory_order_relaxed))
+    {
+    }
+
+    // Bucket i holds latencies in [2^i, 2^(i+1)) ns
+    uint32_t bucket = (ns == 0) ? 0 : 63 - __builtin_clzll(ns);
+    if (bucket >= MMIO_LAT_BUCKETS) bucket = MMIO_LAT_BUCKETS - 1;
+    m_mmioReadLatHist[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+
+//
+// MMIO totals and read latency histogram, followed by counters for each
+// CSR offset that was used.  Offsets are byte offsets in hex.  Each
+// histogram bucket counts reads shorter than the next bucket's bound.
+//
+void
+AFU_CLIENT_CLASS::EmitMMIOStats(ofstream &statusFile)
+{
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t read_ns = 0;
+
+    for (uint32_t i = 0; i < MMIO_STATS_OFFSETS; i++)
+    {
+        reads += m_mmioStats[i].reads;
+        writes += m_mmioStats[i].writes;
+        read_ns += m_mmioStats[i].readNs;
+    }
+
+    statusFile << "QA_MMIO_READS,"
+               << "\"MMIO reads\","
+               << reads
+               << endl;
+    statusFile << "QA_MMIO_WRITES,"
+               << "\"MMIO writes\","
+               << writes
+               << endl;
+    statusFile << "QA_MMIO_READ_NS,"
+               << "\"Total time waiting for MMIO reads (ns)\","
+               << read_ns
+               << endl;
+
+    for (uint32_t b = 0; b < MMIO_LAT_BUCKETS; b++)
+    {
+        statusFile << "QA_MMIO_READ_LAT_HIST_" << b << ","
+                   << "\"MMIO reads taking at least " << (uint64_t(1) << b)
+                   << " ns\","
+                   << m_mmioReadLatHist[b]
+                   << endl;
+    }
+
+    for (uint32_t i = 0; i < MMIO_STATS_OFFSETS; i++)
+    {
+        const MMIO_OFFSET_STATS& st = m_mmioStats[i];
+        if ((st.reads == 0) && (st.writes == 0)) continue;
+
+        char name[64];
+        if (i == MMIO_STATS_OFFSETS - 1)
+        {
+            snprintf(name, sizeof(name), "QA_MMIO_OTHER");
+        }
+        else
+        {
+            snprintf(name, sizeof(name), "QA_MMIO_%04X", i << 2);
+        }
+
+        uint64_t n_reads = st.reads;
+        statusFile << name << "_READS,"
+                   << "\"MMIO reads at offset\","
+                   << n_reads
+                   << endl;
+        statusFile << name << "_WRITES,"
+                   << "\"MMIO writes at offset\","
+                   << st.writes
+                   << endl;
+        if (n_reads != 0)
+        {
+            statusFile << name << "_READ_AVG_NS,"
+                       << "\"MMIO read average latency at offset (ns)\","
+                       << st.readNs / n_reads
+                       << endl;
+            statusFile << name << "_READ_MAX_NS,"
+                       << "\"MMIO read maximum latency at offset (ns)\","
+                       << st.readMaxNs
+                       << endl;
+        }
+    }
+}
+
+
+//
+// MPF counter sampling
+//
+
+void
+AFU_CLIENT_CLASS::StartMPFSampler()
+{
+    m_mpfSamplerStop = false;
+    m_mpfSampler = new std::thread(&AFU_CLIENT_CLASS::MPFSamplerThread, this);
 }
 
+
+void
+AFU_CLIENT_CLASS::StopMPFSampler()
+{
+    if (m_mpfSampler == NULL) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mpfSamplerLock);
+        m_mpfSamplerStop = true;
+    }
+    m_mpfSamplerCond.notify_all();
+
+    m_mpfSampler->join();
+    delete m_mpfSampler;
+    m_mpfSampler = NULL;
+}
+
+
+void
+AFU_CLIENT_CLASS::SampleMPF(MPF_SAMPLE& s)
+{
+    memset(&s, 0, sizeof(s));
+
+    auto lock = LockMMIO();
+    s.timeNs = MMIONowNs();
+
+    s.tlbHits4KB = GetStatVTP(CCI_MPF_VTP_CSR_STAT_4KB_TLB_NUM_HITS);
+    s.tlbMisses4KB = GetStatVTP(CCI_MPF_VTP_CSR_STAT_4KB_TLB_NUM_MISSES);
+    s.tlbHits2MB = GetStatVTP(CCI_MPF_VTP_CSR_STAT_2MB_TLB_NUM_HITS);
+    s.tlbMisses2MB = GetStatVTP(CCI_MPF_VTP_CSR_STAT_2MB_TLB_NUM_MISSES);
+    s.tlbHits1GB = GetStatVTP(CCI_MPF_VTP_CSR_STAT_1GB_TLB_NUM_HITS);
+    s.tlbMisses1GB = GetStatVTP(CCI_MPF_VTP_CSR_STAT_1GB_TLB_NUM_MISSES);
+    s.ptWalkBusyCycles = GetStatVTP(CCI_MPF_VTP_CSR_STAT_PT_WALK_BUSY_CYCLES);
+    s.failedTranslations = GetStatVTP(CCI_MPF_VTP_CSR_STAT_FAILED_TRANSLATIONS);
+
+#if (CCI_S_IFC == 0)
+    if (m_mpf_vc_map)
+    {
+        s.vcMapChanges = m_mpf_vc_map->vcmapGetStatCounter(CCI_MPF_VC_MAP_CSR_STAT_NUM_MAPPING_CHANGES);
+        s.vcMapHistory = m_mpf_vc_map->vcmapGetMappingHistory();
+    }
+
+    if (m_mpf_wro)
+    {
+        s.wroConflictsRR = m_mpf_wro->wroGetStatCounter(CCI_MPF_WRO_CSR_STAT_RR_CONFLICT);
+        s.wroConflictsRW = m_mpf_wro->wroGetStatCounter(CCI_MPF_WRO_CSR_STAT_RW_CONFLICT);
+        s.wroConflictsWR = m_mpf_wro->wroGetStatCounter(CCI_MPF_WRO_CSR_STAT_WR_CONFLICT);
+        s.wroConflictsWW = m_mpf_wro->wroGetStatCounter(CCI_MPF_WRO_CSR_STAT_WW_CONFLICT);
+    }
+
+    if (m_mpf_pwrite)
+    {
+        s.partialWrites = m_mpf_pwrite->pwriteGetStatCounter(CCI_MPF_PWRITE_CSR_STAT_NUM_PWRITES);
+    }
+#endif
+}
+
+
+//
+// Write one CSV row per interval.  Counters are reported as the change
+// since the previous sample.  Rates are per second of host time.
+//
+void
+AFU_CLIENT_CLASS::MPFSamplerThread()
+{
+    // Each AFU writes its own file
+    std::string fname = QA_MPF_SAMPLE_FILE;
+    if (afu->GetInstanceIdx() != 0)
+    {
+        fname += "." + std::to_string(afu->GetInstanceIdx());
+    }
+
+    FILE* f = fopen(fname.c_str(), "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Failed to open MPF sample file %s\n", fname.c_str());
+        return;
+    }
+
+    fprintf(f, "time_ms,interval_ms,"
+               "tlb_4kb_hits,tlb_4kb_misses,tlb_2mb_hits,tlb_2mb_misses,"
+               "tlb_1gb_hits,tlb_1gb_misses,"
+               "tlb_hit_rate,tlb_misses_per_sec,"
+               "pt_walk_busy_cycles,pt_walk_busy_frac,pt_walk_cycles_per_miss,"
+               "failed_translations,"
+               "vc_map_changes,vl0_share,"
+               "wro_rr,wro_rw,wro_wr,wro_ww,"
+               "partial_writes,partial_writes_per_sec\n");
+
+    MPF_SAMPLE first, prev, cur;
+    SampleMPF(first);
+    prev = first;
+
+    std::unique_lock<std::mutex> lock(m_mpfSamplerLock);
+    while (! m_mpfSamplerStop)
+    {
+        m_mpfSamplerCond.wait_for(lock, std::chrono::milliseconds(QA_MPF_SAMPLE_MS));
+
+        SampleMPF(cur);
+
+        double sec = double(cur.timeNs - prev.timeNs) * 1.0e-9;
+        if (sec <= 0) continue;
+
+        uint64_t hits = (cur.tlbHits4KB - prev.tlbHits4KB) +
+                        (cur.tlbHits2MB - prev.tlbHits2MB) +
+                        (cur.tlbHits1GB - prev.tlbHits1GB);
+        uint64_t misses = (cur.tlbMisses4KB - prev.tlbMisses4KB) +
+                          (cur.tlbMisses2MB - prev.tlbMisses2MB) +
+                          (cur.tlbMisses1GB - prev.tlbMisses1GB);
+        uint64_t walk = cur.ptWalkBusyCycles - prev.ptWalkBusyCycles;
+        uint64_t pwrites = cur.partialWrites - prev.partialWrites;
+
+        // The most recent VC mapping ratio is in the low 8 bits, in 64ths
+        double vl0_share = double(cur.vcMapHistory & 0xff) / 64.0;
+
+        fprintf(f, "%0.3f,%0.3f,"
+                   "%lld,%lld,%lld,%lld,"
+                   "%lld,%lld,"
+                   "%0.4f,%0.1f,"
+                   "%lld,%0.4f,%0.1f,"
+                   "%lld,"
+                   "%lld,%0.4f,"
+                   "%lld,%lld,%lld,%lld,"
+                   "%lld,%0.1f\n",
+                double(cur.timeNs - first.timeNs) * 1.0e-6,
+                sec * 1000.0,
+                (long long)(cur.tlbHits4KB - prev.tlbHits4KB),
+                (long long)(cur.tlbMisses4KB - prev.tlbMisses4KB),
+                (long long)(cur.tlbHits2MB - prev.tlbHits2MB),
+                (long long)(cur.tlbMisses2MB - prev.tlbMisses2MB),
+                (long long)(cur.tlbHits1GB - prev.tlbHits1GB),
+                (long long)(cur.tlbMisses1GB - prev.tlbMisses1GB),
+                (hits + misses) ? double(hits) / double(hits + misses) : 0.0,
+                double(misses) / sec,
+                (long long)walk,
+                double(walk) / (sec * afu->GetMPFClockMHz() * 1.0e6),
+                misses ? double(walk) / double(misses) : 0.0,
+                (long long)(cur.failedTranslations - prev.failedTranslations),
+                (long long)(cur.vcMapChanges - prev.vcMapChanges),
+                vl0_share,
+                (long long)(cur.wroConflictsRR - prev.wroConflictsRR),
+                (long long)(cur.wroConflictsRW - prev.wroConflictsRW),
+                (long long)(cur.wroConflictsWR - prev.wroConflictsWR),
+                (long long)(cur.wroConflictsWW - prev.wroConflictsWW),
+                (long long)pwrites,
+                double(pwrites) / sec);
+        fflush(f);
+
+        prev = cur;
+    }
+
+    fclose(f);
+}
+
+
 uint64_t
 AFU_CLIENT_CLASS::GetStatVTP(t_cci_mpf_vtp_csr_offsets stat)
 {
@@ -37,7 +37,15 @@
 #undef TRACE
 
 #include <time.h>
+#include <unistd.h>
+#include <sched.h>
 #include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 
 #ifdef Register
 #undef Register
@@ -90,7 +98,8 @@ typedef struct
 {
     volatile uint8_t *virtualAddress;
     btPhysAddr        physicalAddress;
-    uint64_t          numBytes;
+    uint64_t          numBytes;         // Size requested by the caller
+    uint64_t          allocBytes;       // Size pinned (the pool size class)
 }
 AFU_BUFFER_CLASS;
 
@@ -98,26 +107,136 @@ AFU_BUFFER_CLASS;
 typedef const AFU_BUFFER_CLASS *AFU_BUFFER;
 typedef class AFU_CLASS *AFU;
 
-class AFU_CLASS
+//
+// One step of a bounded spin/backoff wait.  Callers loop until their
+// condition is met, passing the same counter each trip.  The first trips
+// spin, then yield the CPU, then sleep for increasing intervals capped at
+// 1 ms.  Returns true roughly once per second of waiting so that callers
+// may report progress.
+//
+static inline bool
+qaBackoff(uint32_t& trips)
+{
+    trips += 1;
+
+    if (trips < 1000)
+    {
+        __builtin_ia32_pause();
+    }
+    else if (trips < 1100)
+    {
+        sched_yield();
+    }
+    else
+    {
+        uint32_t us = (trips - 1100) * 10;
+        if (us > 1000) us = 1000;
+        usleep(us + 1);
+    }
+
+    // About one second of 1 ms sleeps
+    return (trips > 1100) && ((trips % 1000) == 0);
+}
+
+
+// Let AAL pick any device with a matching AFU ID
+#define QA_ANY_PCI_BUS (-1)
+
+//
+// Host memory benchmark, driven by the FPGA-side memory tester.  The
+// tester is present only when the FPGA is built with QA_PLATFORM_MEMTEST.
+//
+typedef enum
+{
+    QA_MEMTEST_OFF = 0,
+    // 2MB working set, all traffic types
+    QA_MEMTEST_QUICK = 1,
+    // Also sweep the working set size
+    QA_MEMTEST_SWEEP = 2
+}
+QA_MEMTEST_LEVEL;
+
+// Test type, encoded in the tester's request
+typedef enum
+{
+    MEMTEST_READ = 1,
+    MEMTEST_WRITE = 2,
+    MEMTEST_MIXED = 3
+}
+QA_MEMTEST_TYPE;
+
+typedef struct
+{
+    uint64_t cycles;
+    uint64_t wallNs;
+    uint64_t linesRead;
+    uint64_t linesWritten;
+    // Sum of reads in flight, sampled each cycle
+    uint64_t readsActive;
+}
+QA_MEMTEST_RESULT;
+
+class AFU_CLASS: public STATS_EMITTER_CLASS
 {
   private:
-    static AFU instance;
+    // All AFUs allocated in the process, in allocation order
+    static std::vector<AFU> instances;
+    static std::mutex instancesLock;
+
+    // One AAL runtime serves every AFU in the process.  It is started by
+    // the first AFU and stopped when the last is released.  Protected by
+    // instancesLock.
+    static AFU_RUNTIME_CLIENT sharedRuntimeClient;
+    static uint32_t sharedRuntimeRefs;
 
   public:
-    AFU_CLASS(const char* afuID, uint32_t dsmSizeBytes = 4096);
+    //
+    // A process may allocate one AFU per FPGA.  Each has its own shared
+    // buffers, VTP and host channels.  All share one AAL runtime.  pciBus
+    // selects the FPGA.  It is ignored by ASE simulation.
+    //
+    AFU_CLASS(const char* afuID,
+              uint32_t dsmSizeBytes = 4096,
+              int pciBus = QA_ANY_PCI_BUS);
     ~AFU_CLASS();
 
-    // There is a single instance of the AFU allocated.  This allows any
-    // code to find it.
-    static AFU GetInstance() { return instance; }
+    //
+    // Find an AFU by index in allocation order.  Services that don't
+    // care which FPGA they use take the default, which is the first.
+    // Returns NULL if there is no such AFU.
+    //
+    static AFU GetInstance(uint32_t idx = 0);
+    static uint32_t NumInstances();
+
+    // Index of this AFU for GetInstance()
+    uint32_t GetInstanceIdx() const { return instanceIdx; }
+
+    //
+    // Startup timeline.  Initialization code marks the end of each phase.
+    // The timeline, relative to the start of the AFU constructor, is
+    // printed by PrintStartupTimeline() and reported in the stats.
+    //
+    void MarkStartupPhase(const char* phase);
+    void PrintStartupTimeline();
 
     void ResetAFU();
 
     //
     // Allocate a memory buffer shared by the host and an FPGA.  This call
-    // DOES NOT add the VA/PA pair to the FPGA-side VTP.
+    // DOES NOT add the VA/PA pair to the FPGA-side VTP.  The buffer is
+    // zeroed unless zero is false, which callers that overwrite the whole
+    // buffer before reading it may use to save startup time.  With zero
+    // false a buffer recycled from the pool holds stale data.
     //
-    AFU_BUFFER CreateSharedBuffer(ssize_t size_bytes);
+    AFU_BUFFER CreateSharedBuffer(ssize_t size_bytes, bool zero = true);
+
+    //
+    // Release a buffer returned by CreateSharedBuffer.  Buffers are kept
+    // in a pool, indexed by size class, and recycled by later calls to
+    // CreateSharedBuffer.  At most QA_BUFFER_POOL_MAX_MB are retained.
+    // Larger buffers are returned to the driver.
+    //
+    void FreeSharedBuffer(AFU_BUFFER buffer);
 
     //
     // Allocate a shared memory buffer and add the VA/PA mapping to the
@@ -125,10 +244,38 @@ class AFU_CLASS
     //
     void* CreateSharedBufferInVM(ssize_t size_bytes);
 
-    // Virtual to physical translation for memory created by
-    // CreateSharedBufferInVM.
+    //
+    // Release a buffer returned by CreateSharedBufferInVM.  CCI-S can't
+    // return the moved pages to AAL, so they stay pinned until the
+    // device is closed.
+    //
+    void FreeSharedBufferInVM(void* va);
+
+    //
+    // Virtual to physical translation for any address inside memory
+    // created by CreateSharedBuffer or CreateSharedBufferInVM.  Buffers
+    // from CreateSharedBuffer are found in an index ordered by VA.
+    //
     btPhysAddr SharedBufferVAtoPA(const void* va);
 
+    // Return the live CreateSharedBuffer buffer containing va, or NULL.
+    AFU_BUFFER FindSharedBuffer(const void* va);
+
+    //
+    // Remove a buffer from the live index without releasing it.  The
+    // memory stays pinned until the AFU is released.  Used when the
+    // buffer's pages are moved to a new VA and the descriptor is
+    // discarded, so a later allocation at the old VA can't match it.
+    //
+    void DetachSharedBuffer(AFU_BUFFER buffer);
+
+    //
+    // Allocate through CreateSharedBufferInVM and check that translation
+    // of the new region and of a later CreateSharedBuffer buffer is
+    // consistent.  Returns true on success.
+    //
+    bool TestSharedBufferInVM();
+
 
     //
     // DSM is a relatively small shared memory buffer defined by the CCI
@@ -164,11 +311,36 @@ class AFU_CLASS
 
     // The driver implements a status register space in the FPGA.
     // The protocol is very slow -- the registers are intended for debugging.
+    // ReadSREG64 must not be called while a snapshot is in progress.
     uint64_t ReadSREG64(uint32_t n);
 
+    //
+    // Read num consecutive status registers, starting at first, in a
+    // single request.  The FPGA writes the values to DSM and the host
+    // polls for completion, avoiding a CSR round trip per register.
+    // Returns false if num exceeds MaxSnapshotSREGs().
+    //
+    bool SnapshotSREG64(uint32_t first, uint32_t num,
+                        std::vector<uint64_t>& values);
+    uint32_t MaxSnapshotSREGs() const;
+
 
+    //
+    // Run the host memory benchmark at the selected level.  The default
+    // level is QA_MEMTEST_QUICK when the FPGA has the tester and off
+    // otherwise.  Results are printed as CSV rows.
+    //
+    void SetMemTestLevel(QA_MEMTEST_LEVEL level) { memTestLevel = level; }
     void RunTests(QA_HOST_CHANNELS_DEVICE qa);
 
+    //
+    // MPF clock frequency, used by the MPF sampler to compute busy
+    // fractions.  The default is QA_MPF_CLOCK_MHZ.  The sampler may
+    // already be running when it is set.
+    //
+    void SetMPFClockMHz(uint32_t mhz) { mpfClockMHz = mhz; }
+    uint32_t GetMPFClockMHz() const { return mpfClockMHz; }
+
 
     //
     // Properties of the system.
@@ -176,12 +348,50 @@ class AFU_CLASS
     const uint64_t ByteAddrToLineIdx(uint64_t addr) { return addr / CL(1); }
     const uint64_t ByteAddrToLineIdx(const void* addr) { return uint64_t(addr) / CL(1); }
 
+    // STATS_EMITTER_CLASS virtual functions
+    void EmitStats(ofstream &statsFile);
+    void ResetStats();
+
   private:
     AFU_RUNTIME_CLIENT afuRuntimeClient;
     AFU_CLIENT afuClient;
+    uint32_t instanceIdx;
+
+    // Startup phases and their completion times (ns since startupStartNs)
+    uint64_t startupStartNs;
+    std::vector<std::pair<const char*, uint64_t> > startupPhases;
+
+    QA_MEMTEST_LEVEL memTestLevel;
+    std::atomic<uint32_t> mpfClockMHz;
 
-    std::vector<AFU_BUFFER> buffers;
+    void RunMemTest(QA_MEMTEST_TYPE mode,
+                    uint32_t log_lines,
+                    bool cached,
+                    bool ordered,
+                    uint32_t trips,
+                    QA_MEMTEST_RESULT& result);
+
+    // Status register snapshots share one DSM region
+    std::mutex sregSnapshotLock;
+    uint16_t sregSnapshotTag;
+
+    // Buffers in use, indexed by VA.  They are released in the destructor.
+    std::map<uint64_t, AFU_BUFFER> buffers;
     AFU_BUFFER dsmBuffer;
+
+    // Freed buffers available for reuse, indexed by size class
+    std::map<uint64_t, std::vector<AFU_BUFFER> > bufferPool;
+    std::atomic<uint64_t> bufferPoolBytes;
+    std::mutex bufferLock;
+
+    // Round a request up to its pool size class
+    static uint64_t BufferSizeClass(uint64_t size_bytes);
+
+    // Buffer statistics.  Updated under bufferLock, read without it.
+    std::atomic<uint64_t> statBufferPoolHits;
+    std::atomic<uint64_t> statBufferPoolMisses;
+    std::atomic<uint64_t> statBufferPinnedBytes;
+    std::atomic<uint64_t> statBufferPinnedBytesPeak;
 };
 
 
@@ -201,11 +411,22 @@ public:
     AFU_CLIENT_CLASS(AFU afu, AFU_RUNTIME_CLIENT rtc);
     ~AFU_CLIENT_CLASS();
 
-    btInt InitService(const char* afuID);
+    btInt InitService(const char* afuID, int pciBus = QA_ANY_PCI_BUS);
     btInt UninitService();
 
+    //
+    // Delete the VTP and other MPF objects.  The VTP page table is built
+    // from shared buffers, so this must be called while MMIO still works
+    // and before the AFU's shared buffers are released.  Safe to call
+    // more than once.
+    //
+    void ReleaseMPF();
+
     inline bool WriteCSR(btCSROffset offset, bt32bitCSR value)
     {
+        auto lock = LockMMIO();
+        if (QA_MMIO_STATS) NoteMMIOWrite(offset);
+
 #if (CCI_S_IFC != 0)
         return m_Service->CSRWrite(offset, value);
 #else
@@ -215,6 +436,9 @@ public:
 
     inline bool WriteCSR64(btCSROffset offset, bt64bitCSR value)
     {
+        auto lock = LockMMIO();
+        if (QA_MMIO_STATS) NoteMMIOWrite(offset);
+
 #if (CCI_S_IFC != 0)
         return m_Service->CSRWrite64(offset, value);
 #else
@@ -224,14 +448,19 @@ public:
 
     inline bool ReadCSR(btCSROffset offset, bt32bitCSR* pValue)
     {
+        auto lock = LockMMIO();
+        uint64_t start_ns = (QA_MMIO_STATS ? MMIONowNs() : 0);
+
 #if (CCI_S_IFC != 0)
         btCSRValue v;
         bool r = m_Service->CSRRead(offset, &v);
         *pValue = v;
-        return r;
 #else
-        return m_pALIMMIOService->mmioRead32(offset, pValue);
+        bool r = m_pALIMMIOService->mmioRead32(offset, pValue);
 #endif
+
+        if (QA_MMIO_STATS) NoteMMIORead(offset, start_ns);
+        return r;
     }
 
     inline bool ReadCSR64(btCSROffset offset, bt64bitCSR* pValue)
@@ -239,7 +468,11 @@ public:
 #if (CCI_S_IFC != 0)
         return false;
 #else
-        return m_pALIMMIOService->mmioRead64(offset, pValue);
+        auto lock = LockMMIO();
+        uint64_t start_ns = (QA_MMIO_STATS ? MMIONowNs() : 0);
+        bool r = m_pALIMMIOService->mmioRead64(offset, pValue);
+        if (QA_MMIO_STATS) NoteMMIORead(offset, start_ns);
+        return r;
 #endif
     }
 
@@ -248,10 +481,17 @@ public:
     //
     // Allocate a memory buffer shared by the host and an FPGA.
     //
-    AFU_BUFFER CreateSharedBuffer(ssize_t size_bytes);
+    AFU_BUFFER CreateSharedBuffer(ssize_t size_bytes, bool zero = true);
     void FreeSharedBuffer(AFU_BUFFER buffer);
 
+    //
+    // Zero a shared buffer.  Large buffers are split across threads.
+    // Skipped bytes (zero == false) are only counted.
+    //
+    void ZeroSharedBuffer(volatile void* va, size_t size_bytes, bool zero = true);
+
     void* CreateSharedBufferInVM(ssize_t size_bytes);
+    void FreeSharedBufferInVM(void* va);
     btPhysAddr SharedBufferVAtoPA(const void* va);
 
     // <begin IServiceClient interface>
@@ -287,6 +527,99 @@ public:
   private:
     uint64_t GetStatVTP(t_cci_mpf_vtp_csr_offsets stat);
 
+    //
+    // MMIO statistics.  Counters are indexed by 4 byte CSR offset.  Offsets
+    // beyond the table share the last entry.  Read latency is also recorded
+    // in a histogram with power of 2 buckets in ns.
+    //
+    static const uint32_t MMIO_STATS_OFFSETS = 8192;
+    static const uint32_t MMIO_LAT_BUCKETS = 24;
+
+    typedef struct
+    {
+        std::atomic<uint64_t> reads;
+        std::atomic<uint64_t> writes;
+        std::atomic<uint64_t> readNs;
+        std::atomic<uint64_t> readMaxNs;
+    }
+    MMIO_OFFSET_STATS;
+
+    MMIO_OFFSET_STATS* m_mmioStats;
+    std::atomic<uint64_t> m_mmioReadLatHist[MMIO_LAT_BUCKETS];
+
+    static inline uint32_t MMIOStatsIdx(btCSROffset offset)
+    {
+        uint32_t idx = offset >> 2;
+        return (idx < MMIO_STATS_OFFSETS - 1) ? idx : MMIO_STATS_OFFSETS - 1;
+    }
+
+    static inline uint64_t MMIONowNs()
+    {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return uint64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+    }
+
+    inline void NoteMMIOWrite(btCSROffset offset)
+    {
+        m_mmioStats[MMIOStatsIdx(offset)].writes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void NoteMMIORead(btCSROffset offset, uint64_t start_ns);
+    void EmitMMIOStats(ofstream &statusFile);
+
+    //
+    // Background sampling of MPF counters.  Every QA_MPF_SAMPLE_MS the
+    // sampler writes the change in each counter and derived rates as a
+    // row in QA_MPF_SAMPLE_FILE.  AFUs after the first append their
+    // instance index to the file name, e.g. mpf_samples.csv.1.
+    //
+    typedef struct
+    {
+        uint64_t timeNs;
+        uint64_t tlbHits4KB;
+        uint64_t tlbMisses4KB;
+        uint64_t tlbHits2MB;
+        uint64_t tlbMisses2MB;
+        uint64_t tlbHits1GB;
+        uint64_t tlbMisses1GB;
+        uint64_t ptWalkBusyCycles;
+        uint64_t failedTranslations;
+        uint64_t vcMapChanges;
+        uint64_t vcMapHistory;
+        uint64_t wroConflictsRR;
+        uint64_t wroConflictsRW;
+        uint64_t wroConflictsWR;
+        uint64_t wroConflictsWW;
+        uint64_t partialWrites;
+    }
+    MPF_SAMPLE;
+
+    void StartMPFSampler();
+    void StopMPFSampler();
+    void MPFSamplerThread();
+    void SampleMPF(MPF_SAMPLE& s);
+
+    std::thread*            m_mpfSampler;
+    std::mutex              m_mpfSamplerLock;
+    std::condition_variable m_mpfSamplerCond;
+    bool                    m_mpfSamplerStop;
+
+    //
+    // MMIO from the sampler thread is serialized with the main thread.
+    // The lock is taken only when the sampler is configured.  It is
+    // recursive because the CCI-S VTP statistics are read back through
+    // ReadCSR64() while a sample holds the lock.
+    //
+    std::recursive_mutex    m_mmioLock;
+
+    inline std::unique_lock<std::recursive_mutex> LockMMIO()
+    {
+        std::unique_lock<std::recursive_mutex> lock(m_mmioLock, std::defer_lock);
+        if (QA_MPF_SAMPLE_MS != 0) lock.lock();
+        return lock;
+    }
+
   protected:
     AFU            afu;
     IBase         *m_pAALService;    // The generic AAL Service interface for the AFU.
@@ -310,12 +643,25 @@ public:
     // Virtual channel mapping
     MPFVCMAP      *m_mpf_vc_map;
     btCSROffset    m_VCMAPDFHOffset;    ///< VC MAP DFH offset
+
+    // Write/read ordering and partial writes.  Used only for statistics.
+    MPFWRO        *m_mpf_wro;
+    btCSROffset    m_WRODFHOffset;      ///< WRO DFH offset
+    MPFPWRITE     *m_mpf_pwrite;
+    btCSROffset    m_PWRITEDFHOffset;   ///< PWRITE DFH offset
 #endif
     AFU_RUNTIME_CLIENT m_runtimeClient;
     CSemaphore     m_Sem;            // For synchronizing with the AAL runtime.
     CSemaphore     m_SemWrk;         // Semaphore for workspace syc
     btInt          m_Result;         // Returned result value; 0 if success
 
+    // Buffer zeroing statistics.  Buffers may be created from several
+    // threads at once.
+    std::atomic<uint64_t> m_statZeroBytes;       // Bytes zeroed
+    std::atomic<uint64_t> m_statZeroWallNs;      // Elapsed time zeroing
+    std::atomic<uint64_t> m_statZeroThreadNs;    // Sum of time across zeroing threads
+    std::atomic<uint64_t> m_statZeroSkippedBytes;// Bytes not zeroed by request
+
     // Workspace info
     btVirtAddr     m_WrkVA;          // Most recent workspace alloc VA
     btPhysAddr     m_WrkPA;          // Most recent workspace alloc PA
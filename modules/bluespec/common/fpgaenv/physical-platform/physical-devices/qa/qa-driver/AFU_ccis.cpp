@@ -109,6 +109,13 @@ AFU_CCIS_CLASS::Initialize()
 
 AFU_CCIS_CLASS::~AFU_CCIS_CLASS()
 {
+    if (did_init)
+    {
+        // Stop translation before releasing the table
+        m_afu->WriteCSR64(m_csr_base + CCI_MPF_VTP_CSR_MODE, 2);
+    }
+
+    ptTerminate();
 }
 
 
@@ -168,6 +175,11 @@ AFU_CCIS_CLASS::CreateSharedBufferInVM(size_t size_bytes)
         AFU_BUFFER buffer = m_afu->CreateSharedBuffer(pageSize);
         assert(buffer != NULL);
 
+        // The page is about to move and its descriptor is discarded.
+        // Drop it from the AFU's buffer index first so that nothing
+        // later allocated at the old VA resolves to this page.
+        m_afu->DetachSharedBuffer(buffer);
+
         // Shrink the reserved area in order to make a hole in the virtual
         // address space.
         if (va_base_len == pageSize)
@@ -253,6 +265,19 @@ AFU_CCIS_CLASS::ptAllocSharedPage(btWSSize length, btPhysAddr* pa)
 }
 
 
+void
+AFU_CCIS_CLASS::ptFreeSharedPage(btVirtAddr va, btWSSize length)
+{
+    // Page table pages are whole shared buffers.  Free through the
+    // descriptor that allocated the page, never one merely containing va.
+    AFU_BUFFER page = m_afu->FindSharedBuffer(va);
+    assert(page && (btVirtAddr(page->virtualAddress) == va));
+    if ((page == NULL) || (btVirtAddr(page->virtualAddress) != va)) return;
+
+    m_afu->FreeSharedBuffer(page);
+}
+
+
 bool
 AFU_CCIS_CLASS::ptInvalVAMapping(btVirtAddr va)
 {
@@ -13,6 +13,16 @@
 // as a CSR read request.
 #define CSR_AFU_MMIO_READ_COMPAT 0x1a14
 
+// Bulk status register snapshot to DSM.  The 64 bit value holds the
+// register count [15:0], first register [47:16] and a tag [63:48].
+#define CSR_AFU_SREG_SNAPSHOT   0x1a18
+
+// DSM lines used by status register snapshots.  The header is written
+// after all data lines and holds the tag [15:0], count [31:16] and
+// a valid bit [32].
+#define DSM_SREG_SNAPSHOT_HDR_LINE  2
+#define DSM_SREG_SNAPSHOT_DATA_LINE 3
+
 // The host channels driver manages its own CSR space starting at a
 // base address passed to the driver when it is instantiated.
 #define CSR_HC_BASE_ADDR        0x1a80
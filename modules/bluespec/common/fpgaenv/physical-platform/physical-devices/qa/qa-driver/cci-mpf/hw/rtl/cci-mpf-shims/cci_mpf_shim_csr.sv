@@ -65,7 +65,7 @@ parameter CCI_MPF_PWRITE_CSR_OFFSET =    CCI_MPF_WRO_CSR_OFFSET +
 parameter CCI_MPF_STAT_CNT_WIDTH = 16;
 typedef logic [CCI_MPF_STAT_CNT_WIDTH-1:0] t_cci_mpf_stat_cnt;
 
-parameter CCI_MPF_CSR_NUM_STATS = 12;
+parameter CCI_MPF_CSR_NUM_STATS = 14;
 typedef t_mpf_csr_offset [0:CCI_MPF_CSR_NUM_STATS-1] t_stat_csr_offset_vec;
 typedef t_cci_mpf_stat_cnt [0:CCI_MPF_CSR_NUM_STATS-1] t_stat_upd_count_vec;
 
@@ -214,11 +214,18 @@ module cci_mpf_shim_csr
             csrAddrMatches(c0_rx, CCI_MPF_VTP_CSR_BASE +
                                   CCI_MPF_VTP_CSR_INVAL_PAGE_VADDR);
 
+        // Prefetch page held only one cycle
+        csrs.vtp_in_prefetch_page <= t_cci_clAddr'(c0_rx.data);
+        csrs.vtp_in_prefetch_page_valid <=
+            csrAddrMatches(c0_rx, CCI_MPF_VTP_CSR_BASE +
+                                  CCI_MPF_VTP_CSR_PREFETCH_PAGE_VADDR);
+
         if (reset)
         begin
             csrs.vtp_in_mode <= t_cci_mpf_vtp_csr_mode'(0);
             csrs.vtp_in_page_table_base_valid <= 1'b0;
             csrs.vtp_in_inval_page_valid <= 1'b0;
+            csrs.vtp_in_prefetch_page_valid <= 1'b0;
             csrs.vc_map_ctrl_valid <= 1'b0;
             csrs.wro_ctrl_valid <= 1'b0;
         end
@@ -671,17 +678,19 @@ module cci_mpf_shim_csr_events
     `MPF_CSR_STAT_ACCUM(VTP, 1, 4KB_TLB_NUM_MISSES, vtp_4kb_misses, vtp_out_event_4kb_miss)
     `MPF_CSR_STAT_ACCUM(VTP, 2, 2MB_TLB_NUM_HITS, vtp_2mb_hits, vtp_out_event_2mb_hit)
     `MPF_CSR_STAT_ACCUM(VTP, 3, 2MB_TLB_NUM_MISSES, vtp_2mb_misses, vtp_out_event_2mb_miss)
-    `MPF_CSR_STAT_ACCUM(VTP, 4, PT_WALK_BUSY_CYCLES, vtp_pt_walk_busy_cycles, vtp_out_event_pt_walk_busy)
-    `MPF_CSR_STAT_ACCUM(VTP, 5, FAILED_TRANSLATIONS, vtp_failed_translations, vtp_out_event_failed_translation)
+    `MPF_CSR_STAT_ACCUM(VTP, 4, 1GB_TLB_NUM_HITS, vtp_1gb_hits, vtp_out_event_1gb_hit)
+    `MPF_CSR_STAT_ACCUM(VTP, 5, 1GB_TLB_NUM_MISSES, vtp_1gb_misses, vtp_out_event_1gb_miss)
+    `MPF_CSR_STAT_ACCUM(VTP, 6, PT_WALK_BUSY_CYCLES, vtp_pt_walk_busy_cycles, vtp_out_event_pt_walk_busy)
+    `MPF_CSR_STAT_ACCUM(VTP, 7, FAILED_TRANSLATIONS, vtp_failed_translations, vtp_out_event_failed_translation)
 
-    `MPF_CSR_STAT_ACCUM(VC_MAP, 6, NUM_MAPPING_CHANGES, vc_map_mapping_changes, vc_map_out_event_mapping_changed)
+    `MPF_CSR_STAT_ACCUM(VC_MAP, 8, NUM_MAPPING_CHANGES, vc_map_mapping_changes, vc_map_out_event_mapping_changed)
 
-    `MPF_CSR_STAT_ACCUM(WRO,  7, RR_CONFLICT, wro_rr_conflicts, wro_out_event_rr_conflict)
-    `MPF_CSR_STAT_ACCUM(WRO,  8, RW_CONFLICT, wro_rw_conflicts, wro_out_event_rw_conflict)
-    `MPF_CSR_STAT_ACCUM(WRO,  9, WR_CONFLICT, wro_wr_conflicts, wro_out_event_wr_conflict)
-    `MPF_CSR_STAT_ACCUM(WRO, 10, WW_CONFLICT, wro_ww_conflicts, wro_out_event_ww_conflict)
+    `MPF_CSR_STAT_ACCUM(WRO,  9, RR_CONFLICT, wro_rr_conflicts, wro_out_event_rr_conflict)
+    `MPF_CSR_STAT_ACCUM(WRO, 10, RW_CONFLICT, wro_rw_conflicts, wro_out_event_rw_conflict)
+    `MPF_CSR_STAT_ACCUM(WRO, 11, WR_CONFLICT, wro_wr_conflicts, wro_out_event_wr_conflict)
+    `MPF_CSR_STAT_ACCUM(WRO, 12, WW_CONFLICT, wro_ww_conflicts, wro_out_event_ww_conflict)
 
-    `MPF_CSR_STAT_ACCUM(PWRITE, 11, NUM_PWRITES, pwrite_num_pwrites, pwrite_out_event_pwrite)
+    `MPF_CSR_STAT_ACCUM(PWRITE, 13, NUM_PWRITES, pwrite_num_pwrites, pwrite_out_event_pwrite)
 
 endmodule // cci_mpf_shim_csr_events
 
@@ -52,6 +52,7 @@ localparam CCI_PT_PA_BITS = 32;        // Broadwell server
 //
 
 // Low order (page offset) bits in both VA and PA of a page
+localparam CCI_PT_1GB_PAGE_OFFSET_BITS = 24;   // Line sized data (30-6)
 localparam CCI_PT_2MB_PAGE_OFFSET_BITS = 15;   // Line sized data (21-6)
 localparam CCI_PT_4KB_PAGE_OFFSET_BITS = 6;    //                 (12-6)
 
@@ -157,7 +158,9 @@ typedef struct packed
     // Tag from lookup request
     t_cci_mpf_shim_vtp_req_tag tag;
 
-    // Is translation a big page or just a 4KB page?
+    // Is translation a big page or just a 4KB page?  Translations of 1GB
+    // pages are returned as the 2MB region holding the requested address,
+    // so isBigPage is set for both 2MB and 1GB pages.
     logic isBigPage;
 }
 t_cci_mpf_shim_vtp_lookup_rsp;
@@ -233,8 +236,10 @@ interface cci_mpf_shim_vtp_tlb_if;
     logic fillEn;
     t_tlb_4kb_va_page_idx fillVA;
     t_tlb_4kb_pa_page_idx fillPA;
-    // 2MB page? If 0 then it is a 4KB page.
+    // 2MB or 1GB page? If 0 then it is a 4KB page.
     logic fillBigPage;
+    // 1GB page?  fillBigPage is also set for 1GB pages.
+    logic fill1GBPage;
     logic fillRdy;
 
     modport server
@@ -277,6 +282,7 @@ interface cci_mpf_shim_vtp_tlb_if;
         output fillVA,
         output fillPA,
         output fillBigPage,
+        output fill1GBPage,
         input  fillRdy
         );
 
@@ -294,6 +300,9 @@ interface cci_mpf_shim_vtp_pt_walk_if;
     logic reqEn;
     // VA to translate
     t_tlb_4kb_va_page_idx reqVA;
+    // Walk on behalf of a prefetch?  A prefetched page may have been
+    // freed since it was requested, so failed prefetch walks are dropped.
+    logic reqIsPrefetch;
     // Ready to accept a request?
     logic reqRdy;
 
@@ -316,6 +325,7 @@ interface cci_mpf_shim_vtp_pt_walk_if;
        (
         input  reqEn,
         input  reqVA,
+        input  reqIsPrefetch,
         output reqRdy,
 
         output notPresent,
@@ -333,6 +343,7 @@ interface cci_mpf_shim_vtp_pt_walk_if;
        (
         output reqEn,
         output reqVA,
+        output reqIsPrefetch,
         input  reqRdy,
 
         input  notPresent
@@ -42,6 +42,10 @@
 // address is translated each cycle.  Clients are expected to cache responses
 // to reduce the number of requests to this service.
 //
+// Pages named by the host in CCI_MPF_VTP_CSR_PREFETCH_PAGE_VADDR are looked
+// up as though requested by an extra client.  The lookup fills the TLB
+// and the response is dropped.
+//
 
 module cci_mpf_svc_vtp
   #(
@@ -64,7 +68,11 @@ module cci_mpf_svc_vtp
     cci_mpf_csrs.vtp_events events
     );
 
-    typedef logic [$clog2(N_VTP_PORTS)-1 : 0] t_cci_mpf_shim_vtp_port_idx;
+    // Requesters are the clients plus the prefetcher
+    localparam N_REQ_PORTS = N_VTP_PORTS + 1;
+    localparam PREFETCH_PORT = N_VTP_PORTS;
+
+    typedef logic [$clog2(N_REQ_PORTS)-1 : 0] t_cci_mpf_shim_vtp_port_idx;
 
     // ====================================================================
     //
@@ -75,16 +83,16 @@ module cci_mpf_svc_vtp
     //
     // Buffer incoming requests in small FIFOs.
     //
-    t_cci_mpf_shim_vtp_lookup_req new_req[0 : N_VTP_PORTS-1];
-    logic [N_VTP_PORTS-1 : 0] arb_grant;
-    logic [N_VTP_PORTS-1 : 0] arb_grant_q;
-    logic [N_VTP_PORTS-1 : 0] new_req_rdy;
+    t_cci_mpf_shim_vtp_lookup_req new_req[0 : N_REQ_PORTS-1];
+    logic [N_REQ_PORTS-1 : 0] arb_grant;
+    logic [N_REQ_PORTS-1 : 0] arb_grant_q;
+    logic [N_REQ_PORTS-1 : 0] new_req_rdy;
     logic merged_fifo_almFull;
 
     // Select a new request if granted arbitration and a request is ready.
     // The test for a request being ready is required because arbitration
     // results are registered and are thus a cycle out of date.
-    logic [N_VTP_PORTS-1 : 0] new_req_sel;
+    logic [N_REQ_PORTS-1 : 0] new_req_sel;
     assign new_req_sel = arb_grant_q & new_req_rdy;
 
     genvar p;
@@ -114,6 +122,43 @@ module cci_mpf_svc_vtp
     endgenerate
 
 
+    //
+    // Prefetch requests from the host.  Prefetches are only hints, so
+    // they are dropped when the FIFO is full or VTP is disabled.  Walks
+    // for prefetched pages that are no longer mapped are also dropped.
+    //
+    t_cci_mpf_shim_vtp_lookup_req prefetch_req;
+    logic prefetch_notFull;
+
+    always_comb
+    begin
+        prefetch_req.pageVA = vtp4kbPageIdxFromVA(csrs.vtp_in_prefetch_page);
+        // Responses to the prefetcher are dropped.  The tag is unused.
+        prefetch_req.tag = t_cci_mpf_shim_vtp_req_tag'(0);
+    end
+
+    cci_mpf_prim_fifo_lutram
+      #(
+        .N_DATA_BITS($bits(t_cci_mpf_shim_vtp_lookup_req)),
+        .N_ENTRIES(CCI_MPF_SHIM_VTP_MAX_SVC_REQS)
+        )
+      prefetch_fifo
+       (
+        .clk,
+        .reset,
+
+        .enq_data(prefetch_req),
+        .enq_en(csrs.vtp_in_prefetch_page_valid && prefetch_notFull &&
+                csrs.vtp_in_mode.enabled),
+        .notFull(prefetch_notFull),
+
+        .first(new_req[PREFETCH_PORT]),
+        .deq_en(new_req_sel[PREFETCH_PORT]),
+        .notEmpty(new_req_rdy[PREFETCH_PORT]),
+        .almostFull()
+        );
+
+
     //
     // Fair arbitration for new requests
     //
@@ -122,7 +167,7 @@ module cci_mpf_svc_vtp
 
     cci_mpf_prim_arb_rr
       #(
-        .NUM_CLIENTS(N_VTP_PORTS)
+        .NUM_CLIENTS(N_REQ_PORTS)
         )
       arb
        (
@@ -206,10 +251,12 @@ module cci_mpf_svc_vtp
     cci_mpf_shim_vtp_tlb_if tlb_if();
 
     t_cci_mpf_shim_vtp_port_idx rsp_port_idx;
+    t_cci_mpf_shim_vtp_port_idx miss_port_idx;
+    logic miss_drop;
 
     cci_mpf_svc_vtp_pipe
       #(
-        .N_VTP_PORTS(N_VTP_PORTS),
+        .N_VTP_PORTS(N_REQ_PORTS),
         .DEBUG_MESSAGES(DEBUG_MESSAGES)
         )
       pipe
@@ -219,6 +266,8 @@ module cci_mpf_svc_vtp
         .vtp_svc(vtp_pipe),
         .reqPortIdx(first_port_idx),
         .rspPortIdx(rsp_port_idx),
+        .missPortIdx(miss_port_idx),
+        .missDrop(miss_drop),
         .tlb_if
         );
 
@@ -260,8 +309,7 @@ module cci_mpf_svc_vtp
     // ====================================================================
 
     //
-    // Allocate two TLBs.  One manages 4KB pages and the other manages
-    // 2MB pages.
+    // Allocate three TLBs, one each for 4KB, 2MB and 1GB pages.
     //
 
     cci_mpf_shim_vtp_tlb_if tlb_if_4kb();
@@ -301,24 +349,54 @@ module cci_mpf_svc_vtp
         .csrs
         );
 
-    // When the pipeline requests a TLB lookup do it on both pipelines.
+    //
+    // The 1GB TLB returns translations at 2MB granularity.  Clients and
+    // their local caches know only 4KB and 2MB pages.
+    //
+    cci_mpf_shim_vtp_tlb_if tlb_if_1gb();
+
+    cci_mpf_svc_vtp_tlb
+      #(
+        .CCI_PT_PAGE_OFFSET_BITS(CCI_PT_1GB_PAGE_OFFSET_BITS),
+        .LOOKUP_RSP_PAGE_OFFSET_BITS(CCI_PT_2MB_PAGE_OFFSET_BITS),
+        .NUM_TLB_SETS(`VTP_N_TLB_1GB_SETS),
+        .NUM_TLB_SET_WAYS(`VTP_N_TLB_1GB_WAYS),
+        .DEBUG_MESSAGES(DEBUG_MESSAGES),
+        .DEBUG_NAME("1GB")
+        )
+      tlb1gb
+       (
+        .clk,
+        .reset,
+        .tlb_if(tlb_if_1gb),
+        .csrs
+        );
+
+    // When the pipeline requests a TLB lookup do it on all pipelines.
     assign tlb_if_4kb.lookupPageVA = tlb_if.lookupPageVA;
     assign tlb_if_4kb.lookupEn = tlb_if.lookupEn;
     assign tlb_if_2mb.lookupPageVA = tlb_if.lookupPageVA;
     assign tlb_if_2mb.lookupEn = tlb_if.lookupEn;
-    assign tlb_if.lookupRdy = tlb_if_4kb.lookupRdy && tlb_if_2mb.lookupRdy;
+    assign tlb_if_1gb.lookupPageVA = tlb_if.lookupPageVA;
+    assign tlb_if_1gb.lookupEn = tlb_if.lookupEn;
+    assign tlb_if.lookupRdy = tlb_if_4kb.lookupRdy && tlb_if_2mb.lookupRdy &&
+                              tlb_if_1gb.lookupRdy;
 
     // The TLB pipeline is fixed length, so responses arrive together.
     // At most one TLB should have a translation for a given address.
     assign tlb_if.lookupRspValid = tlb_if_4kb.lookupRspValid ||
-                                   tlb_if_2mb.lookupRspValid;
-    assign tlb_if.lookupRspIsBigPage = tlb_if_2mb.lookupRspValid;
+                                   tlb_if_2mb.lookupRspValid ||
+                                   tlb_if_1gb.lookupRspValid;
+    assign tlb_if.lookupRspIsBigPage = tlb_if_2mb.lookupRspValid ||
+                                       tlb_if_1gb.lookupRspValid;
     assign tlb_if.lookupRspPagePA =
         tlb_if_4kb.lookupRspValid ? tlb_if_4kb.lookupRspPagePA :
-                                    tlb_if_2mb.lookupRspPagePA;
+            (tlb_if_2mb.lookupRspValid ? tlb_if_2mb.lookupRspPagePA :
+                                         tlb_if_1gb.lookupRspPagePA);
 
-    // Read the page table if both TLBs miss
-    assign tlb_if.lookupMiss = tlb_if_4kb.lookupMiss && tlb_if_2mb.lookupMiss;
+    // Read the page table if all TLBs miss
+    assign tlb_if.lookupMiss = tlb_if_4kb.lookupMiss && tlb_if_2mb.lookupMiss &&
+                               tlb_if_1gb.lookupMiss;
     assign tlb_if.lookupMissVA = tlb_if_4kb.lookupMissVA;
 
     // Validation
@@ -327,7 +405,10 @@ module cci_mpf_svc_vtp
         if (! reset)
         begin
             assert(! tlb_if_4kb.lookupRspValid || ! tlb_if_2mb.lookupRspValid) else
-                $fatal("cci_mpf_svc_vtp: Both TLBs valid!");
+                $fatal("cci_mpf_svc_vtp: Both 4KB and 2MB TLBs valid!");
+            assert(! tlb_if_1gb.lookupRspValid ||
+                   (! tlb_if_4kb.lookupRspValid && ! tlb_if_2mb.lookupRspValid)) else
+                $fatal("cci_mpf_svc_vtp: 1GB and smaller TLBs valid!");
 
             if (tlb_if.lookupMiss)
             begin
@@ -347,21 +428,27 @@ module cci_mpf_svc_vtp
     always_ff @(posedge clk)
     begin
         tlb_if_4kb.fillEn <= tlb_if.fillEn && ! tlb_if.fillBigPage;
-        tlb_if_2mb.fillEn <= tlb_if.fillEn && tlb_if.fillBigPage;
+        tlb_if_2mb.fillEn <= tlb_if.fillEn && tlb_if.fillBigPage &&
+                             ! tlb_if.fill1GBPage;
+        tlb_if_1gb.fillEn <= tlb_if.fillEn && tlb_if.fill1GBPage;
         fill_en_q <= tlb_if.fillEn;
 
         tlb_if_4kb.fillVA <= tlb_if.fillVA;
         tlb_if_4kb.fillPA <= tlb_if.fillPA;
         tlb_if_2mb.fillVA <= tlb_if.fillVA;
         tlb_if_2mb.fillPA <= tlb_if.fillPA;
+        tlb_if_1gb.fillVA <= tlb_if.fillVA;
+        tlb_if_1gb.fillPA <= tlb_if.fillPA;
 
         tlb_if.fillRdy <= tlb_if_4kb.fillRdy && tlb_if_2mb.fillRdy &&
+                          tlb_if_1gb.fillRdy &&
                           ! tlb_if.fillEn && ! fill_en_q;
 
         if (reset)
         begin
             tlb_if_4kb.fillEn <= 1'b0;
             tlb_if_2mb.fillEn <= 1'b0;
+            tlb_if_1gb.fillEn <= 1'b0;
             tlb_if.fillRdy <= 1'b0;
             fill_en_q <= 1'b0;
         end
@@ -375,17 +462,21 @@ module cci_mpf_svc_vtp
         begin
             events.vtp_out_event_4kb_hit <= 1'b0;
             events.vtp_out_event_2mb_hit <= 1'b0;
+            events.vtp_out_event_1gb_hit <= 1'b0;
 
             events.vtp_out_event_4kb_miss <= 1'b0;
             events.vtp_out_event_2mb_miss <= 1'b0;
+            events.vtp_out_event_1gb_miss <= 1'b0;
         end
         else
         begin
             events.vtp_out_event_4kb_hit <= tlb_if_4kb.lookupRspValid;
             events.vtp_out_event_2mb_hit <= tlb_if_2mb.lookupRspValid;
+            events.vtp_out_event_1gb_hit <= tlb_if_1gb.lookupRspValid;
 
             events.vtp_out_event_4kb_miss <= tlb_if_4kb.fillEn;
             events.vtp_out_event_2mb_miss <= tlb_if_2mb.fillEn;
+            events.vtp_out_event_1gb_miss <= tlb_if_1gb.fillEn;
         end
     end
 
@@ -404,9 +495,21 @@ module cci_mpf_svc_vtp
     // a bus for reading the page table from host memory.
     //
 
+    //
+    // A prefetch that misses in the TLB is complete once its page walk is
+    // requested.  It is not retried, so a walk that fails because the page
+    // was freed after the prefetch was queued is simply dropped.
+    //
+    logic miss_is_prefetch;
+    assign miss_is_prefetch =
+        (miss_port_idx == t_cci_mpf_shim_vtp_port_idx'(PREFETCH_PORT));
+    assign miss_drop = miss_is_prefetch && pt_walk_client.reqRdy &&
+                       tlb_if.fillRdy;
+
     // Add a register stage to walk requests for travel across the FPGA
     logic pt_walk_req_en;
     t_tlb_4kb_va_page_idx pt_walk_req_va;
+    logic pt_walk_req_is_prefetch;
 
     always_ff @(posedge clk)
     begin
@@ -426,9 +529,11 @@ module cci_mpf_svc_vtp
                           tlb_if.fillRdy;
 
         pt_walk_req_va <= tlb_if.lookupMissVA;
+        pt_walk_req_is_prefetch <= miss_is_prefetch;
 
         pt_walk_client.reqEn <= pt_walk_req_en;
         pt_walk_client.reqVA <= pt_walk_req_va;
+        pt_walk_client.reqIsPrefetch <= pt_walk_req_is_prefetch;
 
         if (reset)
         begin
@@ -57,6 +57,11 @@ module cci_mpf_svc_vtp_pipe
     input  logic [$clog2(N_VTP_PORTS)-1 : 0] reqPortIdx,
     output logic [$clog2(N_VTP_PORTS)-1 : 0] rspPortIdx,
 
+    // Port of the request signalling tlb_if.lookupMiss.  The request is
+    // retried unless missDrop is set in the same cycle.
+    output logic [$clog2(N_VTP_PORTS)-1 : 0] missPortIdx,
+    input  logic missDrop,
+
     // TLB lookup
     cci_mpf_shim_vtp_tlb_if.client tlb_if
     );
@@ -101,7 +106,8 @@ module cci_mpf_svc_vtp_pipe
     //  but may indicate the translation failed.  The code here allows
     //  multiple requests to flow through the TLB so that hits can be
     //  returned while the TLB fills from the page table in response
-    //  to misses.  Retried misses will eventually succeed.
+    //  to misses.  Retried misses will eventually succeed.  Misses the
+    //  parent drops with missDrop are not retried and get no response.
     //
     // ====================================================================
 
@@ -114,6 +120,10 @@ module cci_mpf_svc_vtp_pipe
     t_cci_mpf_shim_vtp_lookup_req lookup_rsp;
     t_cci_mpf_shim_vtp_port_idx lookup_rsp_port;
 
+    logic lookup_retry;
+    assign lookup_retry = tlb_if.lookupMiss && ! missDrop;
+    assign missPortIdx = lookup_rsp_port;
+
     cci_mpf_prim_fifo_lutram
       #(
         .N_DATA_BITS($bits(t_cci_mpf_shim_vtp_lookup_req) +
@@ -152,18 +162,18 @@ module cci_mpf_svc_vtp_pipe
         else
         begin
             // Either retry for TLB miss or new request.
-            lookup_req_en <= tlb_if.lookupMiss || new_req_deq;
+            lookup_req_en <= lookup_retry || new_req_deq;
         end
 
         // Next lookup is either a retry or a new request
-        lookup_req <= tlb_if.lookupMiss ? lookup_rsp : new_req;
-        lookup_req_port <= tlb_if.lookupMiss ? lookup_rsp_port : new_req_port;
+        lookup_req <= lookup_retry ? lookup_rsp : new_req;
+        lookup_req_port <= lookup_retry ? lookup_rsp_port : new_req_port;
     end
 
     always_comb
     begin
         new_req_deq = new_req_rdy && lookup_req_notFull && tlb_if.lookupRdy &&
-                      ! tlb_if.lookupMiss;
+                      ! lookup_retry;
 
         // Generate TLB lookup
         tlb_if.lookupEn = lookup_req_en;
@@ -184,7 +194,8 @@ module cci_mpf_svc_vtp_pipe
 
             if (tlb_if.lookupMiss)
             begin
-                $display("VTP PIPE: Lookup retry port %0d, tag %0d, VA 0x%x",
+                $display("VTP PIPE: Lookup %s port %0d, tag %0d, VA 0x%x",
+                         (missDrop ? "drop" : "retry"),
                          lookup_rsp_port,
                          lookup_rsp.tag,
                          {lookup_rsp.pageVA, CCI_PT_4KB_PAGE_OFFSET_BITS'(0), 6'b0});
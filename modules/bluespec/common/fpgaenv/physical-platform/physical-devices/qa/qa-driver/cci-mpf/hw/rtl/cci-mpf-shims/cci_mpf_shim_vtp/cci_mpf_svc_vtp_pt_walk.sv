@@ -229,6 +229,9 @@ module cci_mpf_svc_vtp_pt_walk
     t_tlb_4kb_va_page_idx translate_va;
     assign statLastTranslateVA = { translate_va, CCI_PT_4KB_PAGE_OFFSET_BITS'(0) };
 
+    // Is the walk for a prefetch?
+    logic translate_is_prefetch;
+
     // During translation the VA is broken down into 9 bit indices during
     // the tree-based page walk.  This register is shifted as each level
     // is traversed, leaving the next index in the high bits.
@@ -335,6 +338,7 @@ module cci_mpf_svc_vtp_pt_walk
                 // New request: start by searching the local page table
                 // cache (depth first).
                 translate_va <= pt_walk.reqVA;
+                translate_is_prefetch <= pt_walk.reqIsPrefetch;
                 translate_va_idx_vec <= req_va_as_idx_vec;
                 translate_depth <=
                     t_cci_mpf_pt_walk_depth'(CCI_MPF_PT_MAX_DEPTH - 1);
@@ -458,8 +462,19 @@ module cci_mpf_svc_vtp_pt_walk
                 if (pt_walk_cur_status.error || 
                     ! pt_walk_cur_status.terminal && (&(translate_depth) == 1'b1))
                 begin
-                    state <= STATE_PT_WALK_ERROR;
                     state_is_walk_done <= 1'b0;
+
+                    if (translate_is_prefetch)
+                    begin
+                        // The prefetched page may have been freed while
+                        // the prefetch was queued.  Drop the walk.
+                        state <= STATE_PT_WALK_IDLE;
+                        state_is_walk_idle <= 1'b1;
+                    end
+                    else
+                    begin
+                        state <= STATE_PT_WALK_ERROR;
+                    end
                 end
 
                 // Shift to move to the index of the next level.
@@ -554,9 +569,10 @@ module cci_mpf_svc_vtp_pt_walk
         begin
             if (pt_walk.reqEn && (state == STATE_PT_WALK_IDLE))
             begin
-                $display("VTP PT WALK: New req translate line 0x%x (VA 0x%x)",
+                $display("VTP PT WALK: New req translate line 0x%x (VA 0x%x)%s",
                          { pt_walk.reqVA, CCI_PT_4KB_PAGE_OFFSET_BITS'(0) },
-                         { pt_walk.reqVA, CCI_PT_4KB_PAGE_OFFSET_BITS'(0), 6'b0 });
+                         { pt_walk.reqVA, CCI_PT_4KB_PAGE_OFFSET_BITS'(0), 6'b0 },
+                         (pt_walk.reqIsPrefetch ? " prefetch" : ""));
             end
 
             if ((state == STATE_PT_WALK_READ_CACHE_REQ) && ptReadCacheRdy)
@@ -614,7 +630,8 @@ module cci_mpf_svc_vtp_pt_walk
             begin
                 $display("VTP PT WALK: Response PA 0x%x, size %s",
                          {pt_walk_cur_page, CCI_PT_4KB_PAGE_OFFSET_BITS'(0), 6'b0},
-                         (tlb_fill_if.fillBigPage ? "2MB" : "4KB"));
+                         (tlb_fill_if.fill1GBPage ? "1GB" :
+                              (tlb_fill_if.fillBigPage ? "2MB" : "4KB")));
             end
         end
     end
@@ -633,9 +650,12 @@ module cci_mpf_svc_vtp_pt_walk
     assign tlb_fill_if.fillVA = translate_va;
     assign tlb_fill_if.fillPA = pt_walk_cur_page;
 
-    // Use just bit 0 of translate_depth, which is either 2 for a 2MB page
-    // or 3 for a 4KB page.
-    assign tlb_fill_if.fillBigPage = ! (translate_depth[0]);
+    // translate_depth is 1 for a 1GB page, 2 for a 2MB page and 3 for
+    // a 4KB page.
+    assign tlb_fill_if.fillBigPage =
+        (translate_depth != t_cci_mpf_pt_walk_depth'(CCI_MPF_PT_MAX_DEPTH - 1));
+    assign tlb_fill_if.fill1GBPage =
+        (translate_depth == t_cci_mpf_pt_walk_depth'(1));
 
 endmodule // cci_mpf_svc_vtp_pt_walk
 
@@ -49,10 +49,16 @@
 module cci_mpf_svc_vtp_tlb
   #(
     // Number of offset bits in pages managed by this TLB instance.  OFFSETS
-    // ARE LINES, NOT BYTES.  Typical values are 6 for 4KB pages and 15
-    // for 2MB pages.
+    // ARE LINES, NOT BYTES.  Typical values are 6 for 4KB pages, 15
+    // for 2MB pages and 24 for 1GB pages.
     parameter CCI_PT_PAGE_OFFSET_BITS = CCI_PT_2MB_PAGE_OFFSET_BITS,
 
+    // Granularity of translations returned by lookups.  When smaller than
+    // CCI_PT_PAGE_OFFSET_BITS, the VA bits between the two are copied to
+    // the response PA.  This is used to return 1GB translations to clients
+    // that cache at most 2MB pages.
+    parameter LOOKUP_RSP_PAGE_OFFSET_BITS = CCI_PT_PAGE_OFFSET_BITS,
+
     // Number of sets in the FPGA-side TLB
     parameter NUM_TLB_SETS = 512,
 
@@ -121,6 +127,20 @@ module cci_mpf_svc_vtp_tlb
         return p4k;
     endfunction
 
+    // Merge the VA bits below this TLB's page size, down to
+    // LOOKUP_RSP_PAGE_OFFSET_BITS, into a translated PA.
+    function automatic t_tlb_4kb_pa_page_idx tlbRspPAIdx(t_tlb_4kb_pa_page_idx pa,
+                                                         t_tlb_4kb_va_page_idx va);
+        t_tlb_4kb_pa_page_idx p = pa;
+        for (int i = LOOKUP_RSP_PAGE_OFFSET_BITS - CCI_PT_4KB_PAGE_OFFSET_BITS;
+             i < CCI_PT_PAGE_OFFSET_BITS - CCI_PT_4KB_PAGE_OFFSET_BITS;
+             i = i + 1)
+        begin
+            p[i] = va[i];
+        end
+        return p;
+    endfunction
+
 
     // A virtual address tag is the remainder of the address after using
     // the low bits as a direct-mapped index to a TLB set.  NOTE: The
@@ -229,6 +249,9 @@ module cci_mpf_svc_vtp_tlb
     typedef struct {
         logic did_lookup;
         t_tlb_va_page_idx lookup_page_va;
+        // Full requested VA, needed only when LOOKUP_RSP_PAGE_OFFSET_BITS
+        // is smaller than the page size.  Unused bits are pruned.
+        t_tlb_4kb_va_page_idx lookup_4kb_va;
     } t_tlb_stage_state;
 
     localparam NUM_TLB_LOOKUP_PIPE_STAGES = 5;
@@ -248,6 +271,7 @@ module cci_mpf_svc_vtp_tlb
         end 
 
         stg_state[1].lookup_page_va <= tlbVAIdxFrom4K(tlb_if.lookupPageVA);
+        stg_state[1].lookup_4kb_va <= tlb_if.lookupPageVA;
 
         for (int s = 1; s < NUM_TLB_LOOKUP_PIPE_STAGES; s = s + 1)
         begin
@@ -430,7 +454,9 @@ module cci_mpf_svc_vtp_tlb
             tlbVAIdxTo4K(stg_state[NUM_TLB_LOOKUP_PIPE_STAGES].lookup_page_va);
 
         // Get the physical page index from the chosen way
-        tlb_if.lookupRspPagePA <= lookup_page_pa;
+        tlb_if.lookupRspPagePA <=
+            tlbRspPAIdx(lookup_page_pa,
+                        stg_state[NUM_TLB_LOOKUP_PIPE_STAGES].lookup_4kb_va);
     end
 
 
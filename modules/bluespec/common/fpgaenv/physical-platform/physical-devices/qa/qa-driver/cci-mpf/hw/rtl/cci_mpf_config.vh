@@ -63,6 +63,17 @@
   `define  VTP_N_TLB_2MB_WAYS 4
 `endif
 
+`ifndef VTP_N_TLB_1GB_SETS
+  // Making this smaller than 512 will save no space since sets are mapped
+  // to block RAM and this is the minimum memory depth.
+  `define  VTP_N_TLB_1GB_SETS 512
+`endif
+
+`ifndef VTP_N_TLB_1GB_WAYS
+  // Even two ways of 512 sets cover far more memory than a host holds.
+  `define  VTP_N_TLB_1GB_WAYS 2
+`endif
+
 
 // ========================================================================
 //
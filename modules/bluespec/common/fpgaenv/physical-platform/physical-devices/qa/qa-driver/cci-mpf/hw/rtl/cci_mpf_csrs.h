@@ -75,8 +75,19 @@ typedef enum
     // virtual address that failed.
     CCI_MPF_VTP_CSR_STAT_PT_WALK_LAST_VADDR = 96,
 
+    // Statistics for 1GB pages.  1GB TLB hits are not counted as 2MB
+    // hits even though the translation is returned as a 2MB page.
+    CCI_MPF_VTP_CSR_STAT_1GB_TLB_NUM_HITS = 104,
+    CCI_MPF_VTP_CSR_STAT_1GB_TLB_NUM_MISSES = 112,
+
+    // Load the translation of a virtual address (line address) into the
+    // TLB ahead of use (write).  Prefetches are hints.  They are dropped
+    // when the FPGA-side prefetch queue is full or the page isn't mapped.
+    // Prefetch lookups are counted in the TLB hit and miss statistics.
+    CCI_MPF_VTP_CSR_PREFETCH_PAGE_VADDR = 120,
+
     // Must be last
-    CCI_MPF_VTP_CSR_SIZE = 104
+    CCI_MPF_VTP_CSR_SIZE = 128
 }
 t_cci_mpf_vtp_csr_offsets;
 
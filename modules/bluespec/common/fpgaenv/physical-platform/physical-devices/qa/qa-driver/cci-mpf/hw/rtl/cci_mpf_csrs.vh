@@ -58,6 +58,9 @@ interface cci_mpf_csrs();
     // Input: invalidate the translation for one page
     t_cci_clAddr vtp_in_inval_page;
     logic        vtp_in_inval_page_valid;
+    // Input: load the translation for one page into the TLB
+    t_cci_clAddr vtp_in_prefetch_page;
+    logic        vtp_in_prefetch_page_valid;
 
     // Events: these wires fire to indicate an event. The CSR shim sums
     // events into counters.
@@ -65,6 +68,8 @@ interface cci_mpf_csrs();
     logic vtp_out_event_4kb_miss;
     logic vtp_out_event_2mb_hit;
     logic vtp_out_event_2mb_miss;
+    logic vtp_out_event_1gb_hit;
+    logic vtp_out_event_1gb_miss;
     logic vtp_out_event_pt_walk_busy;
     logic vtp_out_event_failed_translation;
     t_cci_clAddr vtp_out_pt_walk_last_vaddr;
@@ -109,6 +114,8 @@ interface cci_mpf_csrs();
         output vtp_in_page_table_base_valid,
         output vtp_in_inval_page,
         output vtp_in_inval_page_valid,
+        output vtp_in_prefetch_page,
+        output vtp_in_prefetch_page_valid,
 
         output vc_map_ctrl,
         output vc_map_ctrl_valid,
@@ -123,6 +130,8 @@ interface cci_mpf_csrs();
         input  vtp_out_event_4kb_miss,
         input  vtp_out_event_2mb_hit,
         input  vtp_out_event_2mb_miss,
+        input  vtp_out_event_1gb_hit,
+        input  vtp_out_event_1gb_miss,
         input  vtp_out_event_pt_walk_busy,
         input  vtp_out_event_failed_translation,
         input  vtp_out_pt_walk_last_vaddr,
@@ -143,7 +152,9 @@ interface cci_mpf_csrs();
         input  vtp_in_page_table_base,
         input  vtp_in_page_table_base_valid,
         input  vtp_in_inval_page,
-        input  vtp_in_inval_page_valid
+        input  vtp_in_inval_page_valid,
+        input  vtp_in_prefetch_page,
+        input  vtp_in_prefetch_page_valid
         );
     modport vtp_events
        (
@@ -151,6 +162,8 @@ interface cci_mpf_csrs();
         output vtp_out_event_4kb_miss,
         output vtp_out_event_2mb_hit,
         output vtp_out_event_2mb_miss,
+        output vtp_out_event_1gb_hit,
+        output vtp_out_event_1gb_miss,
         output vtp_out_event_pt_walk_busy,
         output vtp_out_event_failed_translation,
         output vtp_out_pt_walk_last_vaddr
@@ -109,11 +109,14 @@ typedef struct
    btUnsigned64bitInt numTLBMisses4KB;
    btUnsigned64bitInt numTLBHits2MB;
    btUnsigned64bitInt numTLBMisses2MB;
+   btUnsigned64bitInt numTLBHits1GB;
+   btUnsigned64bitInt numTLBMisses1GB;
 
    // Number of cycles spent with the page table walker active.  Since
    // the walker manages only one request at a time the latency of the
    // page table walker can be computed as:
-   //   numPTWalkBusyCycles / (numTLBMisses4KB + numTLBMisses2MB)
+   //   numPTWalkBusyCycles /
+   //     (numTLBMisses4KB + numTLBMisses2MB + numTLBMisses1GB)
    btUnsigned64bitInt numPTWalkBusyCycles;
 
    // Number of failed virtual to physical translations. The VTP page
@@ -125,6 +128,18 @@ typedef struct
    // Last virtual address translated. If numFailedTranslations is non-zero
    // this is the failing virtual address.
    btVirtAddr ptWalkLastVAddr;
+
+   // Hits and misses in the host-side translation cache that filters
+   // page table walks in bufferGetIOVA().
+   btUnsigned64bitInt numSWTranslationCacheHits;
+   btUnsigned64bitInt numSWTranslationCacheMisses;
+
+   // Page table footprint.  4KB table pages shared with the FPGA, the
+   // number of those held on the free list for reuse and bytes of
+   // host-only memory used to walk the table.
+   btUnsigned64bitInt numPTTablePages;
+   btUnsigned64bitInt numPTFreeTablePages;
+   btUnsigned64bitInt numPTHostBytes;
 }
 t_cci_mpf_vtp_stats;
 
@@ -136,6 +151,16 @@ public:
    /// Reset VTP (invalidate TLB)
    virtual btBool vtpReset( void ) = 0;
 
+   /// Load translations for the pages covering [va, va + len) into the
+   /// FPGA-side TLB ahead of use, e.g. for the buffers of the next phase
+   /// of an algorithm while the current phase runs.  Prefetches are hints.
+   /// At most as many pages as the FPGA can queue (16) are sent per call;
+   /// later pages in the range are ignored, so long ranges should be
+   /// prefetched in pieces as they come into use.  Unmapped pages are
+   /// skipped, as are pages freed while their prefetch is still queued.
+   /// Returns false only if a prefetch could not be sent.
+   virtual btBool vtpPrefetch( btVirtAddr va, btWSSize len ) = 0;
+
    // Return all statistics counters
    virtual btBool vtpGetStats( t_cci_mpf_vtp_stats *stats ) = 0;
 };
@@ -109,7 +109,8 @@ MPFVTP::MPFVTP( IALIBuffer *pBufferService,
                 btCSROffset vtpDFHOffset ) : m_pALIBuffer( pBufferService),
                                              m_pALIMMIO( pMMIOService ),
                                              m_dfhOffset( vtpDFHOffset ),
-                                             m_isOK( false )
+                                             m_isOK( false ),
+                                             m_deferInval( false )
 {
    ali_errnum_e err;
    btBool ret;                                // for error checking
@@ -147,6 +148,17 @@ MPFVTP::MPFVTP( IALIBuffer *pBufferService,
    m_isOK = true;
 }
 
+MPFVTP::~MPFVTP()
+{
+   // Block traffic and drop FPGA-side translations before the table
+   // is released.
+   if (m_isOK) {
+      m_pALIMMIO->mmioWrite64(m_dfhOffset + CCI_MPF_VTP_CSR_MODE, 2);
+   }
+
+   ptTerminate();
+}
+
 //
 // Allocate virtual buffer, potentially assembling it from several physical
 // buffers.
@@ -195,21 +207,24 @@ ali_errnum_e MPFVTP::bufferAllocate( btWSSize             Length,
    // An extra page is added to the request in order to enable alignment
    // of the base address.  Linux is only guaranteed to return 4 KB aligned
    // addresses and we want large page aligned virtual addresses.
+   // Buffers of at least 1GB are aligned to 1GB so that huge pages
+   // can be used.
    // TODO: Assumption is still that virtual buffer needs to be large-page
    //        (2MB) aligned, even smaller ones. Make that configurable.
+   size_t align = (Length >= HUGE_PAGE_SIZE) ? HUGE_PAGE_SIZE : LARGE_PAGE_SIZE;
    void* va_base;
-   size_t va_base_len = Length + LARGE_PAGE_SIZE;
+   size_t va_base_len = Length + align;
    va_base = mmap(NULL, va_base_len,
                   PROT_READ | PROT_WRITE,
                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
    MPF_ASSERT_RET(va_base != MAP_FAILED, ali_errnumNoMem);
    AAL_DEBUG(LM_AFU, "va_base " << std::hex << std::setw(2) << std::setfill('0') << va_base << std::endl);
 
-   void* va_aligned = (void*)((size_t(va_base) + LARGE_PAGE_SIZE - 1) & LARGE_PAGE_MASK);
+   void* va_aligned = (void*)((size_t(va_base) + align - 1) & ~(align - 1));
    AAL_DEBUG(LM_AFU, "va_aligned " << std::hex << std::setw(2) << std::setfill('0') << va_aligned << std::endl);
 
    // Trim off the unnecessary extra space after alignment
-   size_t trim = LARGE_PAGE_SIZE - (size_t(va_aligned) - size_t(va_base));
+   size_t trim = align - (size_t(va_aligned) - size_t(va_base));
    AAL_DEBUG(LM_AFU, "va_base_len trimmed by " << std::hex << std::setw(2) << std::setfill('0') << trim << " to " << va_base_len - trim << std::endl);
    pRet = mremap(va_base, va_base_len, va_base_len - trim, 0);
    MPF_ASSERT_RET(va_base == pRet, ali_errnumNoMem);
@@ -223,9 +238,9 @@ ali_errnum_e MPFVTP::bufferAllocate( btWSSize             Length,
 
    void * va_alloc = (void *)(size_t(va_aligned) + Length);
 
-   // Flags to indicate first/last page in an allocated region, stored in
-   // the page table
-   uint32_t pt_flags = MPFVTP_PT_FLAG_ALLOC_END;
+   // Allocated pages, in the order they were allocated (decreasing VA).
+   // They are added to the page table once all are allocated.
+   std::vector<MPFVTP_PT_PAGE> pages;
 
    // -------------------------------------------------------------------------
    // small buffer allocation loop
@@ -243,17 +258,16 @@ ali_errnum_e MPFVTP::bufferAllocate( btWSSize             Length,
       va_base_len -= SMALL_PAGE_SIZE;
 
       // allocate buffer
-      if (Length <= SMALL_PAGE_SIZE) {
-         pt_flags |= MPFVTP_PT_FLAG_ALLOC_START;
-      }
-      err = _allocate((btVirtAddr)va_alloc, SMALL_PAGE_SIZE, pt_flags);
+      err = _allocate((btVirtAddr)va_alloc, SMALL_PAGE_SIZE, pages);
       if (err != ali_errnumOK) {
          AAL_ERR(LM_AFU, "Unable to allocate buffer. Err: " << err);
+         _freePages(pages);
+         if (va_base_len != 0) {
+            munmap(va_base, va_base_len);
+         }
          return err;
-         // FIXME: leaking already allocated pages!
       }
 
-      pt_flags = 0;
       Length -= SMALL_PAGE_SIZE;
    }
 
@@ -265,11 +279,21 @@ ali_errnum_e MPFVTP::bufferAllocate( btWSSize             Length,
    // -------------------------------------------------------------------------
    // Run for the remaining space, which should be an integer multiple of the
    // large buffer size in size, and aligned to large buffer boundaries. If
-   // large buffer allocation fails, fall back to small buffers.
-   size_t effPageSize = LARGE_PAGE_SIZE;     // page size used for actual allocations
+   // large buffer allocation fails, fall back to small buffers.  Huge (1GB)
+   // pages are used where the remaining space is 1GB aligned, falling
+   // back to large pages if huge pages aren't available.
+   size_t largePageSize = LARGE_PAGE_SIZE;   // page size used for actual allocations
+   btBool tryHugePages = true;
 
    while (Length > 0) {
 
+      size_t effPageSize = largePageSize;
+      if (tryHugePages && (largePageSize == LARGE_PAGE_SIZE) &&
+          (Length >= HUGE_PAGE_SIZE) &&
+          ((size_t(va_alloc) & (HUGE_PAGE_SIZE - 1)) == 0)) {
+         effPageSize = HUGE_PAGE_SIZE;
+      }
+
       va_alloc = (void *)(size_t(va_alloc) - effPageSize);
 
       // Shrink the reserved area in order to make a hole in the virtual
@@ -285,41 +309,45 @@ ali_errnum_e MPFVTP::bufferAllocate( btWSSize             Length,
       }
 
       // allocate buffer
-      if (Length <= effPageSize) {
-         pt_flags |= MPFVTP_PT_FLAG_ALLOC_START;
-      }
-      err = _allocate((btVirtAddr)va_alloc, effPageSize, pt_flags);
+      err = _allocate((btVirtAddr)va_alloc, effPageSize, pages);
       if (err != ali_errnumOK) {
-         if (effPageSize == LARGE_PAGE_SIZE) {
-            // fall back to small buffers:
-            // restore last large mapping
+         if (effPageSize != SMALL_PAGE_SIZE) {
+            // fall back to smaller buffers:
+            // restore last mapping
             if (va_base_len == 0) {
                // corner case: this was the last mapping - we destroyed it, so
                // try to restore it.
-               va_base = mmap(va_alloc, LARGE_PAGE_SIZE,
+               va_base = mmap(va_alloc, effPageSize,
                               PROT_READ | PROT_WRITE,
                               MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
                MPF_ASSERT_RET(va_base == va_alloc, ali_errnumNoMem);
             } else {
                // this was not the last mapping (or va_base is not aligned), so
                // we still have a valid reserved space. Just resize it back up.
-               pRet = mremap(va_base, va_base_len, va_base_len + LARGE_PAGE_SIZE, 0);
+               pRet = mremap(va_base, va_base_len, va_base_len + effPageSize, 0);
                MPF_ASSERT_RET(pRet == va_base, ali_errnumNoMem);
             }
-            va_base_len += LARGE_PAGE_SIZE;
-            va_alloc = (void *)(size_t(va_alloc) + LARGE_PAGE_SIZE);
-            effPageSize = SMALL_PAGE_SIZE;
-            continue;    // try again with smal buffers
+            va_base_len += effPageSize;
+            va_alloc = (void *)(size_t(va_alloc) + effPageSize);
+            if (effPageSize == HUGE_PAGE_SIZE) {
+               // try again with large buffers
+               tryHugePages = false;
+            } else {
+               largePageSize = SMALL_PAGE_SIZE;
+            }
+            continue;    // try again with smaller buffers
          } else {
             // already using small buffers, nowhere to fall back to.
             AAL_ERR(LM_AFU, "Unable to allocate buffer. Err: " << err);
+            _freePages(pages);
+            if (va_base_len != 0) {
+               munmap(va_base, va_base_len);
+            }
             return err;
-            // FIXME: leaking already allocated pages!
          }
       }
 
       // mapping successful, on to the next
-      pt_flags = 0;
       Length -= effPageSize;
    }
 
@@ -329,6 +357,46 @@ ali_errnum_e MPFVTP::bufferAllocate( btWSSize             Length,
        munmap(va_base, va_base_len);
    }
 
+   // Add the pages to the page table, walking the list backwards to get
+   // increasing VAs.  Each run of same-sized pages is inserted with a
+   // single walk per leaf table.  The lowest page is flagged as the start
+   // of the allocated region and the highest as the end.
+   std::vector<btPhysAddr> run_pa;
+   size_t idx = pages.size();
+   while (idx > 0) {
+      size_t run_start = idx;
+      btVirtAddr run_va = pages[idx - 1].va;
+      MPFVTP_PAGE_SIZE run_size = pages[idx - 1].size;
+
+      run_pa.clear();
+      while ((idx > 0) && (pages[idx - 1].size == run_size)) {
+         run_pa.push_back(pages[idx - 1].pa);
+         idx -= 1;
+      }
+
+      uint32_t pt_flags = 0;
+      if (run_start == pages.size()) {
+         pt_flags |= MPFVTP_PT_FLAG_ALLOC_START;
+      }
+      if (idx == 0) {
+         pt_flags |= MPFVTP_PT_FLAG_ALLOC_END;
+      }
+
+      if (! ptInsertRange(run_va, &run_pa[0], run_pa.size(), run_size, pt_flags)) {
+         AAL_ERR(LM_All, "Page table insertion error." << std::endl);
+
+         // ptInsertRange() has already dropped the failed run.  Runs below
+         // it were inserted and must be removed before their pages are
+         // released.
+         btVirtAddr low_va = pages.back().va;
+         if (run_va != low_va) {
+            ptRemoveRange(low_va, run_va - low_va);
+         }
+         _freePages(pages);
+         return ali_errnumBadMapping;
+      }
+   }
+
 #if defined(ENABLE_DEBUG) && (0 != ENABLE_DEBUG)
    ptDumpPageTable();
 #endif
@@ -338,10 +406,11 @@ ali_errnum_e MPFVTP::bufferAllocate( btWSSize             Length,
 }
 
 //
-// allocate page of size pageSize to virtual address va and add entry to VTP
-// page table
+// allocate page of size pageSize to virtual address va and record it in
+// pages.  The caller adds the pages to the VTP page table.
 //
-ali_errnum_e MPFVTP::_allocate(btVirtAddr va, size_t pageSize, uint32_t flags)
+ali_errnum_e MPFVTP::_allocate(btVirtAddr va, size_t pageSize,
+                              std::vector<MPFVTP_PT_PAGE> &pages)
 {
    ali_errnum_e err;
    MPFVTP_PAGE_SIZE mapType;
@@ -353,7 +422,9 @@ ali_errnum_e MPFVTP::_allocate(btVirtAddr va, size_t pageSize, uint32_t flags)
    AAL_DEBUG(LM_AFU, "_allocate(" << std::hex << std::setw(2) << std::setfill('0') << (void *)va << ", " << std::dec << (unsigned int)pageSize << ")" << std::endl);
 
    // determine mapping type for page table entry
-   if (pageSize == LARGE_PAGE_SIZE) {
+   if (pageSize == HUGE_PAGE_SIZE) {
+      mapType = MPFVTP_PAGE_1GB;
+   } else if (pageSize == LARGE_PAGE_SIZE) {
       mapType = MPFVTP_PAGE_2MB;
    } else if (pageSize == SMALL_PAGE_SIZE) {
       mapType = MPFVTP_PAGE_4KB;
@@ -366,17 +437,16 @@ ali_errnum_e MPFVTP::_allocate(btVirtAddr va, size_t pageSize, uint32_t flags)
    bufAllocArgs->Add(ALI_MMAP_TARGET_VADDR_KEY, static_cast<ALI_MMAP_TARGET_VADDR_DATATYPE>(va));
    err = m_pALIBuffer->bufferAllocate(pageSize, &alloc, *bufAllocArgs);
 
-   // insert VTP page table entry
+   // record the page for the VTP page table
    if (err == ali_errnumOK) {
       MPF_ASSERT_RET(va == alloc, ali_errnumNoMem);
 
-      if (! ptInsertPageMapping(btVirtAddr(va),
-                                m_pALIBuffer->bufferGetIOVA((unsigned char *)va),
-                                mapType,
-                                flags)) {
-         AAL_ERR(LM_All, "Page table insertion error." << std::endl);
-         err = ali_errnumBadMapping;
-      }
+      MPFVTP_PT_PAGE page;
+      page.va = va;
+      page.pa = m_pALIBuffer->bufferGetIOVA((unsigned char *)va);
+      page.size = mapType;
+      page.flags = 0;
+      pages.push_back(page);
    }
 
    delete bufAllocArgs;
@@ -384,15 +454,28 @@ ali_errnum_e MPFVTP::_allocate(btVirtAddr va, size_t pageSize, uint32_t flags)
 }
 
 //
-// Free buffer (not supported).
+// Release pages allocated by _allocate() that never became a complete
+// buffer.  None of them is in the page table.
+//
+void MPFVTP::_freePages(const std::vector<MPFVTP_PT_PAGE> &pages)
+{
+   for (size_t i = 0; i < pages.size(); i++) {
+      m_pALIBuffer->bufferFree(pages[i].va);
+   }
+}
+
+//
+// Free buffer.  The object lock serializes page table updates and the
+// deferred invalidation list with bufferAllocate() and vtpPrefetch().
+// The FPGA must no longer be accessing the buffer.
 //
 ali_errnum_e MPFVTP::bufferFree(btVirtAddr Address)
 {
+   AutoLock(this);
+
    btVirtAddr va = Address;
    btPhysAddr pa;
-   MPFVTP_PAGE_SIZE size;
    uint32_t flags;
-   bool ret;
 
    // Is the address the beginning of an allocation region?
    if (! ptTranslateVAtoPA(va, &pa, &flags)) {
@@ -404,34 +487,63 @@ ali_errnum_e MPFVTP::bufferFree(btVirtAddr Address)
       return ali_errnumNoMem;
    }
 
-   while (ptRemovePageMapping(va, NULL, NULL, &size, &flags)) {
-      ret = ptInvalVAMapping(va);
-      MPF_ASSERT_RET(ret, ali_errnumNoMem);
-      if (!ret) {
-         return ali_errnumNoMem;
+   // Drop the whole region from the page table, up to the page flagged
+   // as the end of the allocation.  Invalidation of table pages released
+   // along the way is deferred until the size of the region is known.
+   std::vector<MPFVTP_PT_PAGE> pages;
+   m_deferInval = true;
+   bool found = ptRemoveRange(va, ~btWSSize(0), &pages);
+   m_deferInval = false;
+
+   // Each invalidation is a serialized MMIO write.  Large regions are
+   // cheaper to drop by flushing all FPGA-side translations.  A failed
+   // invalidation is reported only after the pages and the deferred list
+   // are released, since the page table no longer refers to either.
+   ali_errnum_e err = ali_errnumOK;
+   if (pages.size() + m_deferredInval.size() > CCI_MPF_VTP_INVAL_ALL_THRESHOLD) {
+      if (! _vtpInvalAll()) {
+         err = ali_errnumNoMem;
+      }
+   } else {
+      for (size_t i = 0; (err == ali_errnumOK) && (i < pages.size()); i++) {
+         if (! ptInvalVAMapping(pages[i].va)) {
+            err = ali_errnumNoMem;
+         }
       }
 
-      m_pALIBuffer->bufferFree(va);
-
-      // Done?
-      if (flags & MPFVTP_PT_FLAG_ALLOC_END) {
-#if defined(ENABLE_DEBUG) && (0 != ENABLE_DEBUG)
-         ptDumpPageTable();
-#endif
-         return ali_errnumOK;
+      for (size_t i = 0; (err == ali_errnumOK) && (i < m_deferredInval.size()); i++) {
+         if (! ptInvalVAMapping(m_deferredInval[i])) {
+            err = ali_errnumNoMem;
+         }
       }
+   }
+   m_deferredInval.clear();
 
-      // Next page address
-      va += (size == MPFVTP_PAGE_2MB ? LARGE_PAGE_SIZE : SMALL_PAGE_SIZE);
+   for (size_t i = 0; i < pages.size(); i++) {
+      m_pALIBuffer->bufferFree(pages[i].va);
    }
 
-   AAL_ERR(LM_All, "bufferFree translation error" << std::endl);
-   return ali_errnumNoMem;
+   if (err != ali_errnumOK) {
+      AAL_ERR(LM_All, "bufferFree invalidation failed" << std::endl);
+      return err;
+   }
+
+   if (! found || pages.empty() ||
+       ! (pages.back().flags & MPFVTP_PT_FLAG_ALLOC_END)) {
+      AAL_ERR(LM_All, "bufferFree translation error" << std::endl);
+      return ali_errnumNoMem;
+   }
+
+#if defined(ENABLE_DEBUG) && (0 != ENABLE_DEBUG)
+   ptDumpPageTable();
+#endif
+   return ali_errnumOK;
 }
 
 
 //
-// Get virtual to physical address mapping.
+// Get virtual to physical address mapping.  No lock is needed.  Page
+// table translation is safe while other threads allocate and free.
 //
 btPhysAddr MPFVTP::bufferGetIOVA( btVirtAddr Address)
 {
@@ -461,6 +573,62 @@ btBool MPFVTP::vtpReset( void )
    return _vtpEnable();
 }
 
+//
+// Queue FPGA-side TLB fills for the pages covering [va, va + len).  One
+// prefetch is sent for each page, whatever its size, up to the depth of
+// the FPGA-side queue.  Pages beyond that are not sent, since the FPGA
+// would drop them anyway.  Unmapped regions are skipped a whole missing
+// page table entry at a time.  A page freed while its prefetch is still
+// queued is harmless: the FPGA drops prefetches whose page table walk
+// fails.
+//
+btBool MPFVTP::vtpPrefetch( btVirtAddr va, btWSSize len )
+{
+   // Serialize with page table updates in bufferAllocate() and bufferFree()
+   AutoLock(this);
+
+   btVirtAddr end = va + len;
+   size_t n_sent = 0;
+
+   while ((va < end) && (n_sent < CCI_MPF_VTP_MAX_PREFETCH)) {
+      btPhysAddr pa;
+      MPFVTP_PAGE_SIZE size;
+      size_t page_bytes;
+
+      if (ptTranslateVAtoPA(va, &pa, NULL, &size)) {
+         if (size == MPFVTP_PAGE_1GB) {
+            page_bytes = HUGE_PAGE_SIZE;
+         } else if (size == MPFVTP_PAGE_2MB) {
+            page_bytes = LARGE_PAGE_SIZE;
+         } else {
+            page_bytes = SMALL_PAGE_SIZE;
+         }
+
+         if (! m_pALIMMIO->mmioWrite64(m_dfhOffset + CCI_MPF_VTP_CSR_PREFETCH_PAGE_VADDR,
+                                       uint64_t(va) / CL(1))) {
+            AAL_ERR(LM_All, "vtpPrefetch MMIO write failed" << std::endl);
+            return false;
+         }
+         n_sent += 1;
+      }
+      else {
+         page_bytes = ptUnmappedSize(va);
+         if (page_bytes == 0) {
+            page_bytes = SMALL_PAGE_SIZE;
+         }
+      }
+
+      // Start of the next page or hole.  Stop at the top of the address
+      // space.
+      btVirtAddr next =
+         btVirtAddr((uint64_t(va) & ~uint64_t(page_bytes - 1)) + page_bytes);
+      if (next <= va) break;
+      va = next;
+   }
+
+   return true;
+}
+
 //
 // Enable MPF/VTP feature.
 //
@@ -484,6 +652,26 @@ btBool MPFVTP::_vtpEnable( void )
    return ret;
 }
 
+//
+// Invalidate all FPGA-side translations (TLBs and page table walker cache).
+// VTP is disabled while the translation cache is flushed and then enabled
+// again, as in vtpReset().  Memory traffic is blocked only briefly, so the
+// caller must already have quiesced FPGA accesses to the pages being freed.
+//
+btBool MPFVTP::_vtpInvalAll( void )
+{
+   btBool ret = false;
+
+   ret = m_pALIMMIO->mmioWrite64(m_dfhOffset + CCI_MPF_VTP_CSR_MODE, 2);
+   MPF_ASSERT_RET(ret, ali_errnumNoMem);
+
+   if (!ret) {
+      return ret;
+   }
+
+   return _vtpEnable();
+}
+
 //
 // Return all statistics counters
 //
@@ -493,11 +681,24 @@ btBool MPFVTP::vtpGetStats( t_cci_mpf_vtp_stats *stats )
     stats->numTLBMisses4KB = vtpGetStatCounter(CCI_MPF_VTP_CSR_STAT_4KB_TLB_NUM_MISSES);
     stats->numTLBHits2MB = vtpGetStatCounter(CCI_MPF_VTP_CSR_STAT_2MB_TLB_NUM_HITS);
     stats->numTLBMisses2MB = vtpGetStatCounter(CCI_MPF_VTP_CSR_STAT_2MB_TLB_NUM_MISSES);
+    stats->numTLBHits1GB = vtpGetStatCounter(CCI_MPF_VTP_CSR_STAT_1GB_TLB_NUM_HITS);
+    stats->numTLBMisses1GB = vtpGetStatCounter(CCI_MPF_VTP_CSR_STAT_1GB_TLB_NUM_MISSES);
     stats->numPTWalkBusyCycles = vtpGetStatCounter(CCI_MPF_VTP_CSR_STAT_PT_WALK_BUSY_CYCLES);
     stats->numFailedTranslations = vtpGetStatCounter(CCI_MPF_VTP_CSR_STAT_FAILED_TRANSLATIONS);
 
     stats->ptWalkLastVAddr = btVirtAddr(CL(1) * vtpGetStatCounter(CCI_MPF_VTP_CSR_STAT_PT_WALK_LAST_VADDR));
 
+    uint64_t sw_hits, sw_misses;
+    ptGetTranslationCacheStats(&sw_hits, &sw_misses);
+    stats->numSWTranslationCacheHits = sw_hits;
+    stats->numSWTranslationCacheMisses = sw_misses;
+
+    uint64_t pt_pages, pt_free_pages, pt_host_bytes;
+    ptGetFootprint(&pt_pages, &pt_free_pages, &pt_host_bytes);
+    stats->numPTTablePages = pt_pages;
+    stats->numPTFreeTablePages = pt_free_pages;
+    stats->numPTHostBytes = pt_host_bytes;
+
     return true;
 }
 
@@ -527,17 +728,34 @@ MPFVTP::ptAllocSharedPage(btWSSize length, btPhysAddr* pa)
    ali_errnum_e err;
    btVirtAddr va;
 
+   // Failure is not an error here.  The page table falls back to a
+   // single page when a slab can't be allocated.
    err = m_pALIBuffer->bufferAllocate(length, &va);
-   MPF_ASSERT_RET(err == ali_errnumOK && va, NULL);
+   if ((err != ali_errnumOK) || (va == NULL)) {
+      return NULL;
+   }
 
    *pa = m_pALIBuffer->bufferGetIOVA((unsigned char *)va);
    return va;
 }
 
 
+void
+MPFVTP::ptFreeSharedPage(btVirtAddr va, btWSSize length)
+{
+   m_pALIBuffer->bufferFree(va);
+}
+
+
 bool
 MPFVTP::ptInvalVAMapping(btVirtAddr va)
 {
+    if (m_deferInval)
+    {
+        m_deferredInval.push_back(va);
+        return true;
+    }
+
     return m_pALIMMIO->mmioWrite64(m_dfhOffset + CCI_MPF_VTP_CSR_INVAL_PAGE_VADDR,
                                    uint64_t(va) / CL(1));
 }
@@ -74,11 +74,15 @@ class MPFVTP : public CAASBase, public IMPFVTP, private MPFVTP_PAGE_TABLE
 {
 public:
 
-   /// VTP constructor
+   /// VTP constructor.  The page table pins a 2MB shared buffer for
+   /// table pages as soon as it is initialized.
    MPFVTP( IALIBuffer *pBufferService,
            IALIMMIO   *pMMIOService,
            btCSROffset vtpDFHOffset );
 
+   /// VTP destructor.  Releases the page table.
+   ~MPFVTP();
+
    // <IVTP>
    ali_errnum_e bufferAllocate( btWSSize             Length,
                                 btVirtAddr          *pBufferptr )
@@ -103,6 +107,9 @@ public:
    // invalidate FPGA-side translation cache
    btBool vtpReset( void );
 
+   // load FPGA-side TLB with translations for a region
+   btBool vtpPrefetch( btVirtAddr va, btWSSize len );
+
    btBool isOK( void ) { return m_isOK; }     // < status after initialization
 
    // Return all statistics counters
@@ -118,10 +125,16 @@ protected:
 
    btBool                 m_isOK;
 
+   // While set, ptInvalVAMapping() records VAs in m_deferredInval
+   // instead of writing the invalidation CSR.
+   btBool                 m_deferInval;
+   std::vector<btVirtAddr> m_deferredInval;
+
 private:
    // Page allocator used by MPFVTP_PAGE_TABLE to add pages to the
    // shared page table data structure.
    btVirtAddr ptAllocSharedPage(btWSSize length, btPhysAddr* pa);
+   void ptFreeSharedPage(btVirtAddr va, btWSSize length);
    // Invalidate a VA mapping.
    bool ptInvalVAMapping(btVirtAddr va);
 
@@ -129,12 +142,29 @@ private:
    static const size_t SMALL_PAGE_MASK = ~(SMALL_PAGE_SIZE - 1);
    static const size_t LARGE_PAGE_SIZE = MB(2);
    static const size_t LARGE_PAGE_MASK = ~(LARGE_PAGE_SIZE - 1);
+   static const size_t HUGE_PAGE_SIZE = MB(1024);
+   static const size_t HUGE_PAGE_MASK = ~(HUGE_PAGE_SIZE - 1);
 
    static const size_t CCI_MPF_VTP_LARGE_PAGE_THRESHOLD = KB(128);
 
-   ali_errnum_e _allocate(btVirtAddr va, size_t pageSize, uint32_t flags = 0);
+   // bufferFree() flushes all FPGA-side translations instead of
+   // invalidating page by page when more pages than this are freed.
+   static const size_t CCI_MPF_VTP_INVAL_ALL_THRESHOLD = 256;
+
+   // vtpPrefetch() sends at most this many pages per call, the depth of
+   // the FPGA-side prefetch queue (CCI_MPF_SHIM_VTP_MAX_SVC_REQS).
+   static const size_t CCI_MPF_VTP_MAX_PREFETCH = 16;
+
+   // Allocate a physical page at va and append it to pages.  The page
+   // is not added to the page table.
+   ali_errnum_e _allocate(btVirtAddr va, size_t pageSize,
+                          std::vector<MPFVTP_PT_PAGE> &pages);
+   // Release pages recorded by _allocate() after a failed bufferAllocate()
+   void _freePages(const std::vector<MPFVTP_PT_PAGE> &pages);
    // reinitialize VTP registers after vtpReset
    btBool _vtpEnable( void );
+   // drop all FPGA-side translations and re-enable VTP
+   btBool _vtpInvalAll( void );
 
 };
 
@@ -45,6 +45,7 @@
 //****************************************************************************
 
 #include <assert.h>
+#include <sched.h>
 #if __cplusplus > 199711L
 #include <atomic>
 #endif
@@ -77,54 +78,141 @@ BEGIN_NAMESPACE(AAL)
 // Since pages are aligned on at least 4KB boundaries, at least the low
 // 12 bits of any value in the table are zero.  We use some of these bits
 // as flags.  Bit 0 set indicates the mapping is complete.  The current
-// implementation supports both 4KB and 2MB pages.  Bit 0 will be set
-// after searching 3 levels for 2MB pages and 4 levels for 4KB pages.
+// implementation supports 4KB, 2MB and 1GB pages.  Bit 0 will be set
+// after searching 2 levels for 1GB pages, 3 levels for 2MB pages and
+// 4 levels for 4KB pages.
 // Bit 1 indicates no mapping exists and the search has failed.
 //
 // | 47 ---- 39 | 38 ---- 30 | 29 ---- 21 | 20 ---- 12 | 11 ---------- 0 |
 //     9 bits       9 bits       9 bits       9 bits   ^ 4KB page offset ^
 //                                        ^        2MB page offset       ^
 //
+// The table holds only physical addresses, which software can't follow.
+// Each table page is wrapped in a host-only MPFVTP_PT_NODE that holds
+// the virtual addresses of its children, so a software walk is a direct
+// pointer chase.
+//
+// Tables left empty when translations are removed are unlinked from their
+// parents and kept on a free list for reuse.  The memory is released
+// only by ptTerminate().
+//
+// Translation is lock-free.  Table entries and child pointers are read
+// and written atomically, and unlinked tables aren't reused until every
+// reader that might have reached them has finished (see
+// ptWaitForReaders()).
+//
 //
 
 /// @addtogroup VTPService
 /// @{
 
+//
+// Memory fence, ordering updates to tables visible to the FPGA and
+// to the software translation cache.
+//
+static inline void
+ptMemFence()
+{
+#if __cplusplus > 199711L
+    // C++11 knows atomics
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+#elif __GNUC__
+    // GNU C++ before C++11 should be able to do the same using inline asm
+    asm volatile ("" : : : "memory");
+#else
+#   warning "Neither C++ 11 atomics nor GNU asm volatile - don't know how to do memory barriers."
+#endif
+}
+
 //-----------------------------------------------------------------------------
 // Public functions
 //-----------------------------------------------------------------------------
 
 MPFVTP_PAGE_TABLE::MPFVTP_PAGE_TABLE() :
-    m_pageTableFreeList(NULL)
+    ptRoot(NULL),
+    m_pPageTablePA(0),
+    m_pageTableFreeList(NULL),
+    m_pageTableRetiredList(NULL),
+    m_numTablePages(0),
+    m_numFreeTablePages(0),
+    m_hostBytes(0),
+    m_slabNextVA(NULL),
+    m_slabNextPA(0),
+    m_slabFreeBytes(0),
+    m_epoch(0),
+    m_xlateCacheGen(1)
 {
+    ptXlateCacheReset();
 }
 
 
 MPFVTP_PAGE_TABLE::~MPFVTP_PAGE_TABLE()
 {
-    // We should release the page table here.
+    // Shared pages can be released only through the subclass, which is
+    // already gone.  The subclass destructor must call ptTerminate().
+    assert(ptRoot == NULL);
 }
 
 
 bool
 MPFVTP_PAGE_TABLE::ptInitialize()
 {
-    // Allocate the roots of both the virtual to physical page table passed
-    // to the FPGA and the reverse physical to virtual table used in
-    // this module to walk the virtual to physical table.
+    // Allocate the root of the virtual to physical page table passed
+    // to the FPGA.
+    ptRoot = ptAllocTablePage();
+    if (ptRoot == NULL) return false;
 
-    // VtoP is shared with the hardware
-    ptVtoP = MPFVTP_PT_TREE(ptAllocSharedPage(sizeof(MPFVTP_PT_TREE_CLASS),
-                                              &m_pPageTablePA));
-    ptVtoP->Reset();
-
-    // PtoV is private to software
-    ptPtoV = new MPFVTP_PT_TREE_CLASS();
+    m_pPageTablePA = ptRoot->GetTablePA();
 
     return true;
 }
 
 
+void
+MPFVTP_PAGE_TABLE::ptTerminate()
+{
+    if (ptRoot != NULL)
+    {
+        ptReleaseTree(ptRoot);
+        ptRoot = NULL;
+        m_pPageTablePA = 0;
+    }
+
+    // Nothing may be walking the table now
+    while (m_pageTableRetiredList != NULL)
+    {
+        MPFVTP_PT_NODE node = m_pageTableRetiredList;
+        m_pageTableRetiredList = node->nextFree;
+        node->nextFree = m_pageTableFreeList;
+        m_pageTableFreeList = node;
+    }
+
+    while (m_pageTableFreeList != NULL)
+    {
+        MPFVTP_PT_NODE node = m_pageTableFreeList;
+        m_pageTableFreeList = node->nextFree;
+        delete node;
+    }
+
+    // Table pages are released with the slabs holding them
+    for (size_t i = 0; i < m_sharedRegions.size(); i++)
+    {
+        ptFreeSharedPage(m_sharedRegions[i].first, m_sharedRegions[i].second);
+    }
+    m_sharedRegions.clear();
+
+    m_slabNextVA = NULL;
+    m_slabNextPA = 0;
+    m_slabFreeBytes = 0;
+
+    m_numTablePages = 0;
+    m_numFreeTablePages = 0;
+    m_hostBytes = 0;
+
+    ptXlateCacheReset();
+}
+
+
 btPhysAddr
 MPFVTP_PAGE_TABLE::ptGetPageTableRootPA() const
 {
@@ -139,15 +227,77 @@ MPFVTP_PAGE_TABLE::ptInsertPageMapping(
     MPFVTP_PAGE_SIZE size,
     uint32_t flags)
 {
-    // Are the addresses reasonable?
-    uint64_t mask = (size == MPFVTP_PAGE_4KB) ? (1 << 12) - 1 :
-                                                (1 << 21) - 1;
+    return ptInsertRange(va, &pa, 1, size, flags);
+}
+
+
+bool
+MPFVTP_PAGE_TABLE::ptInsertRange(
+    btVirtAddr va,
+    const btPhysAddr *pa,
+    size_t nPages,
+    MPFVTP_PAGE_SIZE size,
+    uint32_t flags)
+{
+    uint32_t shift = ptPageShift(size);
+    uint64_t mask = (uint64_t(1) << shift) - 1;
+
+    // Is the address reasonable?
     assert((uint64_t(va) & mask) == 0);
-    assert((pa & mask) == 0);
 
-    uint32_t depth = (size == MPFVTP_PAGE_4KB) ? 4 : 3;
+    // Translations of this size are stored at this depth
+    uint32_t depth = uint32_t(size);
+
+    MPFVTP_PT_NODE node = NULL;
+    for (size_t i = 0; i < nPages; i++)
+    {
+        uint64_t page_va = uint64_t(va) + (uint64_t(i) << shift);
+        assert((pa[i] & mask) == 0);
+
+        uint32_t idx = ptIdxFromAddr(page_va, depth);
+
+        // Walk from the root only when crossing into a new table
+        if ((node == NULL) || (idx == 0))
+        {
+            node = ptWalkToTable(btVirtAddr(page_va), depth);
+        }
+
+        // Region start and end flags apply only to the ends of the run
+        uint32_t page_flags = flags & ~uint32_t(MPFVTP_PT_FLAG_ALLOC_START |
+                                                MPFVTP_PT_FLAG_ALLOC_END);
+        if (i == 0)
+        {
+            page_flags |= flags & MPFVTP_PT_FLAG_ALLOC_START;
+        }
+        if (i == nPages - 1)
+        {
+            page_flags |= flags & MPFVTP_PT_FLAG_ALLOC_END;
+        }
+
+        if ((node == NULL) ||
+            ! ptInsertTranslation(node, idx, pa[i], depth, page_flags))
+        {
+            // A table allocated for this page may be empty
+            if (node != NULL)
+            {
+                ptReclaimEmptyTables(node);
+            }
+
+            // Drop the part of the run already added.  None of these pages
+            // is flagged ALLOC_END, so the full length is removed.
+            if (i != 0)
+            {
+                ptRemoveRange(va, btWSSize(i) << shift);
+            }
+
+            return false;
+        }
+    }
+
+    // Memory fence for updates before claiming the table is ready
+    ptMemFence();
 
-    return AddVAtoPA(va, pa, depth, flags);
+    return true;
 }
 
 
@@ -159,74 +309,149 @@ MPFVTP_PAGE_TABLE::ptRemovePageMapping(
     MPFVTP_PAGE_SIZE *size,
     uint32_t *flags)
 {
-    MPFVTP_PT_TREE table = ptVtoP;
-    // Physical address of the page table at current depth
-    btPhysAddr pt_depth_pa = 0;
+    MPFVTP_PT_NODE node;
+    uint32_t depth;
 
-    uint32_t depth = 4;
-    while (depth--)
+    if (! ptFindTranslation(va, &node, &depth)) return false;
+
+    MPFVTP_PT_TREE table = node->GetTable();
+    uint64_t idx = ptIdxFromAddr(uint64_t(va), depth);
+
+    if (pa)
     {
-        // Index in the current level
-        uint64_t idx = ptIdxFromAddr(uint64_t(va), depth);
+        *pa = btPhysAddr(table->GetTranslatedAddr(idx));
+    }
 
-        if (! table->EntryExists(idx)) return false;
+    if (pt_pa)
+    {
+        // Address of the lowest PTE pointing to the entry just removed
+        *pt_pa = node->GetTablePA() + 8 * idx;
+    }
 
-        if (table->EntryIsTerminal(idx))
+    if (size)
+    {
+        *size = ptPageSizeFromDepth(depth);
+    }
+
+    if (flags)
+    {
+        *flags = table->GetTranslatedAddrFlags(idx);
+    }
+
+    node->RemoveTranslation(idx);
+    ptXlateCacheInval();
+
+    ptMemFence();
+
+    ptReclaimEmptyTables(node);
+
+    return true;
+}
+
+
+bool
+MPFVTP_PAGE_TABLE::ptRemoveRange(
+    btVirtAddr va,
+    btWSSize length,
+    std::vector<MPFVTP_PT_PAGE> *removed)
+{
+    uint64_t cur_va = uint64_t(va);
+    bool found = true;
+
+    MPFVTP_PT_NODE node = NULL;
+    uint32_t depth = 0;
+
+    while (length != 0)
+    {
+        // Consecutive pages of the same size are usually in the same
+        // table.  Walk from the root only when the previous table doesn't
+        // hold a translation for the next page.  Moving past the end of
+        // a table wraps the index to 0.
+        uint32_t idx = ptIdxFromAddr(cur_va, depth);
+        if ((node == NULL) || (idx == 0) ||
+            ! node->GetTable()->EntryIsTerminal(idx))
         {
-            if (pa)
+            if (! ptFindTranslation(btVirtAddr(cur_va), &node, &depth))
             {
-                *pa = btPhysAddr(table->GetTranslatedAddr(idx));
+                found = false;
+                break;
             }
 
-            if (pt_pa)
-            {
-                // Address of the lowest PTE pointing to the entry just removed
-                *pt_pa = pt_depth_pa + 8 * idx;
-            }
+            idx = ptIdxFromAddr(cur_va, depth);
+        }
 
-            if (size)
-            {
-                *size = (depth == 1 ? MPFVTP_PAGE_2MB : MPFVTP_PAGE_4KB);
-            }
+        MPFVTP_PAGE_SIZE size = ptPageSizeFromDepth(depth);
+        uint64_t page_bytes = uint64_t(1) << ptPageShift(size);
 
-            if (flags)
-            {
-                *flags = table->GetTranslatedAddrFlags(idx);
-            }
+        // The range must start on a page boundary
+        if (cur_va & (page_bytes - 1))
+        {
+            found = false;
+            break;
+        }
 
-            table->RemoveTranslatedAddr(idx);
+        MPFVTP_PT_TREE table = node->GetTable();
+        uint32_t flags = table->GetTranslatedAddrFlags(idx);
 
-#if __cplusplus > 199711L
-            // C++11 knows atomics
-            std::atomic_thread_fence(std::memory_order_seq_cst);
-#elif __GNUC__
-            // GNU C++ before C++11 should be able to do the same using inline asm
-            asm volatile ("" : : : "memory");
-#else
-#   warning "Neither C++ 11 atomics nor GNU asm volatile - don't know how to do memory barriers."
-#endif
+        if (removed)
+        {
+            MPFVTP_PT_PAGE page;
+            page.va = btVirtAddr(cur_va);
+            page.pa = btPhysAddr(table->GetTranslatedAddr(idx));
+            page.size = size;
+            page.flags = flags;
+            removed->push_back(page);
+        }
 
-            return true;
+        node->RemoveTranslation(idx);
+
+        if (node->IsEmpty())
+        {
+            ptMemFence();
+            ptReclaimEmptyTables(node);
+            node = NULL;
         }
 
-        // Walk down to child
-        btPhysAddr child_pa = table->GetChildAddr(idx);
-        btVirtAddr child_va;
-        if (! ptTranslatePAtoVA(child_pa, &child_va)) return false;
-        table = MPFVTP_PT_TREE(child_va);
-        pt_depth_pa = child_pa;
+        if ((flags & MPFVTP_PT_FLAG_ALLOC_END) || (length <= page_bytes))
+        {
+            break;
+        }
+
+        length -= page_bytes;
+        cur_va += page_bytes;
     }
 
-    return false;
+    ptXlateCacheInval();
+    ptMemFence();
+
+    return found;
 }
 
 
 bool
 MPFVTP_PAGE_TABLE::ptTranslateVAtoPA(btVirtAddr va,
                                      btPhysAddr *pa,
-                                     uint32_t *flags)
+                                     uint32_t *flags,
+                                     MPFVTP_PAGE_SIZE *size)
 {
-    MPFVTP_PT_TREE table = ptVtoP;
+    PT_READER_SHARD *shard = ptReaderShard();
+
+    if (ptXlateCacheLookup(va, pa, flags, size))
+    {
+        shard->xlateCacheHits.FetchAdd(1, MPFVTP_PT_RELAXED);
+        return true;
+    }
+
+    shard->xlateCacheMisses.FetchAdd(1, MPFVTP_PT_RELAXED);
+
+    // Read the cache generation before walking.  If translations are
+    // removed during the walk the entry added below will be stale.
+    uint64_t gen = m_xlateCacheGen.Load(MPFVTP_PT_ACQUIRE);
+
+    MPFVTP_PT_ATOMIC<uint64_t> *active = ptReaderEnter(shard);
+    bool found = false;
+
+    MPFVTP_PT_NODE node = ptRoot;
 
     uint32_t depth = 4;
     while (depth--)
@@ -234,28 +459,78 @@ MPFVTP_PAGE_TABLE::ptTranslateVAtoPA(btVirtAddr va,
         // Index in the current level
         uint64_t idx = ptIdxFromAddr(uint64_t(va), depth);
 
-        if (! table->EntryExists(idx)) return false;
+        // The entry may be changing.  Decode a single read of it.
+        int64_t entry = node->GetTable()->GetEntry(idx);
+        if (entry == -1) break;
 
-        if (table->EntryIsTerminal(idx))
+        if (entry & MPFVTP_PT_FLAG_TERMINAL)
         {
-            *pa = btPhysAddr(table->GetTranslatedAddr(idx));
+            *pa = btPhysAddr(entry & ~ int64_t(MPFVTP_PT_FLAG_MASK));
+            uint32_t pt_flags = uint32_t(entry) & uint32_t(MPFVTP_PT_FLAG_MASK);
 
             if (flags)
             {
-                *flags = table->GetTranslatedAddrFlags(idx);
+                *flags = pt_flags;
+            }
+            if (size)
+            {
+                *size = ptPageSizeFromDepth(depth);
             }
 
-            return true;
+            ptXlateCacheInsert(va, *pa, ptPageSizeFromDepth(depth), pt_flags,
+                               gen);
+
+            found = true;
+            break;
         }
 
         // Walk down to child
-        btPhysAddr child_pa = table->GetChildAddr(idx);
-        btVirtAddr child_va;
-        if (! ptTranslatePAtoVA(child_pa, &child_va)) return false;
-        table = MPFVTP_PT_TREE(child_va);
+        node = node->GetChild(idx);
+        if (node == NULL) break;
     }
 
-    return false;
+    ptReaderExit(active);
+
+    return found;
+}
+
+
+btWSSize
+MPFVTP_PAGE_TABLE::ptUnmappedSize(btVirtAddr va)
+{
+    MPFVTP_PT_ATOMIC<uint64_t> *active = ptReaderEnter(ptReaderShard());
+    btWSSize hole = 0;
+
+    MPFVTP_PT_NODE node = ptRoot;
+
+    uint32_t depth = 4;
+    while (depth--)
+    {
+        uint64_t idx = ptIdxFromAddr(uint64_t(va), depth);
+
+        int64_t entry = node->GetTable()->GetEntry(idx);
+        if (entry == -1)
+        {
+            // Nothing below this entry is mapped
+            hole = btWSSize(1) << (12 + 9 * depth);
+            break;
+        }
+
+        if (entry & MPFVTP_PT_FLAG_TERMINAL) break;
+
+        node = node->GetChild(idx);
+        if (node == NULL)
+        {
+            // The child is being linked in or dropped by a writer.  Only
+            // the 4KB page at va is known to be unmapped.
+            hole = btWSSize(1) << 12;
+            break;
+        }
+    }
+
+    ptReaderExit(active);
+
+    return hole;
 }
 
 
@@ -263,9 +538,48 @@ void
 MPFVTP_PAGE_TABLE::ptDumpPageTable()
 {
     printf("  Page table root VA 0x%016lx -> PA 0x%016lx:\n",
-           ptVtoP,
+           uint64_t(ptRoot->GetTable()),
            ptGetPageTableRootPA());
-    DumpPageTableVAtoPA(ptVtoP, 0, 4);
+    DumpPageTableVAtoPA(ptRoot, 0, 4);
+}
+
+
+void
+MPFVTP_PAGE_TABLE::ptGetTranslationCacheStats(
+    uint64_t *hits,
+    uint64_t *misses) const
+{
+    *hits = 0;
+    *misses = 0;
+
+    for (int i = 0; i < PT_READER_SHARDS; i++)
+    {
+        *hits += m_readerShards[i].xlateCacheHits.Load(MPFVTP_PT_RELAXED);
+        *misses += m_readerShards[i].xlateCacheMisses.Load(MPFVTP_PT_RELAXED);
+    }
+}
+
+
+void
+MPFVTP_PAGE_TABLE::ptResetTranslationCacheStats()
+{
+    for (int i = 0; i < PT_READER_SHARDS; i++)
+    {
+        m_readerShards[i].xlateCacheHits.Store(0, MPFVTP_PT_RELAXED);
+        m_readerShards[i].xlateCacheMisses.Store(0, MPFVTP_PT_RELAXED);
+    }
+}
+
+
+void
+MPFVTP_PAGE_TABLE::ptGetFootprint(
+    uint64_t *tablePages,
+    uint64_t *freeTablePages,
+    uint64_t *hostBytes) const
+{
+    *tablePages = m_numTablePages;
+    *freeTablePages = m_numFreeTablePages;
+    *hostBytes = m_hostBytes;
 }
 
 
@@ -273,133 +587,384 @@ MPFVTP_PAGE_TABLE::ptDumpPageTable()
 // Private functions
 //-----------------------------------------------------------------------------
 
+MPFVTP_PAGE_TABLE::PT_READER_SHARD*
+MPFVTP_PAGE_TABLE::ptReaderShard()
+{
+    // Threads are assigned shards round-robin on first use
+    static MPFVTP_PT_ATOMIC<uint32_t> next_shard(0);
+    static __thread uint32_t thread_shard = ~uint32_t(0);
+
+    if (thread_shard == ~uint32_t(0))
+    {
+        thread_shard = next_shard.FetchAdd(1, MPFVTP_PT_RELAXED) %
+                       PT_READER_SHARDS;
+    }
+
+    return &m_readerShards[thread_shard];
+}
+
+
+MPFVTP_PT_ATOMIC<uint64_t>*
+MPFVTP_PAGE_TABLE::ptReaderEnter(PT_READER_SHARD *shard)
+{
+    while (true)
+    {
+        uint64_t epoch = m_epoch.Load(MPFVTP_PT_SEQ_CST);
+        MPFVTP_PT_ATOMIC<uint64_t> *active = &shard->active[epoch & 1];
+        active->FetchAdd(1, MPFVTP_PT_SEQ_CST);
+
+        // A reader is counted only in the epoch that was current after
+        // it registered.  Retry if the epoch moved in between, since the
+        // writer may already have stopped waiting for that counter.
+        if (m_epoch.Load(MPFVTP_PT_SEQ_CST) == epoch)
+        {
+            return active;
+        }
+
+        active->FetchSub(1, MPFVTP_PT_RELEASE);
+    }
+}
+
+
+void
+MPFVTP_PAGE_TABLE::ptReaderExit(MPFVTP_PT_ATOMIC<uint64_t> *active)
+{
+    active->FetchSub(1, MPFVTP_PT_RELEASE);
+}
+
+
+void
+MPFVTP_PAGE_TABLE::ptWaitForReaders()
+{
+    // Readers registered after the epoch advances can't reach pages that
+    // were unlinked before it.  Wait for the others to finish.
+    uint64_t old_epoch = m_epoch.Load(MPFVTP_PT_RELAXED);
+    m_epoch.Store(old_epoch + 1, MPFVTP_PT_SEQ_CST);
+
+    for (int i = 0; i < PT_READER_SHARDS; i++)
+    {
+        while (m_readerShards[i].active[old_epoch & 1].Load(MPFVTP_PT_SEQ_CST) != 0)
+        {
+            sched_yield();
+        }
+    }
+}
+
+
 bool
-MPFVTP_PAGE_TABLE::ptTranslatePAtoVA(btPhysAddr pa, btVirtAddr *va)
+MPFVTP_PAGE_TABLE::ptXlateCacheLookup(
+    btVirtAddr va,
+    btPhysAddr *pa,
+    uint32_t *flags,
+    MPFVTP_PAGE_SIZE *pageSize)
 {
-    MPFVTP_PT_TREE table = ptPtoV;
+    uint64_t gen = m_xlateCacheGen.Load(MPFVTP_PT_ACQUIRE);
 
-    uint32_t depth = 4;
-    while (depth--)
+    // A VA is in exactly one page, so the order of the probes doesn't
+    // matter.  Large pages are checked first.
+    for (int s = MPFVTP_PAGE_N_SIZES - 1; s >= 0; s--)
     {
-        // Index in the current level
-        uint64_t idx = ptIdxFromAddr(uint64_t(pa), depth);
+        MPFVTP_PAGE_SIZE size = MPFVTP_PAGE_SIZE(s);
+        uint64_t vpn = uint64_t(va) >> ptPageShift(size);
+        PT_XLATE_CACHE_ENTRY* e = ptXlateCacheEntry(uint64_t(va), size);
 
-        if (! table->EntryExists(idx)) return false;
+        uint64_t seq = e->seq.Load(MPFVTP_PT_ACQUIRE);
+        if (seq & 1) continue;
 
-        if (table->EntryIsTerminal(idx))
+        if ((e->vpn.Load(MPFVTP_PT_RELAXED) == vpn) &&
+            (e->gen.Load(MPFVTP_PT_RELAXED) == gen))
         {
-            *va = btVirtAddr(table->GetTranslatedAddr(idx));
+            btPhysAddr e_pa = e->pa.Load(MPFVTP_PT_RELAXED);
+            uint32_t e_flags = e->flags.Load(MPFVTP_PT_RELAXED);
+
+            // Confirm the entry didn't change while it was read
+            ptAtomicFence(MPFVTP_PT_ACQUIRE);
+            if (e->seq.Load(MPFVTP_PT_RELAXED) != seq) return false;
+
+            *pa = e_pa;
+            if (flags)
+            {
+                *flags = e_flags;
+            }
+            if (pageSize)
+            {
+                *pageSize = size;
+            }
+
             return true;
         }
-
-        // Walk down to child
-        table = MPFVTP_PT_TREE(table->GetChildAddr(idx));
     }
 
     return false;
 }
 
 
-btVirtAddr
-MPFVTP_PAGE_TABLE::ptAllocTablePage(btPhysAddr* pa)
+void
+MPFVTP_PAGE_TABLE::ptXlateCacheInsert(
+    btVirtAddr va,
+    btPhysAddr pa,
+    MPFVTP_PAGE_SIZE size,
+    uint32_t flags,
+    uint64_t gen)
 {
-    btVirtAddr va;
+    PT_XLATE_CACHE_ENTRY* e = ptXlateCacheEntry(uint64_t(va), size);
+
+    // Claim the entry by making the sequence number odd.  The cache is
+    // only a filter, so give up if another thread is filling it.
+    uint64_t seq = e->seq.Load(MPFVTP_PT_RELAXED);
+    if ((seq & 1) ||
+        ! e->seq.CompareExchange(seq, seq + 1,
+                                 MPFVTP_PT_ACQUIRE, MPFVTP_PT_RELAXED))
+    {
+        return;
+    }
+    ptAtomicFence(MPFVTP_PT_RELEASE);
+
+    e->vpn.Store(uint64_t(va) >> ptPageShift(size), MPFVTP_PT_RELAXED);
+    e->gen.Store(gen, MPFVTP_PT_RELAXED);
+    e->pa.Store(pa, MPFVTP_PT_RELAXED);
+    e->flags.Store(flags, MPFVTP_PT_RELAXED);
+
+    e->seq.Store(seq + 2, MPFVTP_PT_RELEASE);
+}
+
+
+void
+MPFVTP_PAGE_TABLE::ptXlateCacheInval()
+{
+    // Entries from older generations no longer match
+    m_xlateCacheGen.Store(m_xlateCacheGen.Load(MPFVTP_PT_RELAXED) + 1,
+                          MPFVTP_PT_RELEASE);
+}
+
+
+void
+MPFVTP_PAGE_TABLE::ptXlateCacheReset()
+{
+    for (int s = 0; s < MPFVTP_PAGE_N_SIZES; s++)
+    {
+        for (int i = 0; i < PT_XLATE_CACHE_ENTRIES; i++)
+        {
+            PT_XLATE_CACHE_ENTRY* e = &m_xlateCache[s][i];
+            e->seq.Store(0, MPFVTP_PT_RELAXED);
+            e->vpn.Store(0, MPFVTP_PT_RELAXED);
+            e->gen.Store(0, MPFVTP_PT_RELAXED);
+            e->pa.Store(0, MPFVTP_PT_RELAXED);
+            e->flags.Store(0, MPFVTP_PT_RELAXED);
+        }
+    }
+}
+
+
+MPFVTP_PT_NODE
+MPFVTP_PAGE_TABLE::ptAllocTablePage()
+{
+    MPFVTP_PT_NODE node;
+
+    // Retired pages become free once no reader can be walking them
+    if ((m_pageTableFreeList == NULL) && (m_pageTableRetiredList != NULL))
+    {
+        ptWaitForReaders();
+
+        m_pageTableFreeList = m_pageTableRetiredList;
+        m_pageTableRetiredList = NULL;
+    }
 
     // Is a page available from the free list?
     if (m_pageTableFreeList != NULL)
     {
         // Pop page from free list
-        va = m_pageTableFreeList;
-        MPFVTP_PT_TREE t = MPFVTP_PT_TREE(va);
-        m_pageTableFreeList = btVirtAddr(t->GetChildAddr(0));
+        node = m_pageTableFreeList;
+        m_pageTableFreeList = node->nextFree;
+        node->nextFree = NULL;
+        m_numFreeTablePages -= 1;
 
-        // Corresponding PA is stored in slot 1
-        *pa = btPhysAddr(t->GetChildAddr(1));
+        if (node->HasChildren())
+        {
+            m_hostBytes -= 512 * sizeof(MPFVTP_PT_NODE);
+        }
     }
     else
     {
         // Need a new page
-        va = ptAllocSharedPage(sizeof(MPFVTP_PT_TREE_CLASS), pa);
-        assert(va != NULL);
+        btPhysAddr pa;
+        btVirtAddr va = ptAllocTableMem(&pa);
+        if (va == NULL) return NULL;
+
+        node = new MPFVTP_PT_NODE_CLASS(MPFVTP_PT_TREE(va), pa);
+        m_hostBytes += sizeof(MPFVTP_PT_NODE_CLASS);
+    }
+
+    node->Reset();
+    return node;
+}
+
+
+btVirtAddr
+MPFVTP_PAGE_TABLE::ptAllocTableMem(btPhysAddr *pa)
+{
+    const size_t page_bytes = sizeof(MPFVTP_PT_TREE_CLASS);
+
+    if (m_slabFreeBytes < page_bytes)
+    {
+        btPhysAddr slab_pa;
+        btVirtAddr slab_va = ptAllocSharedPage(PT_SLAB_SIZE, &slab_pa);
 
-        // Add new page to physical to virtual translation so the table
-        // can be walked in software
-        assert(AddPAtoVA(*pa, va, 4));
+        if (slab_va == NULL)
+        {
+            // No slab available.  Fall back to a single page.
+            btVirtAddr va = ptAllocSharedPage(page_bytes, pa);
+            if (va == NULL) return NULL;
+
+            m_sharedRegions.push_back(std::make_pair(va, btWSSize(page_bytes)));
+            m_numTablePages += 1;
+            return va;
+        }
+
+        m_sharedRegions.push_back(std::make_pair(slab_va,
+                                                 btWSSize(PT_SLAB_SIZE)));
+        m_slabNextVA = slab_va;
+        m_slabNextPA = slab_pa;
+        m_slabFreeBytes = PT_SLAB_SIZE;
+
+        // Uncarved pages in the slab are counted as free table pages
+        m_numTablePages += PT_SLAB_SIZE / page_bytes;
+        m_numFreeTablePages += PT_SLAB_SIZE / page_bytes;
     }
 
+    btVirtAddr va = m_slabNextVA;
+    *pa = m_slabNextPA;
+
+    m_slabNextVA += page_bytes;
+    m_slabNextPA += page_bytes;
+    m_slabFreeBytes -= page_bytes;
+    m_numFreeTablePages -= 1;
+
     return va;
 }
 
 
 void
-MPFVTP_PAGE_TABLE::ptFreeTablePage(btVirtAddr va, btPhysAddr pa)
+MPFVTP_PAGE_TABLE::ptFreeTablePage(MPFVTP_PT_NODE node)
 {
-    // Push page on the free list
-    MPFVTP_PT_TREE t = MPFVTP_PT_TREE(va);
-    t->InsertChildAddr(0, int64_t(m_pageTableFreeList));
-    t->InsertChildAddr(1, int64_t(pa));
-    m_pageTableFreeList = va;
+    // Push page on the retired list.  Concurrent readers may still be
+    // walking it, so it is reset only when reused.
+    node->nextFree = m_pageTableRetiredList;
+    m_pageTableRetiredList = node;
+    m_numFreeTablePages += 1;
+
+    // Pointers to the page must be gone before the hardware drops it
+    ptMemFence();
 
     // Invalidate the address in any hardware tables (page table walker cache)
-    assert(ptInvalVAMapping(va));
+    bool ok = ptInvalVAMapping(btVirtAddr(node->GetTable()));
+    assert(ok);
+    (void)ok;
 }
 
 
-bool
-MPFVTP_PAGE_TABLE::AddVAtoPA(btVirtAddr va, btPhysAddr pa, uint32_t depth, uint32_t flags)
+void
+MPFVTP_PAGE_TABLE::ptReclaimEmptyTables(MPFVTP_PT_NODE node)
 {
-    MPFVTP_PT_TREE table = ptVtoP;
+    while ((node != ptRoot) && node->IsEmpty())
+    {
+        MPFVTP_PT_NODE parent = node->GetParent();
+        if (parent == NULL) break;
 
-    // Index in the leaf page
-    uint64_t leaf_idx = ptIdxFromAddr(uint64_t(va), 4 - depth);
+        parent->RemoveChild(node->GetParentIdx());
+        ptFreeTablePage(node);
 
-    uint32_t cur_depth = 4;
-    while (--depth)
+        node = parent;
+    }
+}
+
+
+void
+MPFVTP_PAGE_TABLE::ptReleaseTree(MPFVTP_PT_NODE node)
+{
+    for (uint32_t idx = 0; idx < 512; idx++)
+    {
+        MPFVTP_PT_NODE child_node = node->GetChild(idx);
+        if (child_node != NULL)
+        {
+            ptReleaseTree(child_node);
+        }
+    }
+
+    delete node;
+}
+
+
+MPFVTP_PT_NODE
+MPFVTP_PAGE_TABLE::ptWalkToTable(btVirtAddr va, uint32_t depth)
+{
+    MPFVTP_PT_NODE node = ptRoot;
+
+    uint32_t cur_depth = 3;
+    while (cur_depth > depth)
     {
-        // Drop 4KB page offset
-        uint64_t idx = ptIdxFromAddr(uint64_t(va), --cur_depth);
+        MPFVTP_PT_TREE table = node->GetTable();
+
+        // Index in the current level
+        uint64_t idx = ptIdxFromAddr(uint64_t(va), cur_depth--);
 
         // Need a new page in the table?
         if (! table->EntryExists(idx))
         {
-            btPhysAddr pt_p;
-            btVirtAddr pt_v = ptAllocTablePage(&pt_p);
-            MPFVTP_PT_TREE child_table = MPFVTP_PT_TREE(pt_v);
-            child_table->Reset();
+            MPFVTP_PT_NODE child_node = ptAllocTablePage();
+            if (child_node == NULL)
+            {
+                // Drop tables already allocated on the way down
+                ptReclaimEmptyTables(node);
+                return NULL;
+            }
 
             // Add new page to the FPGA-visible virtual to physical table
-            table->InsertChildAddr(idx, pt_p);
+            if (! node->HasChildren())
+            {
+                m_hostBytes += 512 * sizeof(MPFVTP_PT_NODE);
+            }
+            node->InsertChild(idx, child_node);
         }
 
         // Are we being asked to add an entry below a larger region that
         // is already mapped?
-        if (table->EntryIsTerminal(idx)) return false;
+        if (table->EntryIsTerminal(idx)) return NULL;
 
         // Continue down the tree
-        btPhysAddr child_pa = table->GetChildAddr(idx);
-        btVirtAddr child_va;
-        if (! ptTranslatePAtoVA(child_pa, &child_va)) return false;
-        table = MPFVTP_PT_TREE(child_va);
+        node = node->GetChild(idx);
+        if (node == NULL) return NULL;
     }
 
-    // Now at the leaf.  Add the translation.
-    if (table->EntryExists(leaf_idx))
+    return node;
+}
+
+
+bool
+MPFVTP_PAGE_TABLE::ptInsertTranslation(
+    MPFVTP_PT_NODE node,
+    uint32_t idx,
+    btPhysAddr pa,
+    uint32_t depth,
+    uint32_t flags)
+{
+    MPFVTP_PT_TREE table = node->GetTable();
+    if (table->EntryExists(idx))
     {
-        if ((cur_depth == 2) && ! table->EntryIsTerminal(leaf_idx))
+        if ((depth >= 1) && ! table->EntryIsTerminal(idx))
         {
-            // Entry exists while trying to add a 2MB entry.  Perhaps there is
-            // an old leaf that used to hold 4KB pages.  If the existing
-            // entry has no active pages then get rid of it.
-            btPhysAddr child_pa = table->GetChildAddr(leaf_idx);
-            btVirtAddr child_va;
-            if (! ptTranslatePAtoVA(child_pa, &child_va)) return false;
-            MPFVTP_PT_TREE child_table = MPFVTP_PT_TREE(child_va);
-
-            if (! child_table->TableIsEmpty()) return false;
-
-            // The old page that held 4KB translations is now empty and the
-            // pointer will be overwritten with a 2MB page pointer.
-            ptFreeTablePage(child_va, child_pa);
+            // Entry exists while trying to add a 2MB or 1GB entry.  Perhaps
+            // there is an old table that used to hold smaller pages.  If
+            // the existing entry has no active pages then get rid of it.
+            MPFVTP_PT_NODE child_node = node->GetChild(idx);
+            if (child_node == NULL) return false;
+
+            if (! child_node->IsEmpty()) return false;
+
+            // The old page that held smaller translations is now empty and
+            // the pointer will be overwritten with a large page pointer.
+            node->RemoveChild(idx);
+            ptFreeTablePage(child_node);
         }
         else
         {
@@ -407,67 +972,54 @@ MPFVTP_PAGE_TABLE::AddVAtoPA(btVirtAddr va, btPhysAddr pa, uint32_t depth, uint3
         }
     }
 
-    table->InsertTranslatedAddr(leaf_idx, pa, flags);
-
-    // Memory fence for updates before claiming the table is ready
-#if __cplusplus > 199711L
-    // C++11 knows atomics
-    std::atomic_thread_fence(std::memory_order_seq_cst);
-#elif __GNUC__
-    // GNU C++ before C++11 should be able to do the same using inline asm
-    asm volatile ("" : : : "memory");
-#else
-#   warning "Neither C++ 11 atomics nor GNU asm volatile - don't know how to do memory barriers."
-#endif
+    node->InsertTranslation(idx, pa, flags);
 
     return true;
 }
 
 
 bool
-MPFVTP_PAGE_TABLE::AddPAtoVA(btPhysAddr pa, btVirtAddr va, uint32_t depth)
+MPFVTP_PAGE_TABLE::ptFindTranslation(
+    btVirtAddr va,
+    MPFVTP_PT_NODE *node,
+    uint32_t *depth)
 {
-    MPFVTP_PT_TREE table = ptPtoV;
-
-    // Index in the leaf page
-    uint64_t leaf_idx = ptIdxFromAddr(uint64_t(pa), 4 - depth);
+    MPFVTP_PT_NODE cur_node = ptRoot;
 
     uint32_t cur_depth = 4;
-    while (--depth)
+    while (cur_depth--)
     {
-        // Drop 4KB page offset
-        uint64_t idx = ptIdxFromAddr(uint64_t(pa), --cur_depth);
+        MPFVTP_PT_TREE table = cur_node->GetTable();
 
-        // Need a new page in the table?
-        if (! table->EntryExists(idx))
-        {
-            // Add new page to the FPGA-visible virtual to physical table
-            MPFVTP_PT_TREE child_table = new MPFVTP_PT_TREE_CLASS();
-            if (child_table == NULL) return false;
+        // Index in the current level
+        uint64_t idx = ptIdxFromAddr(uint64_t(va), cur_depth);
 
-            table->InsertChildAddr(idx, int64_t(child_table));
-        }
+        if (! table->EntryExists(idx)) return false;
 
-        // Are we being asked to add an entry below a larger region that
-        // is already mapped?
-        if (table->EntryIsTerminal(idx)) return false;
+        if (table->EntryIsTerminal(idx))
+        {
+            *node = cur_node;
+            *depth = cur_depth;
+            return true;
+        }
 
-        // Continue down the tree
-        table = MPFVTP_PT_TREE(table->GetChildAddr(idx));
+        // Walk down to child
+        cur_node = cur_node->GetChild(idx);
+        if (cur_node == NULL) return false;
     }
 
-    // Now at the leaf.  Add the translation.
-    table->InsertTranslatedAddr(leaf_idx, int64_t(va));
-    return true;
+    return false;
 }
 
 
 void
 MPFVTP_PAGE_TABLE::DumpPageTableVAtoPA(
-    MPFVTP_PT_TREE table,
+    MPFVTP_PT_NODE node,
     uint64_t partial_va,
     uint32_t depth)
 {
+    MPFVTP_PT_TREE table = node->GetTable();
+
     for (uint64_t idx = 0; idx < 512; idx++)
     {
         if (table->EntryExists(idx))
@@ -485,6 +1037,9 @@ MPFVTP_PAGE_TABLE::DumpPageTableVAtoPA(
                   case 2:
                     kind = "2MB";
                     break;
+                  case 3:
+                    kind = "1GB";
+                    break;
                   default:
                     kind = "?";
                     break;
@@ -516,10 +1071,10 @@ MPFVTP_PAGE_TABLE::DumpPageTableVAtoPA(
                 // Follow pointer to another level
                 assert(depth != 1);
 
-                btPhysAddr child_pa = table->GetChildAddr(idx);
-                btVirtAddr child_va;
-                assert(ptTranslatePAtoVA(child_pa, &child_va));
-                DumpPageTableVAtoPA(MPFVTP_PT_TREE(child_va), va, depth - 1);
+                MPFVTP_PT_NODE child_node = node->GetChild(idx);
+                assert(child_node != NULL);
+                assert(child_node->GetTablePA() == btPhysAddr(table->GetChildAddr(idx)));
+                DumpPageTableVAtoPA(child_node, va, depth - 1);
             }
         }
     }
@@ -47,6 +47,11 @@
 #ifndef __CCI_MPF_SHIM_VTP_PT_H__
 #define __CCI_MPF_SHIM_VTP_PT_H__
 
+#include <vector>
+#if __cplusplus > 199711L
+#include <atomic>
+#endif
+
 #include <aalsdk/AALTypes.h>
 #include <aalsdk/utils/Utilities.h>
 
@@ -56,12 +61,120 @@ BEGIN_NAMESPACE(AAL)
 /// @{
 
 //
-// The page table supports two physical page sizes.
+// Memory orders for MPFVTP_PT_ATOMIC and ptAtomicFence().
+//
+#if __cplusplus > 199711L
+typedef std::memory_order MPFVTP_PT_MEM_ORDER;
+static const MPFVTP_PT_MEM_ORDER MPFVTP_PT_RELAXED = std::memory_order_relaxed;
+static const MPFVTP_PT_MEM_ORDER MPFVTP_PT_ACQUIRE = std::memory_order_acquire;
+static const MPFVTP_PT_MEM_ORDER MPFVTP_PT_RELEASE = std::memory_order_release;
+static const MPFVTP_PT_MEM_ORDER MPFVTP_PT_SEQ_CST = std::memory_order_seq_cst;
+#elif __GNUC__
+typedef int MPFVTP_PT_MEM_ORDER;
+static const MPFVTP_PT_MEM_ORDER MPFVTP_PT_RELAXED = __ATOMIC_RELAXED;
+static const MPFVTP_PT_MEM_ORDER MPFVTP_PT_ACQUIRE = __ATOMIC_ACQUIRE;
+static const MPFVTP_PT_MEM_ORDER MPFVTP_PT_RELEASE = __ATOMIC_RELEASE;
+static const MPFVTP_PT_MEM_ORDER MPFVTP_PT_SEQ_CST = __ATOMIC_SEQ_CST;
+#else
+#   error "Neither C++ 11 atomics nor GNU atomic builtins - don't know how to share the page table."
+#endif
+
+//
+// A value shared by lock-free translation and page table updates.  C++11
+// atomics are used when available.  GNU C++ before C++11 falls back to
+// the compiler's atomic builtins.  Only the value is stored, so an array
+// of MPFVTP_PT_ATOMIC<T> has the layout of an array of T.
+//
+template <typename T>
+class MPFVTP_PT_ATOMIC
+{
+  public:
+    MPFVTP_PT_ATOMIC(T v = T()) : value(v) {}
+
+    T Load(MPFVTP_PT_MEM_ORDER order) const
+    {
+#if __cplusplus > 199711L
+        return value.load(order);
+#else
+        return __atomic_load_n(&value, order);
+#endif
+    }
+
+    void Store(T v, MPFVTP_PT_MEM_ORDER order)
+    {
+#if __cplusplus > 199711L
+        value.store(v, order);
+#else
+        __atomic_store_n(&value, v, order);
+#endif
+    }
+
+    T FetchAdd(T v, MPFVTP_PT_MEM_ORDER order)
+    {
+#if __cplusplus > 199711L
+        return value.fetch_add(v, order);
+#else
+        return __atomic_fetch_add(&value, v, order);
+#endif
+    }
+
+    T FetchSub(T v, MPFVTP_PT_MEM_ORDER order)
+    {
+#if __cplusplus > 199711L
+        return value.fetch_sub(v, order);
+#else
+        return __atomic_fetch_sub(&value, v, order);
+#endif
+    }
+
+    // Replace the value with desired if it is expected.  On failure,
+    // expected is updated with the current value.
+    bool CompareExchange(T &expected, T desired,
+                         MPFVTP_PT_MEM_ORDER success,
+                         MPFVTP_PT_MEM_ORDER failure)
+    {
+#if __cplusplus > 199711L
+        return value.compare_exchange_strong(expected, desired,
+                                             success, failure);
+#else
+        return __atomic_compare_exchange_n(&value, &expected, desired, false,
+                                           success, failure);
+#endif
+    }
+
+  private:
+    // Not copyable
+    MPFVTP_PT_ATOMIC(const MPFVTP_PT_ATOMIC&);
+    MPFVTP_PT_ATOMIC& operator=(const MPFVTP_PT_ATOMIC&);
+
+#if __cplusplus > 199711L
+    std::atomic<T> value;
+#else
+    T value;
+#endif
+};
+
+static inline void
+ptAtomicFence(MPFVTP_PT_MEM_ORDER order)
+{
+#if __cplusplus > 199711L
+    std::atomic_thread_fence(order);
+#else
+    __atomic_thread_fence(order);
+#endif
+}
+
+//
+// The page table supports three physical page sizes.
 //
 typedef enum
 {
     MPFVTP_PAGE_4KB,
-    MPFVTP_PAGE_2MB
+    MPFVTP_PAGE_2MB,
+    MPFVTP_PAGE_1GB,
+
+    // Number of page sizes (must be last)
+    MPFVTP_PAGE_N_SIZES
 }
 MPFVTP_PAGE_SIZE;
 
@@ -86,6 +199,19 @@ typedef enum
 MPFVTP_PT_FLAG;
 
 typedef class MPFVTP_PT_TREE_CLASS* MPFVTP_PT_TREE;
+typedef class MPFVTP_PT_NODE_CLASS* MPFVTP_PT_NODE;
+
+//
+// State of a page dropped by ptRemoveRange().
+//
+typedef struct
+{
+    btVirtAddr va;
+    btPhysAddr pa;
+    MPFVTP_PAGE_SIZE size;
+    uint32_t flags;
+}
+MPFVTP_PT_PAGE;
 
 
 //
@@ -96,6 +222,13 @@ typedef class MPFVTP_PT_TREE_CLASS* MPFVTP_PT_TREE;
 //  handful of AAL types and include files.  Otherwise, types are
 //  standard C types.
 //
+//  Concurrency: ptTranslateVAtoPA() is lock-free and may be called from
+//  any number of threads, including while the table is updated.  All
+//  other methods modify the table and must be serialized by the caller.
+//
+//  Performance: test/test-vtp-pt/SW holds host-only benchmarks of this
+//  class.  Its README records reference results.
+//
 class MPFVTP_PAGE_TABLE
 {
   public:
@@ -106,6 +239,12 @@ class MPFVTP_PAGE_TABLE
     // Initialize page table
     bool ptInitialize();
 
+    // Release all page table memory, both shared with the FPGA and
+    // host-only.  Shared pages are returned through ptFreeSharedPage(),
+    // so this must be called from the subclass destructor.  The FPGA
+    // must no longer be walking the table.
+    void ptTerminate();
+
     // Return the physical address of the root of the page table.  This
     // address must be passed to the FPGA-side page table walker.
     btPhysAddr ptGetPageTableRootPA() const;
@@ -117,6 +256,19 @@ class MPFVTP_PAGE_TABLE
                              // ORed MPFVTP_PT_FLAG values
                              uint32_t flags = 0);
 
+    // Add a run of nPages pages of the same size, starting at va.  pa[i]
+    // is the physical address of page i.  The table is walked once for
+    // each leaf table instead of once for each page.  ALLOC_START in flags
+    // is applied only to the first page and ALLOC_END only to the last.
+    // Other flags are applied to all pages.  On failure no page in the
+    // run is left mapped.
+    bool ptInsertRange(btVirtAddr va,
+                       const btPhysAddr *pa,
+                       size_t nPages,
+                       MPFVTP_PAGE_SIZE size,
+                       // ORed MPFVTP_PT_FLAG values
+                       uint32_t flags = 0);
+
     // Remove a page from the table, returning some state from the page
     // as it is dropped.  State pointers are not written if they are NULL.
     bool ptRemovePageMapping(btVirtAddr va,
@@ -128,52 +280,210 @@ class MPFVTP_PAGE_TABLE
                              MPFVTP_PAGE_SIZE *size = NULL,
                              uint32_t *flags = NULL);
 
-    // Translate an address from virtual to physical.
+    // Remove consecutive pages, possibly of mixed sizes, starting with the
+    // page at va.  Removal stops after length bytes or after a page flagged
+    // ALLOC_END, whichever comes first.  Dropped pages are appended to
+    // removed when it isn't NULL.  Returns false if an unmapped address
+    // is reached first.
+    bool ptRemoveRange(btVirtAddr va,
+                       btWSSize length,
+                       std::vector<MPFVTP_PT_PAGE> *removed = NULL);
+
+    // Translate an address from virtual to physical.  Safe to call
+    // concurrently with other readers and with a writer.  The size of
+    // the page holding va is returned when size isn't NULL.
     bool ptTranslateVAtoPA(btVirtAddr va,
                            btPhysAddr *pa,
-                           uint32_t *flags = NULL);
+                           uint32_t *flags = NULL,
+                           MPFVTP_PAGE_SIZE *size = NULL);
+
+    // Size of the naturally aligned unmapped region holding va: the span
+    // of the page table entry that is missing when va is walked, from 4KB
+    // up to a whole root entry.  Returns 0 if va is mapped.  Safe to call
+    // concurrently, like ptTranslateVAtoPA().
+    btWSSize ptUnmappedSize(btVirtAddr va);
 
     // Dump the page table (debugging)
     void ptDumpPageTable();
 
+    // Hits and misses in the software translation cache that filters
+    // calls to ptTranslateVAtoPA().
+    void ptGetTranslationCacheStats(uint64_t *hits, uint64_t *misses) const;
+    void ptResetTranslationCacheStats();
+
+    // Page table footprint: table pages shared with the FPGA, the subset
+    // of those that are free (on the free list or not yet carved from a
+    // slab) and bytes of host-only memory used to walk the table.
+    void ptGetFootprint(uint64_t *tablePages,
+                        uint64_t *freeTablePages,
+                        uint64_t *hostBytes) const;
+
   private:
     // The parent class must provide a method for allocating memory
     // shared with the FPGA, used here to construct the page table that
-    // will be walked in hardware.
+    // will be walked in hardware.  ptAllocSharedPage() returns NULL when
+    // no memory is available.
     virtual btVirtAddr ptAllocSharedPage(btWSSize length, btPhysAddr* pa) = 0;
+    virtual void ptFreeSharedPage(btVirtAddr va, btWSSize length) = 0;
     virtual bool ptInvalVAMapping(btVirtAddr va) = 0;
 
   private:
-    // Virtual to physical page hierarchical page table.  This is the table
-    // that is passed to the FPGA.
-    MPFVTP_PT_TREE ptVtoP;
-
-    // Because the page table is implemented in user space with no access
-    // to kernel page mapping.  In order to walk ptVtoP in software we need
-    // to record a reverse physical to virtual mapping.
-    MPFVTP_PT_TREE ptPtoV;
+    // Root of the virtual to physical page hierarchical page table.  The
+    // table pages are passed to the FPGA.  Each is wrapped in a host-only
+    // node that records the virtual addresses of its children, since
+    // the table itself holds only physical addresses.
+    MPFVTP_PT_NODE ptRoot;
 
     btPhysAddr m_pPageTablePA;
 
     // Allocate an internal page table page.
-    btVirtAddr ptAllocTablePage(btPhysAddr* pa);
-    void ptFreeTablePage(btVirtAddr va, btPhysAddr pa);
-    btVirtAddr m_pageTableFreeList;
+    MPFVTP_PT_NODE ptAllocTablePage();
+    void ptFreeTablePage(MPFVTP_PT_NODE node);
+    MPFVTP_PT_NODE m_pageTableFreeList;
+
+    // Pages unlinked from the table that concurrent readers may still be
+    // walking.  They move to the free list after ptWaitForReaders().
+    MPFVTP_PT_NODE m_pageTableRetiredList;
+
+    // Return tables left empty after removing a translation to the free
+    // list, starting at node and working up toward the root.
+    void ptReclaimEmptyTables(MPFVTP_PT_NODE node);
+
+    // Release a subtree during ptTerminate().
+    void ptReleaseTree(MPFVTP_PT_NODE node);
+
+    // Footprint counters
+    uint64_t m_numTablePages;
+    uint64_t m_numFreeTablePages;
+    uint64_t m_hostBytes;
+
+    // New table pages are carved from slabs of shared memory so that
+    // the tables the FPGA walks for nearby addresses are physically
+    // close.  Slabs are returned only by ptTerminate().  A single page
+    // is allocated if a slab can't be.  Allocating the root in
+    // ptInitialize() normally takes a slab, so every page table pins
+    // PT_SLAB_SIZE of shared memory from the start.
+    static const size_t PT_SLAB_SIZE = MB(2);
+
+    btVirtAddr m_slabNextVA;
+    btPhysAddr m_slabNextPA;
+    size_t m_slabFreeBytes;
+
+    // All shared memory allocated for tables
+    std::vector<std::pair<btVirtAddr, btWSSize> > m_sharedRegions;
+
+    // Return an unused table page from the current slab.
+    btVirtAddr ptAllocTableMem(btPhysAddr *pa);
+
+    // Return the table holding entries for va at depth, allocating
+    // intermediate tables as needed.  NULL if a larger page already
+    // maps va.
+    MPFVTP_PT_NODE ptWalkToTable(btVirtAddr va, uint32_t depth);
+
+    // Add a translation at idx in a table.  Returns false if a mapping
+    // already exists.
+    bool ptInsertTranslation(MPFVTP_PT_NODE node,
+                             uint32_t idx,
+                             btPhysAddr pa,
+                             uint32_t depth,
+                             uint32_t flags);
+
+    // Find the table and depth holding the translation of va.
+    bool ptFindTranslation(btVirtAddr va,
+                           MPFVTP_PT_NODE *node,
+                           uint32_t *depth);
+
+    //
+    // Epoch-based reclamation.  Readers walking the table register in the
+    // current epoch.  A writer that needs to reuse unlinked pages
+    // advances the epoch and waits for readers registered in the old
+    // one to finish.  Readers are counted in shards, picked by thread,
+    // to avoid sharing a cache line.  The shards also hold translation
+    // cache statistics.
+    //
+    enum { PT_READER_SHARDS = 64 };
+
+    typedef struct
+    {
+        // Active readers, indexed by epoch parity
+        MPFVTP_PT_ATOMIC<uint64_t> active[2];
+
+        MPFVTP_PT_ATOMIC<uint64_t> xlateCacheHits;
+        MPFVTP_PT_ATOMIC<uint64_t> xlateCacheMisses;
+
+        // Pad to a cache line
+        uint64_t pad[4];
+    }
+    PT_READER_SHARD;
+
+    PT_READER_SHARD m_readerShards[PT_READER_SHARDS];
+    MPFVTP_PT_ATOMIC<uint64_t> m_epoch;
+
+    // Register a reader, returning the counter to pass to ptReaderExit().
+    MPFVTP_PT_ATOMIC<uint64_t>* ptReaderEnter(PT_READER_SHARD *shard);
+    void ptReaderExit(MPFVTP_PT_ATOMIC<uint64_t> *active);
+    void ptWaitForReaders();
+    PT_READER_SHARD* ptReaderShard();
+
+    //
+    // Direct-mapped caches of recent translations, one for each page
+    // size.  A table walk is up to four dependent loads, one per level.
+    // The cache lets repeated translations within a page skip the walk.
+    // Only successful translations are cached.
+    //
+    // Entries are tagged with the cache generation, which is advanced
+    // whenever translations are removed.  A reader that walked the table
+    // before a removal can't leave a stale entry behind.  Any reader may
+    // fill an entry, so each is guarded by a sequence number that is odd
+    // while the entry is written.
+    //
+    enum { PT_XLATE_CACHE_ENTRIES = 256 };
+
+    typedef struct
+    {
+        MPFVTP_PT_ATOMIC<uint64_t> seq;
+        // Virtual page number and cache generation of the translation
+        MPFVTP_PT_ATOMIC<uint64_t> vpn;
+        MPFVTP_PT_ATOMIC<uint64_t> gen;
+        MPFVTP_PT_ATOMIC<btPhysAddr> pa;
+        MPFVTP_PT_ATOMIC<uint32_t> flags;
+    }
+    PT_XLATE_CACHE_ENTRY;
 
-    // Add a virtual to physical mapping at depth in the tree.  Returns
-    // false if a mapping already exists.
-    bool AddVAtoPA(btVirtAddr va, btPhysAddr pa, uint32_t depth, uint32_t flags);
+    PT_XLATE_CACHE_ENTRY m_xlateCache[MPFVTP_PAGE_N_SIZES][PT_XLATE_CACHE_ENTRIES];
+    MPFVTP_PT_ATOMIC<uint64_t> m_xlateCacheGen;
 
-    // Add a physical to virtual mapping at depth in the tree.  Returns
-    // false if a mapping already exists.
-    bool AddPAtoVA(btPhysAddr pa, btVirtAddr va, uint32_t depth);
+    bool ptXlateCacheLookup(btVirtAddr va, btPhysAddr *pa, uint32_t *flags,
+                            MPFVTP_PAGE_SIZE *pageSize);
+    void ptXlateCacheInsert(btVirtAddr va, btPhysAddr pa,
+                            MPFVTP_PAGE_SIZE size, uint32_t flags,
+                            uint64_t gen);
+    void ptXlateCacheInval();
+    void ptXlateCacheReset();
 
-    bool ptTranslatePAtoVA(btPhysAddr pa, btVirtAddr *va);
+    PT_XLATE_CACHE_ENTRY* ptXlateCacheEntry(uint64_t va, MPFVTP_PAGE_SIZE size)
+    {
+        uint64_t vpn = va >> ptPageShift(size);
+        return &m_xlateCache[size][vpn & (PT_XLATE_CACHE_ENTRIES - 1)];
+    }
 
-    void DumpPageTableVAtoPA(MPFVTP_PT_TREE table,
+    void DumpPageTableVAtoPA(MPFVTP_PT_NODE node,
                              uint64_t partial_va,
                              uint32_t depth);
 
+    // Number of address bits in the page offset
+    static uint32_t ptPageShift(MPFVTP_PAGE_SIZE size)
+    {
+        return 12 + 9 * uint32_t(size);
+    }
+
+    // Physical page size of a terminal entry found at a depth during a
+    // walk.  The root is depth 3 and 4KB leaf tables are depth 0.
+    static MPFVTP_PAGE_SIZE ptPageSizeFromDepth(uint32_t depth)
+    {
+        return MPFVTP_PAGE_SIZE(depth);
+    }
+
     uint32_t ptIdxFromAddr(uint64_t addr, uint32_t depth)
     {
         // Drop 4KB page offset
@@ -207,19 +517,29 @@ class MPFVTP_PT_TREE_CLASS
 
     void Reset()
     {
-        memset(table, -1, sizeof(table));
+        for (int idx = 0; idx < 512; idx++)
+        {
+            table[idx].Store(-1, MPFVTP_PT_RELAXED);
+        }
     }
 
     bool TableIsEmpty()
     {
         for (int idx = 0; idx < 512; idx++)
         {
-            if (table[idx] != -1) return false;
+            if (Entry(idx) != -1) return false;
         }
 
         return true;
     }
 
+    // Raw entry at idx, read once.  Used by concurrent readers, which
+    // must not decode an entry from more than one load.  -1 when empty.
+    int64_t GetEntry(uint32_t idx) const
+    {
+        return table[idx].Load(MPFVTP_PT_ACQUIRE);
+    }
+
     // Does an entry exist at the index?
     bool EntryExists(uint32_t idx)
     {
@@ -228,7 +548,7 @@ class MPFVTP_PT_TREE_CLASS
             return false;
         }
 
-        return (table[idx] != -1);
+        return (Entry(idx) != -1);
     }
 
     // Is the entry at idx terminal? If so, use GetTranslatedAddr(). If not,
@@ -240,7 +560,7 @@ class MPFVTP_PT_TREE_CLASS
             return false;
         }
 
-        return (table[idx] & MPFVTP_PT_FLAG_TERMINAL) != 0;
+        return (Entry(idx) & MPFVTP_PT_FLAG_TERMINAL) != 0;
     }
 
     // Walk the tree.  Ideally this would be a pointer to another
@@ -254,7 +574,7 @@ class MPFVTP_PT_TREE_CLASS
             return -1;
         }
 
-        return table[idx];
+        return Entry(idx);
     }
 
     int64_t GetTranslatedAddr(uint32_t idx)
@@ -265,7 +585,7 @@ class MPFVTP_PT_TREE_CLASS
         }
 
         // Clear the flags stored in low bits
-        return table[idx] & ~ int64_t(MPFVTP_PT_FLAG_MASK);
+        return Entry(idx) & ~ int64_t(MPFVTP_PT_FLAG_MASK);
     }
 
     uint32_t GetTranslatedAddrFlags(uint32_t idx)
@@ -275,14 +595,16 @@ class MPFVTP_PT_TREE_CLASS
             return 0;
         }
 
-        return uint32_t(table[idx]) & uint32_t(MPFVTP_PT_FLAG_MASK);
+        return uint32_t(Entry(idx)) & uint32_t(MPFVTP_PT_FLAG_MASK);
     }
 
+    // Updates are atomic stores so that concurrent readers (software and
+    // the FPGA) see either the old or the new entry.
     void InsertChildAddr(uint32_t idx, int64_t addr)
     {
         if (idx < 512)
         {
-            table[idx] = addr;
+            table[idx].Store(addr, MPFVTP_PT_RELEASE);
         }
     }
 
@@ -292,7 +614,8 @@ class MPFVTP_PT_TREE_CLASS
     {
         if (idx < 512)
         {
-            table[idx] = addr | MPFVTP_PT_FLAG_TERMINAL | flags;
+            table[idx].Store(addr | MPFVTP_PT_FLAG_TERMINAL | flags,
+                             MPFVTP_PT_RELEASE);
         }
     }
 
@@ -300,12 +623,167 @@ class MPFVTP_PT_TREE_CLASS
     {
         if (idx < 512)
         {
-            table[idx] = -1;
+            table[idx].Store(-1, MPFVTP_PT_RELEASE);
+        }
+    }
+
+    void RemoveChildAddr(uint32_t idx)
+    {
+        if (idx < 512)
+        {
+            table[idx].Store(-1, MPFVTP_PT_RELEASE);
         }
     }
 
   private:
-    int64_t table[512];
+    // Entry at idx as seen by the updating thread
+    int64_t Entry(uint32_t idx) const
+    {
+        return table[idx].Load(MPFVTP_PT_RELAXED);
+    }
+
+    MPFVTP_PT_ATOMIC<int64_t> table[512];
+};
+
+
+//
+// Host-only wrapper around a page table page.  MPFVTP_PT_TREE_CLASS must
+// match the layout walked by the FPGA, so the virtual addresses needed to
+// walk the tree in software are kept here.  The child array is allocated
+// only when the first non-terminal entry is added, so leaf tables holding
+// only translations remain small.  Entries are counted so that empty
+// tables can be found without scanning them.
+//
+// GetTable(), GetTablePA() and GetChild() may be called by concurrent
+// readers.  Child pointers are published before the table entry that
+// refers to them.
+//
+class MPFVTP_PT_NODE_CLASS
+{
+  public:
+    MPFVTP_PT_NODE_CLASS(MPFVTP_PT_TREE table, btPhysAddr tablePA) :
+        nextFree(NULL),
+        table(table),
+        tablePA(tablePA),
+        children(NULL),
+        parent(NULL),
+        parentIdx(0),
+        numEntries(0)
+    {}
+
+    ~MPFVTP_PT_NODE_CLASS()
+    {
+        delete[] children.Load(MPFVTP_PT_RELAXED);
+    }
+
+    // Page walked by the FPGA and its physical address
+    MPFVTP_PT_TREE GetTable() const { return table; }
+    btPhysAddr GetTablePA() const { return tablePA; }
+
+    // Child node at idx.  NULL if the entry is empty or terminal.
+    MPFVTP_PT_NODE GetChild(uint32_t idx) const
+    {
+        PT_CHILD* c = children.Load(MPFVTP_PT_ACQUIRE);
+        if ((idx >= 512) || (c == NULL))
+        {
+            return NULL;
+        }
+
+        return c[idx].Load(MPFVTP_PT_ACQUIRE);
+    }
+
+    // Parent node and the index of this node in the parent.  The parent
+    // of the root is NULL.
+    MPFVTP_PT_NODE GetParent() const { return parent; }
+    uint32_t GetParentIdx() const { return parentIdx; }
+
+    bool IsEmpty() const { return numEntries == 0; }
+    bool HasChildren() const
+    {
+        return children.Load(MPFVTP_PT_RELAXED) != NULL;
+    }
+
+    // Add a child both to the FPGA-visible table and the shadow.  The
+    // entry must be empty.
+    void InsertChild(uint32_t idx, MPFVTP_PT_NODE child)
+    {
+        if (idx < 512)
+        {
+            PT_CHILD* c = children.Load(MPFVTP_PT_RELAXED);
+            if (c == NULL)
+            {
+                c = new PT_CHILD[512];
+                children.Store(c, MPFVTP_PT_RELEASE);
+            }
+
+            c[idx].Store(child, MPFVTP_PT_RELEASE);
+            child->parent = this;
+            child->parentIdx = idx;
+            table->InsertChildAddr(idx, child->GetTablePA());
+            numEntries += 1;
+        }
+    }
+
+    // Drop a child from both the FPGA-visible table and the shadow.
+    void RemoveChild(uint32_t idx)
+    {
+        PT_CHILD* c = children.Load(MPFVTP_PT_RELAXED);
+        if ((idx < 512) && (c != NULL) &&
+            (c[idx].Load(MPFVTP_PT_RELAXED) != NULL))
+        {
+            c[idx].Load(MPFVTP_PT_RELAXED)->parent = NULL;
+            c[idx].Store(NULL, MPFVTP_PT_RELEASE);
+            table->RemoveChildAddr(idx);
+            numEntries -= 1;
+        }
+    }
+
+    // Add a translation.  The entry must be empty.
+    void InsertTranslation(uint32_t idx, btPhysAddr pa, uint32_t flags)
+    {
+        if (idx < 512)
+        {
+            table->InsertTranslatedAddr(idx, pa, flags);
+            numEntries += 1;
+        }
+    }
+
+    void RemoveTranslation(uint32_t idx)
+    {
+        if ((idx < 512) && table->EntryIsTerminal(idx))
+        {
+            table->RemoveTranslatedAddr(idx);
+            numEntries -= 1;
+        }
+    }
+
+    // Clear the table and all shadow state, used when recycling the node.
+    // No reader may still hold a pointer to the node.
+    void Reset()
+    {
+        table->Reset();
+        delete[] children.Load(MPFVTP_PT_RELAXED);
+        children.Store(NULL, MPFVTP_PT_RELAXED);
+        parent = NULL;
+        parentIdx = 0;
+        numEntries = 0;
+    }
+
+    // Link for the page table free list
+    MPFVTP_PT_NODE nextFree;
+
+  private:
+    typedef MPFVTP_PT_ATOMIC<MPFVTP_PT_NODE> PT_CHILD;
+
+    MPFVTP_PT_TREE table;
+    btPhysAddr tablePA;
+    MPFVTP_PT_ATOMIC<PT_CHILD*> children;
+
+    MPFVTP_PT_NODE parent;
+    uint32_t parentIdx;
+
+    // Number of valid entries in table
+    uint32_t numEntries;
 };
 
 
@@ -170,11 +170,28 @@ int main(int argc, char *argv[])
     {
         cout << "#   VTP failed addr:    0x" << hex << uint64_t(vtp_stats.ptWalkLastVAddr) << dec << endl;
     }
-    cout << "#   VTP PT walk cycles: " << vtp_stats.numPTWalkBusyCycles << endl
-         << "#   VTP 4KB hit / miss: " << vtp_stats.numTLBHits4KB << " / "
+    // The walker handles one miss at a time, so busy cycles per miss is
+    // the average walk latency.
+    uint64_t vtp_misses = vtp_stats.numTLBMisses4KB +
+                          vtp_stats.numTLBMisses2MB +
+                          vtp_stats.numTLBMisses1GB;
+    cout << "#   VTP PT walk cycles: " << vtp_stats.numPTWalkBusyCycles << endl;
+    if (vtp_misses)
+    {
+        cout << "#   VTP cycles / miss:  "
+             << double(vtp_stats.numPTWalkBusyCycles) / double(vtp_misses) << endl;
+    }
+    cout << "#   VTP 4KB hit / miss: " << vtp_stats.numTLBHits4KB << " / "
                                        << vtp_stats.numTLBMisses4KB << endl
          << "#   VTP 2MB hit / miss: " << vtp_stats.numTLBHits2MB << " / "
-                                       << vtp_stats.numTLBMisses2MB << endl;
+                                       << vtp_stats.numTLBMisses2MB << endl
+         << "#   VTP 1GB hit / miss: " << vtp_stats.numTLBHits1GB << " / "
+                                       << vtp_stats.numTLBMisses1GB << endl
+         << "#   VTP SW hit / miss:  " << vtp_stats.numSWTranslationCacheHits << " / "
+                                       << vtp_stats.numSWTranslationCacheMisses << endl
+         << "#   VTP PT pages:       " << vtp_stats.numPTTablePages << " ("
+                                       << vtp_stats.numPTFreeTablePages << " free, "
+                                       << vtp_stats.numPTHostBytes << " host bytes)" << endl;
 
     if (svc.m_pVCMAPService)
     {
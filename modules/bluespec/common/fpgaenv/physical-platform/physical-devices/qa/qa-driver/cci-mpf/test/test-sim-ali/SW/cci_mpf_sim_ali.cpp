@@ -0,0 +1,404 @@
+// Copyright(c) 2016, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//****************************************************************************
+/// @file cci_mpf_sim_ali.cpp
+/// @brief Software stand-in for the ALI buffer and MMIO services.
+/// @ingroup SimALI
+/// @verbatim
+/// See cci_mpf_sim_ali.h.
+/// @endverbatim
+//****************************************************************************
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif // HAVE_CONFIG_H
+
+#include <sys/mman.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <aalsdk/AAL.h>
+#include <aalsdk/AALLoggerExtern.h>              // Logger
+#include <aalsdk/service/IALIAFU.h>
+
+#include "cci_mpf_sim_ali.h"
+
+BEGIN_NAMESPACE(AAL)
+
+
+//=============================================================================
+// Typedefs and Constants
+//=============================================================================
+
+// Fake IOVAs start well above any plausible physical address
+#define SIM_IOVA_BASE     (btPhysAddr(1) << 44)
+
+// Device feature header fields
+#define SIM_DFH_TYPE_AFU  1
+#define SIM_DFH_TYPE_BBB  2
+
+// Size of the AFU's own CSR space, before the first MPF feature
+#define SIM_AFU_CSR_SIZE  0x1000
+
+
+/// @addtogroup SimALI
+/// @{
+
+//-----------------------------------------------------------------------------
+// MPFSimALIBuffer
+//-----------------------------------------------------------------------------
+
+MPFSimALIBuffer::MPFSimALIBuffer() : m_nextIOVA( SIM_IOVA_BASE ),
+                                     m_numAllocs( 0 ),
+                                     m_numFrees( 0 ),
+                                     m_bytesAllocated( 0 )
+{
+}
+
+MPFSimALIBuffer::~MPFSimALIBuffer()
+{
+   bufferFreeAll();
+}
+
+ali_errnum_e MPFSimALIBuffer::bufferAllocate( btWSSize             Length,
+                                              btVirtAddr          *pBufferptr,
+                                              NamedValueSet const &rInputArgs,
+                                              NamedValueSet       &rOutputArgs )
+{
+   return bufferAllocate(Length, pBufferptr, rInputArgs);
+}
+
+ali_errnum_e MPFSimALIBuffer::bufferAllocate( btWSSize             Length,
+                                              btVirtAddr          *pBufferptr,
+                                              NamedValueSet const &rInputArgs )
+{
+   if (Length == 0) {
+      return ali_errnumBadParameter;
+   }
+
+   // Like the driver, map at a requested VA, replacing any reservation
+   // already there.
+   ALI_MMAP_TARGET_VADDR_DATATYPE target = NULL;
+   int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+   if (ENamedValuesOK == rInputArgs.Get(ALI_MMAP_TARGET_VADDR_KEY, &target)) {
+      flags |= MAP_FIXED;
+   }
+
+   void *va = mmap(target, Length, PROT_READ | PROT_WRITE, flags, -1, 0);
+   if (va == MAP_FAILED) {
+      AAL_ERR(LM_AFU, "Simulated buffer mmap failed." << std::endl);
+      return ali_errnumNoMem;
+   }
+
+   // Fake IOVAs are naturally aligned up to 2MB so that VTP can map
+   // them with large pages.
+   btWSSize align = 4096;
+   while ((align < Length) && (align < 2 * 1024 * 1024)) {
+      align <<= 1;
+   }
+
+   std::lock_guard<std::mutex> lock(m_lock);
+
+   t_sim_buffer buf;
+   buf.length = Length;
+   buf.iova = (m_nextIOVA + align - 1) & ~btPhysAddr(align - 1);
+   m_nextIOVA = buf.iova + ((Length + 4095) & ~btWSSize(4095));
+
+   m_buffers[btVirtAddr(va)] = buf;
+   m_numAllocs += 1;
+   m_bytesAllocated += Length;
+
+   *pBufferptr = btVirtAddr(va);
+   return ali_errnumOK;
+}
+
+ali_errnum_e MPFSimALIBuffer::bufferAllocate( btWSSize    Length,
+                                              btVirtAddr *pBufferptr )
+{
+   NamedValueSet nvs;
+   return bufferAllocate(Length, pBufferptr, nvs);
+}
+
+ali_errnum_e MPFSimALIBuffer::bufferFree( btVirtAddr Address )
+{
+   std::lock_guard<std::mutex> lock(m_lock);
+
+   std::map<btVirtAddr, t_sim_buffer>::iterator b = m_buffers.find(Address);
+   if (b == m_buffers.end()) {
+      return ali_errnumBadParameter;
+   }
+
+   munmap(Address, b->second.length);
+   m_bytesAllocated -= b->second.length;
+   m_numFrees += 1;
+   m_buffers.erase(b);
+
+   return ali_errnumOK;
+}
+
+ali_errnum_e MPFSimALIBuffer::bufferFreeAll()
+{
+   std::lock_guard<std::mutex> lock(m_lock);
+
+   for (std::map<btVirtAddr, t_sim_buffer>::iterator b = m_buffers.begin();
+        b != m_buffers.end();
+        b++) {
+      munmap(b->first, b->second.length);
+      m_numFrees += 1;
+   }
+
+   m_buffers.clear();
+   m_bytesAllocated = 0;
+
+   return ali_errnumOK;
+}
+
+//
+// Translate any address inside an allocated buffer.
+//
+btPhysAddr MPFSimALIBuffer::bufferGetIOVA( btVirtAddr Address )
+{
+   std::lock_guard<std::mutex> lock(m_lock);
+
+   std::map<btVirtAddr, t_sim_buffer>::iterator b = m_buffers.upper_bound(Address);
+   if (b == m_buffers.begin()) {
+      return 0;
+   }
+   b--;
+
+   btWSSize offset = Address - b->first;
+   if (offset >= b->second.length) {
+      return 0;
+   }
+
+   return b->second.iova + offset;
+}
+
+
+//-----------------------------------------------------------------------------
+// MPFSimALIMMIO
+//-----------------------------------------------------------------------------
+
+MPFSimALIMMIO::MPFSimALIMMIO( btUnsigned64bitInt mpfFeatureID ) :
+   m_lastDFHOffset( 0 ),
+   m_numReads( 0 ),
+   m_numWrites( 0 )
+{
+   m_regs.resize(SIM_AFU_CSR_SIZE / 8, 0);
+
+   // AFU DFH.  The next feature pointer is filled in by addFeature().
+   m_regs[0] = (btUnsigned64bitInt(SIM_DFH_TYPE_AFU) << 60) |
+               (btUnsigned64bitInt(1) << 40);
+
+   m_vtpDFHOffset = addFeature(SIM_DFH_TYPE_BBB, mpfFeatureID,
+                               MPF_VTP_BBB_GUID, CCI_MPF_VTP_CSR_SIZE);
+   m_vcmapDFHOffset = addFeature(SIM_DFH_TYPE_BBB, mpfFeatureID,
+                                 MPF_VC_MAP_BBB_GUID, CCI_MPF_VC_MAP_CSR_SIZE);
+   m_wroDFHOffset = addFeature(SIM_DFH_TYPE_BBB, mpfFeatureID,
+                               MPF_WRO_BBB_GUID, CCI_MPF_WRO_CSR_SIZE);
+   m_pwriteDFHOffset = addFeature(SIM_DFH_TYPE_BBB, mpfFeatureID,
+                                  MPF_PWRITE_BBB_GUID, CCI_MPF_PWRITE_CSR_SIZE);
+}
+
+MPFSimALIMMIO::~MPFSimALIMMIO()
+{
+}
+
+//
+// Parse a GUID string into the two 64 bit ID CSRs.  ID_H holds the first
+// 16 hex digits.
+//
+static void simParseGUID( btcString sGUID,
+                          btUnsigned64bitInt *idH,
+                          btUnsigned64bitInt *idL )
+{
+   btUnsigned64bitInt v[2] = { 0, 0 };
+   int n = 0;
+
+   for (btcString c = sGUID; *c && (n < 32); c++) {
+      if (*c == '-') continue;
+
+      char digit[2] = { *c, 0 };
+      v[n / 16] = (v[n / 16] << 4) | strtoul(digit, NULL, 16);
+      n += 1;
+   }
+
+   *idH = v[0];
+   *idL = v[1];
+}
+
+btCSROffset MPFSimALIMMIO::addFeature( btUnsigned64bitInt type,
+                                       btUnsigned64bitInt featureID,
+                                       btcString          sGUID,
+                                       btCSROffset        size )
+{
+   btCSROffset offset = m_regs.size() * 8;
+   m_regs.resize(m_regs.size() + (size + 7) / 8, 0);
+
+   // Point the previous feature here and clear its end of list bit
+   btUnsigned64bitInt &prev = m_regs[m_lastDFHOffset / 8];
+   prev &= ~((btUnsigned64bitInt(0xffffff) << 16) | (btUnsigned64bitInt(1) << 40));
+   prev |= btUnsigned64bitInt(offset - m_lastDFHOffset) << 16;
+
+   // New feature is the end of the list
+   m_regs[offset / 8] = (type << 60) |
+                        (btUnsigned64bitInt(1) << 40) |
+                        (featureID & 0xfff);
+   simParseGUID(sGUID, &m_regs[offset / 8 + 2], &m_regs[offset / 8 + 1]);
+
+   m_lastDFHOffset = offset;
+   return offset;
+}
+
+btVirtAddr MPFSimALIMMIO::mmioGetAddress( void )
+{
+   return btVirtAddr(&m_regs[0]);
+}
+
+btCSROffset MPFSimALIMMIO::mmioGetLength( void )
+{
+   return m_regs.size() * 8;
+}
+
+btBool MPFSimALIMMIO::mmioRead32( const btCSROffset Offset,
+                                  btUnsigned32bitInt * const pValue )
+{
+   if ((Offset & 3) || (Offset + 4 > mmioGetLength())) {
+      return false;
+   }
+
+   m_numReads += 1;
+   *pValue = *(btUnsigned32bitInt *)(mmioGetAddress() + Offset);
+   return true;
+}
+
+btBool MPFSimALIMMIO::mmioWrite32( const btCSROffset Offset,
+                                   const btUnsigned32bitInt Value )
+{
+   if ((Offset & 3) || (Offset + 4 > mmioGetLength())) {
+      return false;
+   }
+
+   m_numWrites += 1;
+   *(btUnsigned32bitInt *)(mmioGetAddress() + Offset) = Value;
+   return true;
+}
+
+btBool MPFSimALIMMIO::mmioRead64( const btCSROffset Offset,
+                                  btUnsigned64bitInt * const pValue )
+{
+   if ((Offset & 7) || (Offset + 8 > mmioGetLength())) {
+      return false;
+   }
+
+   m_numReads += 1;
+   *pValue = m_regs[Offset / 8];
+   return true;
+}
+
+btBool MPFSimALIMMIO::mmioWrite64( const btCSROffset Offset,
+                                   const btUnsigned64bitInt Value )
+{
+   if ((Offset & 7) || (Offset + 8 > mmioGetLength())) {
+      return false;
+   }
+
+   m_numWrites += 1;
+   m_regs[Offset / 8] = Value;
+   return true;
+}
+
+btBool MPFSimALIMMIO::mmioGetFeatureAddress( btVirtAddr          *pFeature,
+                                             NamedValueSet const &rInputArgs,
+                                             NamedValueSet       &rOutputArgs )
+{
+   return mmioGetFeatureAddress(pFeature, rInputArgs);
+}
+
+btBool MPFSimALIMMIO::mmioGetFeatureAddress( btVirtAddr          *pFeature,
+                                             NamedValueSet const &rInputArgs )
+{
+   btCSROffset offset;
+   if (! mmioGetFeatureOffset(&offset, rInputArgs)) {
+      return false;
+   }
+
+   *pFeature = mmioGetAddress() + offset;
+   return true;
+}
+
+btBool MPFSimALIMMIO::mmioGetFeatureOffset( btCSROffset         *pFeatureOffset,
+                                            NamedValueSet const &rInputArgs,
+                                            NamedValueSet       &rOutputArgs )
+{
+   return mmioGetFeatureOffset(pFeatureOffset, rInputArgs);
+}
+
+//
+// Walk the DFH chain looking for a feature matching all filters present
+// in rInputArgs.
+//
+btBool MPFSimALIMMIO::mmioGetFeatureOffset( btCSROffset         *pFeatureOffset,
+                                            NamedValueSet const &rInputArgs )
+{
+   ALI_GETFEATURE_TYPE_DATATYPE filterType;
+   ALI_GETFEATURE_ID_DATATYPE filterID;
+   ALI_GETFEATURE_GUID_DATATYPE filterGUID;
+
+   btBool hasType = (ENamedValuesOK == rInputArgs.Get(ALI_GETFEATURE_TYPE_KEY, &filterType));
+   btBool hasID = (ENamedValuesOK == rInputArgs.Get(ALI_GETFEATURE_ID_KEY, &filterID));
+   btBool hasGUID = (ENamedValuesOK == rInputArgs.Get(ALI_GETFEATURE_GUID_KEY, &filterGUID));
+
+   btUnsigned64bitInt guidH = 0, guidL = 0;
+   if (hasGUID) {
+      simParseGUID((btcString)filterGUID, &guidH, &guidL);
+   }
+
+   btCSROffset offset = 0;
+   while (true) {
+      btUnsigned64bitInt dfh = m_regs[offset / 8];
+
+      btBool match = true;
+      if (hasType && ((dfh >> 60) != btUnsigned64bitInt(filterType))) match = false;
+      if (hasID && ((dfh & 0xfff) != btUnsigned64bitInt(filterID))) match = false;
+      if (hasGUID && ((m_regs[offset / 8 + 2] != guidH) ||
+                      (m_regs[offset / 8 + 1] != guidL))) match = false;
+
+      if (match) {
+         *pFeatureOffset = offset;
+         return true;
+      }
+
+      // End of list?
+      if ((dfh >> 40) & 1) break;
+      offset += (dfh >> 16) & 0xffffff;
+   }
+
+   return false;
+}
+
+/// @}
+
+END_NAMESPACE(AAL)
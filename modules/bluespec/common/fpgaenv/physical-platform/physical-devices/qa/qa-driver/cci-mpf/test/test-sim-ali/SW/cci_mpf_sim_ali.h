@@ -0,0 +1,178 @@
+// Copyright(c) 2016, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//****************************************************************************
+/// @file cci_mpf_sim_ali.h
+/// @brief Software stand-in for the ALI buffer and MMIO services.
+/// @ingroup SimALI
+/// @verbatim
+/// In-process implementations of IALIBuffer and IALIMMIO that need no FPGA
+/// and no AAL driver.  Buffers are anonymous mmap() regions with fake,
+/// naturally aligned IOVAs.  MMIO is a register file holding an AFU DFH
+/// followed by the MPF VTP, VC MAP, WRO and PWRITE feature headers, so
+/// the MPF shim classes find their features exactly as they would in
+/// hardware.
+///
+/// No FPGA-side behavior is modeled.  Register writes are simply stored
+/// and statistics counters read back as the values last written.  The
+/// classes are intended for measuring software costs such as allocation
+/// throughput, page table updates and translation.
+/// @endverbatim
+//****************************************************************************
+#ifndef __CCI_MPF_SIM_ALI_H__
+#define __CCI_MPF_SIM_ALI_H__
+
+#include <map>
+#include <vector>
+#include <mutex>
+
+#include <aalsdk/AAL.h>
+#include <aalsdk/service/IALIAFU.h>
+
+#include "IMPF.h"              // Public MPF service interface
+#include "cci_mpf_csrs.h"
+
+
+BEGIN_NAMESPACE(AAL)
+
+/// @addtogroup SimALI
+/// @{
+
+//
+// Shared memory buffers backed by anonymous mmap().
+//
+class MPFSimALIBuffer : public IALIBuffer
+{
+public:
+   MPFSimALIBuffer();
+   ~MPFSimALIBuffer();
+
+   // <IALIBuffer>
+   ali_errnum_e bufferAllocate( btWSSize             Length,
+                                btVirtAddr          *pBufferptr,
+                                NamedValueSet const &rInputArgs,
+                                NamedValueSet       &rOutputArgs );
+   ali_errnum_e bufferAllocate( btWSSize             Length,
+                                btVirtAddr          *pBufferptr,
+                                NamedValueSet const &rInputArgs );
+   ali_errnum_e bufferAllocate( btWSSize             Length,
+                                btVirtAddr          *pBufferptr );
+   ali_errnum_e bufferFree( btVirtAddr Address );
+   ali_errnum_e bufferFreeAll();
+   btPhysAddr bufferGetIOVA( btVirtAddr Address );
+   // </IALIBuffer>
+
+   // Statistics
+   btUnsigned64bitInt numAllocs() const { return m_numAllocs; }
+   btUnsigned64bitInt numFrees() const { return m_numFrees; }
+   btUnsigned64bitInt bytesAllocated() const { return m_bytesAllocated; }
+
+protected:
+   typedef struct
+   {
+      btWSSize   length;
+      btPhysAddr iova;
+   }
+   t_sim_buffer;
+
+   // Active buffers indexed by VA
+   std::map<btVirtAddr, t_sim_buffer> m_buffers;
+   std::mutex m_lock;
+
+   // Next fake IOVA
+   btPhysAddr m_nextIOVA;
+
+   btUnsigned64bitInt m_numAllocs;
+   btUnsigned64bitInt m_numFrees;
+   btUnsigned64bitInt m_bytesAllocated;
+};
+
+
+//
+// MMIO register file with an MPF feature chain.
+//
+class MPFSimALIMMIO : public IALIMMIO
+{
+public:
+   /// mpfFeatureID is the BBB feature ID reported by each MPF shim.  It must
+   /// match MPF_FEATURE_ID_KEY when the MPF service searches for features.
+   MPFSimALIMMIO( btUnsigned64bitInt mpfFeatureID = 1 );
+   ~MPFSimALIMMIO();
+
+   // <IALIMMIO>
+   btVirtAddr  mmioGetAddress( void );
+   btCSROffset mmioGetLength( void );
+
+   btBool mmioRead32( const btCSROffset Offset, btUnsigned32bitInt * const pValue );
+   btBool mmioWrite32( const btCSROffset Offset, const btUnsigned32bitInt Value );
+   btBool mmioRead64( const btCSROffset Offset, btUnsigned64bitInt * const pValue );
+   btBool mmioWrite64( const btCSROffset Offset, const btUnsigned64bitInt Value );
+
+   btBool mmioGetFeatureAddress( btVirtAddr          *pFeature,
+                                 NamedValueSet const &rInputArgs,
+                                 NamedValueSet       &rOutputArgs );
+   btBool mmioGetFeatureAddress( btVirtAddr          *pFeature,
+                                 NamedValueSet const &rInputArgs );
+   btBool mmioGetFeatureOffset( btCSROffset         *pFeatureOffset,
+                                NamedValueSet const &rInputArgs,
+                                NamedValueSet       &rOutputArgs );
+   btBool mmioGetFeatureOffset( btCSROffset         *pFeatureOffset,
+                                NamedValueSet const &rInputArgs );
+   // </IALIMMIO>
+
+   // DFH offsets of the simulated MPF features
+   btCSROffset vtpDFHOffset() const { return m_vtpDFHOffset; }
+   btCSROffset vcmapDFHOffset() const { return m_vcmapDFHOffset; }
+   btCSROffset wroDFHOffset() const { return m_wroDFHOffset; }
+   btCSROffset pwriteDFHOffset() const { return m_pwriteDFHOffset; }
+
+   // Statistics
+   btUnsigned64bitInt numReads() const { return m_numReads; }
+   btUnsigned64bitInt numWrites() const { return m_numWrites; }
+
+protected:
+   // Append a feature to the DFH chain.  Returns the feature's offset.
+   btCSROffset addFeature( btUnsigned64bitInt type,
+                           btUnsigned64bitInt featureID,
+                           btcString          sGUID,
+                           btCSROffset        size );
+
+   std::vector<btUnsigned64bitInt> m_regs;
+   btCSROffset m_lastDFHOffset;
+
+   btCSROffset m_vtpDFHOffset;
+   btCSROffset m_vcmapDFHOffset;
+   btCSROffset m_wroDFHOffset;
+   btCSROffset m_pwriteDFHOffset;
+
+   btUnsigned64bitInt m_numReads;
+   btUnsigned64bitInt m_numWrites;
+};
+
+/// @}
+
+END_NAMESPACE(AAL)
+
+#endif // __CCI_MPF_SIM_ALI_H__
@@ -0,0 +1,290 @@
+// Copyright(c) 2016, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//****************************************************************************
+/// @file test-sim-ali.cpp
+/// @brief Exercise the MPF shims against the in-process ALI stand-ins
+/// @verbatim
+/// Construct MPFVTP, MPFVCMAP, MPFWRO and MPFPWRITE on MPFSimALIBuffer and
+/// MPFSimALIMMIO and check their CSR accesses.  Then allocate VTP buffers
+/// of several sizes, check that every page translates consistently and
+/// free them.  Construction, allocation and free times are reported.  No
+/// FPGA is needed.
+///
+/// Usage: test-sim-ali [--buffers=<n>]
+/// @endverbatim
+//****************************************************************************
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include <aalsdk/AAL.h>
+
+#include "cci_mpf_shim_vtp.h"
+#include "cci_mpf_shim_vc_map.h"
+#include "cci_mpf_shim_wro.h"
+#include "cci_mpf_shim_pwrite.h"
+#include "cci_mpf_sim_ali.h"
+
+using namespace AAL;
+
+
+static uint64_t
+nowNs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return uint64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
+
+//
+// Every 4KB page of the buffer must translate, and addresses within a
+// page must translate to the same offsets within the physical page.
+//
+static bool
+checkBuffer(MPFVTP& vtp, btVirtAddr va, size_t len)
+{
+    for (size_t off = 0; off < len; off += 4096)
+    {
+        btPhysAddr pa = vtp.bufferGetIOVA(va + off);
+        if (pa == 0)
+        {
+            fprintf(stderr, "FAIL: VA %p not mapped\n", va + off);
+            return false;
+        }
+
+        size_t last = ((len - off) < 4096) ? (len - off - 1) : 4095;
+        if (vtp.bufferGetIOVA(va + off + last) != pa + last)
+        {
+            fprintf(stderr, "FAIL: VA %p translates inconsistently\n",
+                    va + off + last);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+//
+// Check a CSR written through a shim against the register file.
+//
+static bool
+checkCSR(MPFSimALIMMIO& mmio, const char* name, btCSROffset offset,
+         btUnsigned64bitInt expected)
+{
+    btUnsigned64bitInt v;
+    if (! mmio.mmioRead64(offset, &v) || (v != expected))
+    {
+        fprintf(stderr, "FAIL: %s CSR is 0x%llx, expected 0x%llx\n",
+                name, (long long)v, (long long)expected);
+        return false;
+    }
+
+    return true;
+}
+
+
+//
+// A statistics counter read through a shim must be the register value.
+//
+static bool
+checkStat(const char* name, btUnsigned64bitInt v, btUnsigned64bitInt expected)
+{
+    if (v != expected)
+    {
+        fprintf(stderr, "FAIL: %s is %lld, expected %lld\n",
+                name, (long long)v, (long long)expected);
+        return false;
+    }
+
+    return true;
+}
+
+
+//
+// Construct the VC MAP, WRO and PWRITE shims as MPF startup does and
+// check that each reaches its own CSRs.
+//
+static bool
+checkOtherShims(MPFSimALIMMIO& mmio)
+{
+    uint64_t t0 = nowNs();
+    MPFVCMAP vcmap(&mmio, mmio.vcmapDFHOffset());
+    uint64_t vcmap_ns = nowNs() - t0;
+
+    t0 = nowNs();
+    MPFWRO wro(&mmio, mmio.wroDFHOffset());
+    uint64_t wro_ns = nowNs() - t0;
+
+    t0 = nowNs();
+    MPFPWRITE pwrite(&mmio, mmio.pwriteDFHOffset());
+    uint64_t pwrite_ns = nowNs() - t0;
+
+    if (! vcmap.isOK() || ! wro.isOK() || ! pwrite.isOK())
+    {
+        fprintf(stderr, "FAIL: shim initialization (VC MAP %d, WRO %d, PWRITE %d)\n",
+                vcmap.isOK(), wro.isOK(), pwrite.isOK());
+        return false;
+    }
+
+    printf("Startup:  VC MAP %.1f us, WRO %.1f us, PWRITE %.1f us\n",
+           vcmap_ns / 1000.0, wro_ns / 1000.0, pwrite_ns / 1000.0);
+
+    // VC MAP control register encoding (group A)
+    bool ok = vcmap.vcmapSetMode(true, true, 10);
+    ok = ok && checkCSR(mmio, "VC MAP control",
+                        mmio.vcmapDFHOffset() + CCI_MPF_VC_MAP_CSR_CTRL_REG,
+                        1 | 2 | (10 << 2) | (btUnsigned64bitInt(1) << 63));
+
+    // Statistics are read from each shim's own feature
+    mmio.mmioWrite64(mmio.vcmapDFHOffset() +
+                     CCI_MPF_VC_MAP_CSR_STAT_NUM_MAPPING_CHANGES, 11);
+    mmio.mmioWrite64(mmio.wroDFHOffset() + CCI_MPF_WRO_CSR_STAT_RR_CONFLICT, 21);
+    mmio.mmioWrite64(mmio.wroDFHOffset() + CCI_MPF_WRO_CSR_STAT_RW_CONFLICT, 22);
+    mmio.mmioWrite64(mmio.wroDFHOffset() + CCI_MPF_WRO_CSR_STAT_WR_CONFLICT, 23);
+    mmio.mmioWrite64(mmio.wroDFHOffset() + CCI_MPF_WRO_CSR_STAT_WW_CONFLICT, 24);
+    mmio.mmioWrite64(mmio.pwriteDFHOffset() +
+                     CCI_MPF_PWRITE_CSR_STAT_NUM_PWRITES, 31);
+
+    t_cci_mpf_vc_map_stats vcmap_stats;
+    t_cci_mpf_wro_stats wro_stats;
+    t_cci_mpf_pwrite_stats pwrite_stats;
+    ok = ok && vcmap.vcmapGetStats(&vcmap_stats) &&
+         wro.wroGetStats(&wro_stats) &&
+         pwrite.pwriteGetStats(&pwrite_stats);
+
+    ok = ok && checkStat("VC MAP mapping changes", vcmap_stats.numMappingChanges, 11);
+    ok = ok && checkStat("WRO RR conflicts", wro_stats.numConflictCyclesRR, 21);
+    ok = ok && checkStat("WRO RW conflicts", wro_stats.numConflictCyclesRW, 22);
+    ok = ok && checkStat("WRO WR conflicts", wro_stats.numConflictCyclesWR, 23);
+    ok = ok && checkStat("WRO WW conflicts", wro_stats.numConflictCyclesWW, 24);
+    ok = ok && checkStat("PWRITE partial writes", pwrite_stats.numPartialWrites, 31);
+
+    return ok;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    size_t n_buffers = 256;
+
+    static struct option long_opts[] =
+    {
+        { "buffers", required_argument, 0, 'b' },
+        { 0, 0, 0, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_opts, NULL)) != -1)
+    {
+        switch (c)
+        {
+          case 'b':
+            n_buffers = strtoull(optarg, NULL, 0);
+            break;
+          default:
+            fprintf(stderr, "Usage: %s [--buffers=<n>]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    MPFSimALIBuffer sim_buffer;
+    MPFSimALIMMIO sim_mmio;
+
+    uint64_t t0 = nowNs();
+    MPFVTP vtp(&sim_buffer, &sim_mmio, sim_mmio.vtpDFHOffset());
+    uint64_t vtp_ns = nowNs() - t0;
+    if (! vtp.isOK())
+    {
+        fprintf(stderr, "FAIL: VTP initialization\n");
+        exit(1);
+    }
+    printf("Startup:  VTP %.1f us\n", vtp_ns / 1000.0);
+
+    if (! checkOtherShims(sim_mmio)) exit(1);
+
+    // Mix of sizes: small, odd, just over a large page and multi-page
+    static const size_t sizes[] =
+        { 4096, 12345, 65536, MB(2) + 4096, MB(5) };
+    const size_t n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    std::vector<btVirtAddr> va(n_buffers);
+    std::vector<size_t> len(n_buffers);
+
+    t0 = nowNs();
+    for (size_t i = 0; i < n_buffers; i++)
+    {
+        len[i] = sizes[i % n_sizes];
+        if (vtp.bufferAllocate(len[i], &va[i]) != ali_errnumOK)
+        {
+            fprintf(stderr, "FAIL: allocate %ld bytes\n", len[i]);
+            exit(1);
+        }
+    }
+    uint64_t alloc_ns = nowNs() - t0;
+
+    for (size_t i = 0; i < n_buffers; i++)
+    {
+        if (! checkBuffer(vtp, va[i], len[i])) exit(1);
+    }
+
+    t0 = nowNs();
+    for (size_t i = 0; i < n_buffers; i++)
+    {
+        if (vtp.bufferFree(va[i]) != ali_errnumOK)
+        {
+            fprintf(stderr, "FAIL: free %p\n", va[i]);
+            exit(1);
+        }
+    }
+    uint64_t free_ns = nowNs() - t0;
+
+    // Freed buffers must no longer translate
+    for (size_t i = 0; i < n_buffers; i++)
+    {
+        if (vtp.bufferGetIOVA(va[i]) != 0)
+        {
+            fprintf(stderr, "FAIL: VA %p still mapped after free\n", va[i]);
+            exit(1);
+        }
+    }
+
+    printf("%ld buffers:  allocate %.1f us/buffer, free %.1f us/buffer\n",
+           n_buffers,
+           alloc_ns / 1000.0 / n_buffers,
+           free_ns / 1000.0 / n_buffers);
+    printf("ALI buffer service:  %lld allocations, %lld frees\n",
+           sim_buffer.numAllocs(), sim_buffer.numFrees());
+    printf("ALI MMIO service:  %lld reads, %lld writes\n",
+           sim_mmio.numReads(), sim_mmio.numWrites());
+    printf("PASS\n");
+
+    return 0;
+}
@@ -0,0 +1,365 @@
+// Copyright(c) 2016, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//****************************************************************************
+/// @file test-vtp-pt-bench.cpp
+/// @brief Single-threaded VTP page table microbenchmark
+/// @verbatim
+/// Measure throughput and latency of page table insert, translate and
+/// remove for 4KB and 2MB pages.  Two VA patterns are used:
+///
+///   seq    - pages are contiguous and visited in address order.
+///   random - pages are scattered over a sparse region 64 times larger
+///            than the mapped set and visited in random order.
+///
+/// Sequential runs also time ptInsertRange() and ptRemoveRange() over the
+/// whole set.  Table memory is reported after the inserts.
+///
+/// Latency is sampled on a subset of operations to limit the cost of
+/// reading the clock.  Reported latencies have the timer overhead
+/// subtracted.@endverbatim
+//****************************************************************************
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "vtp_pt_host.h"
+
+
+// VA of the first page in the sequential pattern.  The random pattern
+// starts at 0.  Both fit in the 48 bit VA space covered by the table.
+static const uint64_t SEQ_BASE = 1ULL << 46;
+static const uint64_t MAX_SPAN = 1ULL << 46;
+
+static inline uint64_t nsec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Cost of the pair of clock reads around a sampled operation
+static uint64_t timerOverhead()
+{
+    uint64_t best = ~uint64_t(0);
+    for (int i = 0; i < 1000; i++)
+    {
+        uint64_t t0 = nsec();
+        uint64_t t1 = nsec();
+        best = std::min(best, t1 - t0);
+    }
+
+    return best;
+}
+
+static inline btPhysAddr pageToPA(uint64_t va)
+{
+    // Arbitrary, but predictable for checking
+    return btPhysAddr(va ^ (1ULL << 47));
+}
+
+
+class BENCH
+{
+  public:
+    BENCH(size_t sampleInterval) :
+        sampleInterval(sampleInterval),
+        overhead(timerOverhead())
+    {}
+
+    // Run op on every VA, printing throughput and latency.  op returns
+    // false on failure.
+    template <typename OP>
+    bool run(const char *name, const char *label,
+             const std::vector<btVirtAddr> &vas, OP op)
+    {
+        std::vector<uint64_t> samples;
+        samples.reserve(vas.size() / sampleInterval + 1);
+
+        bool ok = true;
+        uint64_t start = nsec();
+        for (size_t i = 0; i < vas.size(); i++)
+        {
+            if (i % sampleInterval)
+            {
+                ok &= op(vas[i]);
+            }
+            else
+            {
+                uint64_t t0 = nsec();
+                ok &= op(vas[i]);
+                uint64_t t1 = nsec();
+                samples.push_back(t1 - t0 > overhead ? t1 - t0 - overhead : 0);
+            }
+        }
+        uint64_t elapsed = nsec() - start;
+
+        report(name, label, vas.size(), elapsed, samples);
+        return ok;
+    }
+
+    // Time a single operation covering n pages
+    template <typename OP>
+    bool runOnce(const char *name, const char *label, size_t n, OP op)
+    {
+        std::vector<uint64_t> samples;
+
+        uint64_t start = nsec();
+        bool ok = op();
+        uint64_t elapsed = nsec() - start;
+
+        report(name, label, n, elapsed, samples);
+        return ok;
+    }
+
+    static void header()
+    {
+        printf("# %-6s %-6s %-14s %9s %9s %8s %8s %8s %8s\n",
+               "page", "va", "op", "n", "Mops/s", "avg ns",
+               "p50 ns", "p99 ns", "max ns");
+    }
+
+  private:
+    const size_t sampleInterval;
+    const uint64_t overhead;
+
+    void report(const char *name, const char *label, size_t n,
+                uint64_t elapsed, std::vector<uint64_t> &samples)
+    {
+        printf("  %-13s %-14s %9ld %9.2f %8.1f",
+               label, name, n, n * 1000.0 / elapsed, double(elapsed) / n);
+
+        if (samples.empty())
+        {
+            printf(" %8s %8s %8s\n", "-", "-", "-");
+            return;
+        }
+
+        std::sort(samples.begin(), samples.end());
+        printf(" %8ld %8ld %8ld\n",
+               samples[samples.size() / 2],
+               samples[(samples.size() * 99) / 100],
+               samples.back());
+    }
+};
+
+
+static void reportFootprint(VTP_PT_HOST &pt, size_t nPages)
+{
+    uint64_t table_pages, free_pages, host_bytes;
+    pt.ptGetFootprint(&table_pages, &free_pages, &host_bytes);
+
+    printf("  %-13s table pages %ld (%ld free), shared %.2f MB, "
+           "host %.2f MB, %.2f bytes/mapping\n",
+           "", table_pages, free_pages,
+           table_pages * 4096 / 1048576.0, host_bytes / 1048576.0,
+           double(table_pages * 4096 + host_bytes) / nPages);
+}
+
+
+static bool benchmark(size_t nPages, MPFVTP_PAGE_SIZE size, bool random,
+                      size_t sampleInterval)
+{
+    uint64_t page_bytes = uint64_t(1) << (12 + 9 * size);
+    char label[32];
+    snprintf(label, sizeof(label), "%-6s %s",
+             (size == MPFVTP_PAGE_4KB ? "4KB" : "2MB"),
+             (random ? "random" : "seq"));
+
+    // Build the set of page VAs in the order they are visited
+    std::vector<btVirtAddr> vas(nPages);
+    if (random)
+    {
+        uint64_t span = 1;
+        while (span < nPages * 64) span <<= 1;
+        while (span * page_bytes > MAX_SPAN) span >>= 1;
+        if (span < nPages)
+        {
+            fprintf(stderr, "Too many pages for the random pattern\n");
+            return false;
+        }
+
+        // Multiplying by an odd constant is a permutation of [0, span),
+        // so the pages are distinct.
+        for (size_t i = 0; i < nPages; i++)
+        {
+            uint64_t idx = (i * 0x9e3779b97f4a7c15ULL) & (span - 1);
+            vas[i] = btVirtAddr(idx * page_bytes);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < nPages; i++)
+        {
+            vas[i] = btVirtAddr(SEQ_BASE + i * page_bytes);
+        }
+    }
+
+    VTP_PT_HOST pt;
+    BENCH bench(sampleInterval);
+    bool ok = true;
+
+    ok &= bench.run("insert", label, vas,
+                    [&](btVirtAddr va)
+                    {
+                        return pt.ptInsertPageMapping(va, pageToPA(uint64_t(va)),
+                                                      size);
+                    });
+    reportFootprint(pt, nPages);
+
+    // Visit translations and removals in a different order than inserts
+    if (random)
+    {
+        std::mt19937_64 rng(1);
+        std::shuffle(vas.begin(), vas.end(), rng);
+    }
+
+    pt.ptResetTranslationCacheStats();
+    ok &= bench.run("translate", label, vas,
+                    [&](btVirtAddr va)
+                    {
+                        btPhysAddr pa;
+                        btVirtAddr off = va + (uint64_t(va) >> 20) % page_bytes;
+                        return pt.ptTranslateVAtoPA(off, &pa) &&
+                               (pa == pageToPA(uint64_t(va)));
+                    });
+
+    uint64_t hits, misses;
+    pt.ptGetTranslationCacheStats(&hits, &misses);
+    printf("  %-13s translation cache %ld hits, %ld misses\n",
+           "", hits, misses);
+
+    ok &= bench.run("remove", label, vas,
+                    [&](btVirtAddr va)
+                    {
+                        return pt.ptRemovePageMapping(va);
+                    });
+    reportFootprint(pt, nPages);
+
+    if (! random)
+    {
+        std::vector<btPhysAddr> pa(nPages);
+        for (size_t i = 0; i < nPages; i++)
+        {
+            pa[i] = pageToPA(uint64_t(vas[i]));
+        }
+
+        ok &= bench.runOnce("insert-range", label, nPages,
+                            [&]()
+                            {
+                                return pt.ptInsertRange(vas[0], &pa[0], nPages,
+                                                        size,
+                                                        MPFVTP_PT_FLAG_ALLOC_START |
+                                                        MPFVTP_PT_FLAG_ALLOC_END);
+                            });
+
+        ok &= bench.runOnce("remove-range", label, nPages,
+                            [&]()
+                            {
+                                return pt.ptRemoveRange(vas[0], ~btWSSize(0));
+                            });
+    }
+
+    return ok;
+}
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [--pages=<n>] [--size=4k|2m|all] [--sample=<n>]\n"
+            "  --pages   Number of mappings (default 1048576)\n"
+            "  --size    Page size to test (default all)\n"
+            "  --sample  Time every n-th operation for latency (default 16)\n",
+            prog);
+    exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t n_pages = 1 << 20;
+    size_t sample_interval = 16;
+    bool test_4k = true;
+    bool test_2m = true;
+
+    static struct option long_options[] =
+    {
+        { "pages",  required_argument, 0, 'p' },
+        { "size",   required_argument, 0, 'z' },
+        { "sample", required_argument, 0, 's' },
+        { 0, 0, 0, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+          case 'p':
+            n_pages = strtoull(optarg, NULL, 0);
+            break;
+          case 'z':
+            test_4k = (strcasecmp(optarg, "4k") == 0) ||
+                      (strcasecmp(optarg, "all") == 0);
+            test_2m = (strcasecmp(optarg, "2m") == 0) ||
+                      (strcasecmp(optarg, "all") == 0);
+            if (! test_4k && ! test_2m) usage(argv[0]);
+            break;
+          case 's':
+            sample_interval = strtoull(optarg, NULL, 0);
+            break;
+          default:
+            usage(argv[0]);
+        }
+    }
+
+    if ((n_pages == 0) || (sample_interval == 0)) usage(argv[0]);
+
+    BENCH::header();
+
+    bool ok = true;
+    for (int s = MPFVTP_PAGE_4KB; s <= MPFVTP_PAGE_2MB; s++)
+    {
+        if ((s == MPFVTP_PAGE_4KB) ? ! test_4k : ! test_2m) continue;
+
+        ok &= benchmark(n_pages, MPFVTP_PAGE_SIZE(s), false, sample_interval);
+        ok &= benchmark(n_pages, MPFVTP_PAGE_SIZE(s), true, sample_interval);
+    }
+
+    if (! ok)
+    {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    return 0;
+}
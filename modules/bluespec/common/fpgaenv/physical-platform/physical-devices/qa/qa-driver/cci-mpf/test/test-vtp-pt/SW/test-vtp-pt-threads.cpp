@@ -0,0 +1,467 @@
+// Copyright(c) 2016, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//****************************************************************************
+/// @file test-vtp-pt-threads.cpp
+/// @brief Scaling of concurrent VTP page table translation
+/// @verbatim
+/// Map a region of 4KB pages and translate addresses in it from 1 to N
+/// threads.  Two patterns are measured:
+///
+///   random - addresses spread over the whole region, so most translations
+///            walk the table.
+///   hot    - each thread cycles over a few pages that stay in the
+///            software translation cache.
+///
+/// Unless --no-writer is given, a writer thread repeatedly maps and
+/// unmaps a separate region while the readers run, alternating between
+/// two physical addresses for each page.  Readers also probe that region,
+/// walking tables that the writer is reclaiming.  A probe made entirely
+/// while the region is mapped must return the current cycle's address,
+/// so a stale translation cache entry is an error.  Every translation is
+/// checked, as are the unmapped hole sizes used to skip ahead in
+/// prefetch.@endverbatim
+//****************************************************************************
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "vtp_pt_host.h"
+
+
+// Base of the region translated by the readers
+static const uint64_t READ_BASE = 1ULL << 40;
+// Base of the region remapped by the writer
+static const uint64_t CHURN_BASE = 1ULL << 41;
+static const size_t CHURN_PAGES = 4096;
+
+// Number of distinct pages touched by each thread in the hot pattern
+static const size_t HOT_PAGES = 16;
+
+
+// Physical addresses are arbitrary, but must be predictable for checking
+static inline btPhysAddr readPA(uint64_t page)
+{
+    return btPhysAddr((page * 7 + 0x100000) << 12);
+}
+
+// Churn pages map to a different PA on odd and even writer cycles
+static inline btPhysAddr churnPA(uint64_t page, uint64_t cycle)
+{
+    return btPhysAddr((page + 0x10000000 + ((cycle & 1) << 24)) << 12);
+}
+
+//
+// Writer state.  Odd values mean the churn region is fully mapped for
+// writer cycle (state >> 1).  The state is even while pages are being
+// added or removed.
+//
+static std::atomic<uint64_t> churnState(0);
+
+static inline uint64_t xorshift(uint64_t &s)
+{
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+typedef enum
+{
+    PATTERN_RANDOM,
+    PATTERN_HOT
+}
+t_pattern;
+
+typedef struct
+{
+    uint64_t translations;
+    uint64_t errors;
+    char pad[48];
+}
+t_thread_result;
+
+
+static void reader(VTP_PT_HOST *pt,
+                   size_t nPages,
+                   t_pattern pattern,
+                   bool probeChurn,
+                   uint32_t tid,
+                   std::atomic<bool> *stop,
+                   t_thread_result *result)
+{
+    uint64_t seed = 0x9e3779b97f4a7c15ULL * (tid + 1);
+    uint64_t n = 0;
+    uint64_t errors = 0;
+
+    while (! stop->load(std::memory_order_relaxed))
+    {
+        // Check the stop flag only every few translations
+        for (int i = 0; i < 256; i++)
+        {
+            uint64_t r = xorshift(seed);
+            uint64_t page;
+
+            if (pattern == PATTERN_HOT)
+            {
+                page = (tid * HOT_PAGES + (r % HOT_PAGES)) % nPages;
+            }
+            else
+            {
+                page = r % nPages;
+            }
+
+            btVirtAddr va = btVirtAddr(READ_BASE + (page << 12) + (r >> 52));
+            btPhysAddr pa;
+            if (! pt->ptTranslateVAtoPA(va, &pa) || (pa != readPA(page)))
+            {
+                errors += 1;
+            }
+
+            // The churn region may or may not be mapped, but any
+            // translation found must be correct.  If the writer state
+            // was unchanged and mapped for the whole probe then the
+            // translation must be from the current cycle.
+            if (probeChurn && ((r & 0xf00) == 0))
+            {
+                page = (r >> 16) % CHURN_PAGES;
+                va = btVirtAddr(CHURN_BASE + (page << 12));
+
+                uint64_t s0 = churnState.load(std::memory_order_acquire);
+                bool found = pt->ptTranslateVAtoPA(va, &pa);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                uint64_t s1 = churnState.load(std::memory_order_relaxed);
+
+                if ((s0 == s1) && (s0 & 1))
+                {
+                    if (! found || (pa != churnPA(page, s0 >> 1)))
+                    {
+                        errors += 1;
+                    }
+                }
+                else if (found && (pa != churnPA(page, 0)) &&
+                         (pa != churnPA(page, 1)))
+                {
+                    errors += 1;
+                }
+            }
+        }
+
+        n += 256;
+    }
+
+    result->translations = n;
+    result->errors = errors;
+}
+
+
+static void writer(VTP_PT_HOST *pt,
+                   std::atomic<bool> *stop,
+                   uint64_t *cycles,
+                   uint64_t *errors)
+{
+    std::vector<btPhysAddr> pa[2];
+    for (int c = 0; c < 2; c++)
+    {
+        pa[c].resize(CHURN_PAGES);
+        for (size_t i = 0; i < CHURN_PAGES; i++)
+        {
+            pa[c][i] = churnPA(i, c);
+        }
+    }
+
+    uint64_t cycle = churnState.load() >> 1;
+    while (! stop->load(std::memory_order_relaxed))
+    {
+        cycle += 1;
+
+        if (! pt->ptInsertRange(btVirtAddr(CHURN_BASE), &pa[cycle & 1][0],
+                                CHURN_PAGES, MPFVTP_PAGE_4KB,
+                                MPFVTP_PT_FLAG_ALLOC_START |
+                                MPFVTP_PT_FLAG_ALLOC_END))
+        {
+            *errors += 1;
+            return;
+        }
+
+        churnState.store(2 * cycle + 1, std::memory_order_release);
+
+        // Mark the region unstable before any translation is removed
+        churnState.store(2 * cycle + 2, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        if (! pt->ptRemoveRange(btVirtAddr(CHURN_BASE), ~btWSSize(0)))
+        {
+            *errors += 1;
+            return;
+        }
+
+        *cycles += 1;
+    }
+}
+
+
+//
+// A cached translation must not survive removal of the page.  Map a page,
+// translate it so that it is cached, then remove it and map the same VA
+// to a new PA.
+//
+static bool checkRemap(VTP_PT_HOST *pt)
+{
+    btVirtAddr va = btVirtAddr(CHURN_BASE);
+    btPhysAddr pa;
+    bool ok = true;
+
+    for (int c = 0; c < 4; c++)
+    {
+        ok = ok && pt->ptInsertPageMapping(va, churnPA(0, c), MPFVTP_PAGE_4KB);
+        for (int i = 0; ok && (i < 2); i++)
+        {
+            ok = pt->ptTranslateVAtoPA(va + 64 * i, &pa) &&
+                 (pa == churnPA(0, c));
+        }
+
+        ok = ok && pt->ptRemovePageMapping(va);
+        ok = ok && ! pt->ptTranslateVAtoPA(va, &pa);
+    }
+
+    if (! ok)
+    {
+        fprintf(stderr, "Stale translation after remapping VA %p\n", va);
+    }
+
+    return ok;
+}
+
+
+//
+// ptUnmappedSize() must report the span of the first missing table entry.
+// Map a single page and probe holes at each level around it.
+//
+static bool checkHoles(VTP_PT_HOST *pt)
+{
+    const uint64_t base = 3ULL << 40;
+    const uint64_t page = base + (1ULL << 30) + (1ULL << 21) + (1ULL << 12);
+
+    struct { uint64_t va; btWSSize hole; } probes[] =
+    {
+        { page,                           0 },
+        { page - (1ULL << 12),            1ULL << 12 },
+        { base + (1ULL << 30),            1ULL << 21 },
+        { base,                           1ULL << 30 },
+        { base + (1ULL << 39),            1ULL << 39 }
+    };
+
+    bool ok = pt->ptInsertPageMapping(btVirtAddr(page), churnPA(0, 0),
+                                      MPFVTP_PAGE_4KB);
+    for (size_t i = 0; ok && (i < sizeof(probes) / sizeof(probes[0])); i++)
+    {
+        btWSSize hole = pt->ptUnmappedSize(btVirtAddr(probes[i].va));
+        if (hole != probes[i].hole)
+        {
+            fprintf(stderr, "Hole at VA 0x%lx is 0x%lx bytes, expected 0x%lx\n",
+                    probes[i].va, uint64_t(hole), uint64_t(probes[i].hole));
+            ok = false;
+        }
+    }
+
+    ok = ok && pt->ptRemovePageMapping(btVirtAddr(page));
+    ok = ok && (pt->ptUnmappedSize(btVirtAddr(page)) != 0);
+
+    return ok;
+}
+
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [--pages=<n>] [--threads=<n>] [--seconds=<n>] [--no-writer]\n",
+            prog);
+    exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t n_pages = 1 << 20;
+    uint32_t max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    double seconds = 1.0;
+    bool use_writer = true;
+
+    static struct option long_options[] =
+    {
+        { "pages",     required_argument, 0, 'p' },
+        { "threads",   required_argument, 0, 't' },
+        { "seconds",   required_argument, 0, 's' },
+        { "no-writer", no_argument,       0, 'n' },
+        { 0, 0, 0, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+          case 'p':
+            n_pages = strtoull(optarg, NULL, 0);
+            break;
+          case 't':
+            max_threads = strtoul(optarg, NULL, 0);
+            break;
+          case 's':
+            seconds = strtod(optarg, NULL);
+            break;
+          case 'n':
+            use_writer = false;
+            break;
+          default:
+            usage(argv[0]);
+        }
+    }
+
+    if ((n_pages == 0) || (max_threads == 0)) usage(argv[0]);
+
+    VTP_PT_HOST pt;
+
+    std::vector<btPhysAddr> pa(n_pages);
+    for (size_t i = 0; i < n_pages; i++)
+    {
+        pa[i] = readPA(i);
+    }
+
+    if (! pt.ptInsertRange(btVirtAddr(READ_BASE), &pa[0], n_pages,
+                           MPFVTP_PAGE_4KB,
+                           MPFVTP_PT_FLAG_ALLOC_START | MPFVTP_PT_FLAG_ALLOC_END))
+    {
+        fprintf(stderr, "Failed to map %ld pages\n", n_pages);
+        exit(1);
+    }
+
+    if (! checkRemap(&pt))
+    {
+        printf("FAILED: remap check\n");
+        return 1;
+    }
+
+    if (! checkHoles(&pt))
+    {
+        printf("FAILED: hole check\n");
+        return 1;
+    }
+
+    printf("# %ld mapped 4KB pages, %s writer\n",
+           n_pages, (use_writer ? "with" : "no"));
+    printf("# %-8s %7s %12s %12s %10s %8s\n",
+           "pattern", "threads", "Mxlate/s", "per thread", "wr cycles", "errors");
+
+    uint64_t total_errors = 0;
+    const char *pattern_names[] = { "random", "hot" };
+
+    for (int p = PATTERN_RANDOM; p <= PATTERN_HOT; p++)
+    {
+        uint32_t n_threads = 1;
+        while (true)
+        {
+            std::atomic<bool> stop(false);
+            std::vector<t_thread_result> results(n_threads);
+            std::vector<std::thread> threads;
+
+            uint64_t wr_cycles = 0;
+            uint64_t wr_errors = 0;
+            std::thread wr_thread;
+            if (use_writer)
+            {
+                wr_thread = std::thread(writer, &pt, &stop,
+                                        &wr_cycles, &wr_errors);
+            }
+
+            double start = now();
+            for (uint32_t t = 0; t < n_threads; t++)
+            {
+                threads.push_back(std::thread(reader, &pt, n_pages,
+                                              t_pattern(p), use_writer, t,
+                                              &stop, &results[t]));
+            }
+
+            usleep(useconds_t(seconds * 1000000));
+            stop = true;
+
+            for (uint32_t t = 0; t < n_threads; t++)
+            {
+                threads[t].join();
+            }
+            double elapsed = now() - start;
+
+            if (use_writer)
+            {
+                wr_thread.join();
+            }
+
+            uint64_t n = 0;
+            uint64_t errors = wr_errors;
+            for (uint32_t t = 0; t < n_threads; t++)
+            {
+                n += results[t].translations;
+                errors += results[t].errors;
+            }
+            total_errors += errors;
+
+            double rate = n / elapsed / 1000000.0;
+            printf("  %-8s %7d %12.2f %12.2f %10ld %8ld\n",
+                   pattern_names[p], n_threads, rate, rate / n_threads,
+                   wr_cycles, errors);
+
+            if (n_threads == max_threads) break;
+            n_threads = (2 * n_threads < max_threads) ? 2 * n_threads : max_threads;
+        }
+    }
+
+    uint64_t hits, misses;
+    pt.ptGetTranslationCacheStats(&hits, &misses);
+    printf("# Translation cache: %ld hits, %ld misses\n", hits, misses);
+
+    if (total_errors)
+    {
+        printf("FAILED: %ld bad translations\n", total_errors);
+        return 1;
+    }
+
+    return 0;
+}
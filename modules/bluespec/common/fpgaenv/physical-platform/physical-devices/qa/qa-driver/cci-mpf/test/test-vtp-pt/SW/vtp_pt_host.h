@@ -0,0 +1,90 @@
+// Copyright(c) 2016, Intel Corporation
+//
+// Redistribution  and  use  in source  and  binary  forms,  with  or  without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of  source code  must retain the  above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name  of Intel Corporation  nor the names of its contributors
+//   may be used to  endorse or promote  products derived  from this  software
+//   without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,  BUT NOT LIMITED TO,  THE
+// IMPLIED WARRANTIES OF  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT  SHALL THE COPYRIGHT OWNER  OR CONTRIBUTORS BE
+// LIABLE  FOR  ANY  DIRECT,  INDIRECT,  INCIDENTAL,  SPECIAL,  EXEMPLARY,  OR
+// CONSEQUENTIAL  DAMAGES  (INCLUDING,  BUT  NOT LIMITED  TO,  PROCUREMENT  OF
+// SUBSTITUTE GOODS OR SERVICES;  LOSS OF USE,  DATA, OR PROFITS;  OR BUSINESS
+// INTERRUPTION)  HOWEVER CAUSED  AND ON ANY THEORY  OF LIABILITY,  WHETHER IN
+// CONTRACT,  STRICT LIABILITY,  OR TORT  (INCLUDING NEGLIGENCE  OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//****************************************************************************
+/// @file vtp_pt_host.h
+/// @brief Host-memory page table for VTP page table benchmarks.
+/// @verbatim
+/// MPFVTP_PAGE_TABLE expects its owner to provide memory shared with the
+/// FPGA.  The benchmarks here run without an FPGA, so table pages are
+/// simply mmap()ed host memory and the "physical" address of a page is
+/// its virtual address.  Nothing walks the table in hardware, so there
+/// is nothing to invalidate.@endverbatim
+//****************************************************************************
+#ifndef __VTP_PT_HOST_H__
+#define __VTP_PT_HOST_H__
+
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cci_mpf_shim_vtp_pt.h"
+
+using namespace AAL;
+
+
+class VTP_PT_HOST : public MPFVTP_PAGE_TABLE
+{
+  public:
+    VTP_PT_HOST()
+    {
+        if (! ptInitialize())
+        {
+            fprintf(stderr, "Failed to initialize page table\n");
+            exit(1);
+        }
+    }
+
+    ~VTP_PT_HOST()
+    {
+        ptTerminate();
+    }
+
+  private:
+    btVirtAddr ptAllocSharedPage(btWSSize length, btPhysAddr* pa)
+    {
+        void* va = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (va == MAP_FAILED)
+        {
+            return NULL;
+        }
+
+        *pa = btPhysAddr(va);
+        return btVirtAddr(va);
+    }
+
+    void ptFreeSharedPage(btVirtAddr va, btWSSize length)
+    {
+        munmap(va, length);
+    }
+
+    bool ptInvalVAMapping(btVirtAddr)
+    {
+        return true;
+    }
+};
+
+#endif // __VTP_PT_HOST_H__
@@ -0,0 +1,281 @@
+//
+// Copyright (c) 2016, Intel Corporation
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// Neither the name of the Intel Corporation nor the names of its contributors
+// may be used to endorse or promote products derived from this software
+// without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <iostream>
+
+#include "awb/provides/qa_driver_host_channels.h"
+
+using namespace std;
+
+// Size of the buffers handed to the file writer thread
+#define TRACE_BUFFER_BYTES (4 * 1024 * 1024)
+
+
+static inline uint64_t
+traceNowNs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return uint64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
+
+// ============================================
+//           Trace writer
+// ============================================
+
+QA_CHANNEL_TRACE_WRITER_CLASS::QA_CHANNEL_TRACE_WRITER_CLASS() :
+    traceFile(NULL),
+    curBuffer(NULL)
+{
+    isOpen = false;
+}
+
+
+QA_CHANNEL_TRACE_WRITER_CLASS::~QA_CHANNEL_TRACE_WRITER_CLASS()
+{
+    Close();
+
+    TRACE_BUFFER* buf;
+    while (freeBuffers.try_pop(buf))
+    {
+        delete buf;
+    }
+}
+
+
+bool
+QA_CHANNEL_TRACE_WRITER_CLASS::Open(const char* path)
+{
+    if (isOpen) return false;
+
+    traceFile = fopen(path, "wb");
+    if (traceFile == NULL)
+    {
+        cerr << "QA channel trace: failed to open " << path << endl;
+        return false;
+    }
+
+    fwrite(QA_CHANNEL_TRACE_MAGIC, 1, 8, traceFile);
+
+    curBuffer = newBuffer();
+
+    if (pthread_create(&fileWriterThread, NULL, FileWriter, this))
+    {
+        perror("pthread_create, QA channel trace writer:");
+        exit(1);
+    }
+
+    isOpen = true;
+    return true;
+}
+
+
+void
+QA_CHANNEL_TRACE_WRITER_CLASS::Close()
+{
+    if (! isOpen.fetch_and_store(false)) return;
+
+    // Write the partial buffer and stop the file writer
+    {
+        tbb::spin_mutex::scoped_lock lock(curBufferLock);
+        fullBuffers.push(curBuffer);
+        curBuffer = NULL;
+    }
+
+    fullBuffers.push(NULL);
+    pthread_join(fileWriterThread, NULL);
+
+    fclose(traceFile);
+    traceFile = NULL;
+}
+
+
+void
+QA_CHANNEL_TRACE_WRITER_CLASS::Record(
+    QA_CHANNEL_TRACE_DIRECTION dir,
+    const void* data0,
+    size_t bytes0,
+    const void* data1,
+    size_t bytes1)
+{
+    QA_CHANNEL_TRACE_RECORD_HDR hdr;
+    hdr.timeNs = traceNowNs();
+    hdr.direction = dir;
+    hdr.nBytes = bytes0 + bytes1;
+
+    size_t rec_bytes = sizeof(hdr) + hdr.nBytes;
+
+    tbb::spin_mutex::scoped_lock lock(curBufferLock);
+
+    // Closed while waiting for the lock?
+    if (curBuffer == NULL) return;
+
+    // Hand off the current buffer if the record doesn't fit.  Records
+    // larger than a buffer simply grow the next one.
+    if ((curBuffer->size() + rec_bytes > TRACE_BUFFER_BYTES) &&
+        ! curBuffer->empty())
+    {
+        fullBuffers.push(curBuffer);
+        curBuffer = newBuffer();
+    }
+
+    size_t pos = curBuffer->size();
+    curBuffer->resize(pos + rec_bytes);
+    uint8_t* dst = &(*curBuffer)[pos];
+
+    memcpy(dst, &hdr, sizeof(hdr));
+    dst += sizeof(hdr);
+    if (bytes0 != 0)
+    {
+        memcpy(dst, data0, bytes0);
+    }
+    if (bytes1 != 0)
+    {
+        memcpy(dst + bytes0, data1, bytes1);
+    }
+}
+
+
+QA_CHANNEL_TRACE_WRITER_CLASS::TRACE_BUFFER*
+QA_CHANNEL_TRACE_WRITER_CLASS::newBuffer()
+{
+    TRACE_BUFFER* buf;
+    if (! freeBuffers.try_pop(buf))
+    {
+        buf = new TRACE_BUFFER();
+        buf->reserve(TRACE_BUFFER_BYTES);
+    }
+
+    buf->clear();
+    return buf;
+}
+
+
+void*
+QA_CHANNEL_TRACE_WRITER_CLASS::FileWriter(void *argv)
+{
+    QA_CHANNEL_TRACE_WRITER trace = QA_CHANNEL_TRACE_WRITER(argv);
+
+    while (true)
+    {
+        TRACE_BUFFER* buf;
+        trace->fullBuffers.pop(buf);
+
+        if (buf == NULL) break;
+
+        if (! buf->empty())
+        {
+            fwrite(&(*buf)[0], 1, buf->size(), trace->traceFile);
+        }
+
+        trace->freeBuffers.push(buf);
+    }
+
+    return NULL;
+}
+
+
+// ============================================
+//           Trace reader
+// ============================================
+
+QA_CHANNEL_TRACE_READER_CLASS::QA_CHANNEL_TRACE_READER_CLASS() :
+    traceFile(NULL)
+{
+}
+
+
+QA_CHANNEL_TRACE_READER_CLASS::~QA_CHANNEL_TRACE_READER_CLASS()
+{
+    Close();
+}
+
+
+bool
+QA_CHANNEL_TRACE_READER_CLASS::Open(const char* path)
+{
+    traceFile = fopen(path, "rb");
+    if (traceFile == NULL)
+    {
+        cerr << "QA channel trace: failed to open " << path << endl;
+        return false;
+    }
+
+    char magic[8];
+    if ((fread(magic, 1, 8, traceFile) != 8) ||
+        (memcmp(magic, QA_CHANNEL_TRACE_MAGIC, 8) != 0))
+    {
+        cerr << "QA channel trace: " << path << " is not a trace file" << endl;
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+
+void
+QA_CHANNEL_TRACE_READER_CLASS::Close()
+{
+    if (traceFile != NULL)
+    {
+        fclose(traceFile);
+        traceFile = NULL;
+    }
+}
+
+
+bool
+QA_CHANNEL_TRACE_READER_CLASS::Next(
+    QA_CHANNEL_TRACE_RECORD_HDR& hdr,
+    std::vector<uint8_t>& data)
+{
+    if (traceFile == NULL) return false;
+
+    if (fread(&hdr, sizeof(hdr), 1, traceFile) != 1)
+    {
+        return false;
+    }
+
+    data.resize(hdr.nBytes);
+    if ((hdr.nBytes != 0) &&
+        (fread(&data[0], 1, hdr.nBytes, traceFile) != hdr.nBytes))
+    {
+        cerr << "QA channel trace: truncated record" << endl;
+        return false;
+    }
+
+    return true;
+}
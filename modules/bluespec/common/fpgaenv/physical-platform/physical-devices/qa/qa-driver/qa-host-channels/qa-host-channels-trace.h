@@ -0,0 +1,148 @@
+//
+// Copyright (c) 2016, Intel Corporation
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// Neither the name of the Intel Corporation nor the names of its contributors
+// may be used to endorse or promote products derived from this software
+// without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __QA_HOST_CHANNELS_TRACE__
+#define __QA_HOST_CHANNELS_TRACE__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+
+#include "tbb/atomic.h"
+#include "tbb/concurrent_queue.h"
+#include "tbb/spin_mutex.h"
+
+
+//
+// Binary trace of host channel traffic.
+//
+// The file begins with the 8 byte magic string QA_CHANNEL_TRACE_MAGIC.
+// Each record is a QA_CHANNEL_TRACE_RECORD_HDR followed by nBytes of data,
+// exactly as they crossed the channel.  Outbound records hold one UMF
+// message (header chunk followed by the padded body).  Inbound records
+// hold a span of the read ring as it was decoded, which may include
+// filler chunks and partial messages.  Flush records have no data and mark
+// the points at which the channel padded the outbound ring to a line
+// boundary.
+//
+#define QA_CHANNEL_TRACE_MAGIC "QACHTRC1"
+
+typedef enum
+{
+    QA_CHANNEL_TRACE_OUTBOUND = 0,      // Host to FPGA
+    QA_CHANNEL_TRACE_INBOUND = 1,       // FPGA to host
+    QA_CHANNEL_TRACE_FLUSH = 2          // Host to FPGA line padding
+}
+QA_CHANNEL_TRACE_DIRECTION;
+
+typedef struct
+{
+    uint64_t timeNs;                    // CLOCK_MONOTONIC
+    uint32_t direction;                 // QA_CHANNEL_TRACE_DIRECTION
+    uint32_t nBytes;
+}
+QA_CHANNEL_TRACE_RECORD_HDR;
+
+
+// ==============================================
+//          Trace writer
+// ==============================================
+
+//
+// Records are copied into large buffers.  Full buffers are written to the
+// file by a background thread so that recording costs a copy on the
+// channel's hot path.
+//
+typedef class QA_CHANNEL_TRACE_WRITER_CLASS* QA_CHANNEL_TRACE_WRITER;
+class QA_CHANNEL_TRACE_WRITER_CLASS
+{
+  private:
+    typedef std::vector<uint8_t> TRACE_BUFFER;
+
+    FILE* traceFile;
+    tbb::atomic<bool> isOpen;
+
+    // Buffer currently being filled
+    TRACE_BUFFER* curBuffer;
+    tbb::spin_mutex curBufferLock;
+
+    // Full buffers, waiting to be written.  NULL stops the file writer.
+    tbb::concurrent_bounded_queue<TRACE_BUFFER*> fullBuffers;
+    // Written buffers, available for reuse
+    tbb::concurrent_queue<TRACE_BUFFER*> freeBuffers;
+
+    pthread_t fileWriterThread;
+
+    static void* FileWriter(void *argv);
+
+    TRACE_BUFFER* newBuffer();
+
+  public:
+    QA_CHANNEL_TRACE_WRITER_CLASS();
+    ~QA_CHANNEL_TRACE_WRITER_CLASS();
+
+    bool Open(const char* path);
+    void Close();
+
+    bool IsOpen() const { return isOpen; }
+
+    //
+    // Record a message composed of up to two pieces (e.g. a header and
+    // a body).  Safe to call from multiple threads.
+    //
+    void Record(QA_CHANNEL_TRACE_DIRECTION dir,
+                const void* data0, size_t bytes0,
+                const void* data1 = NULL, size_t bytes1 = 0);
+};
+
+
+// ==============================================
+//          Trace reader
+// ==============================================
+
+typedef class QA_CHANNEL_TRACE_READER_CLASS* QA_CHANNEL_TRACE_READER;
+class QA_CHANNEL_TRACE_READER_CLASS
+{
+  private:
+    FILE* traceFile;
+
+  public:
+    QA_CHANNEL_TRACE_READER_CLASS();
+    ~QA_CHANNEL_TRACE_READER_CLASS();
+
+    bool Open(const char* path);
+    void Close();
+
+    // Read the next record.  Returns false at the end of the trace.
+    bool Next(QA_CHANNEL_TRACE_RECORD_HDR& hdr, std::vector<uint8_t>& data);
+};
+
+#endif
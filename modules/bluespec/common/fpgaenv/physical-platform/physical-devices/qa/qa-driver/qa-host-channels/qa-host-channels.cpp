@@ -43,8 +43,11 @@
 #include <signal.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <iostream>
 #include <atomic>
+#include <vector>
+#include <algorithm>
 
 #include "awb/provides/qa_driver.h"
 
@@ -59,8 +62,8 @@
 
 using namespace std;
 
-// Handle to the QA device.  Useful when debugging.
-static QA_HOST_CHANNELS_DEVICE_CLASS *debugQADev;
+// Handles to the QA devices, one per AFU.  Useful when debugging.
+static std::vector<QA_HOST_CHANNELS_DEVICE_CLASS*> debugQADevs;
 
 // Receiver thread in loopback test
 static void* LoopbackTestRecv(void *arg);
@@ -81,17 +84,22 @@ QA_HOST_CHANNELS_DEVICE_CLASS::QA_HOST_CHANNELS_DEVICE_CLASS(
         readFillNext(0),
         readNext(0),
         readBytesAvail(0),
-        enableTests(false)
+        enableTests(false),
+        replayTrace(NULL),
+        replayRealTime(false)
 {
     initReadComplete = false;
     initWriteComplete = false;
 
-    debugQADev = this;
+    debugQADevs.push_back(this);
 }
 
 
 QA_HOST_CHANNELS_DEVICE_CLASS::~QA_HOST_CHANNELS_DEVICE_CLASS()
 {
+    debugQADevs.erase(std::remove(debugQADevs.begin(), debugQADevs.end(), this),
+                      debugQADevs.end());
+
     // cleanup
     Cleanup();
 }
@@ -119,9 +127,20 @@ QA_HOST_CHANNELS_DEVICE_CLASS::Init()
                ctrlBuffer->physicalAddress, ctrlBuffer->physicalAddress / CL(1));
     }
 
+    afu.MarkStartupPhase("Channel CTRL buffer allocated");
+
     // Wait for the hardware to respond by writing the buffer sizes
     // into CTRL line 0.
-    while (ReadCTRL32(0) == 0) {};
+    uint32_t trips = 0;
+    while (ReadCTRL32(0) == 0)
+    {
+        if (qaBackoff(trips))
+        {
+            printf("Waiting for host channel CTRL handshake...\n");
+        }
+    }
+
+    afu.MarkStartupPhase("Channel CTRL handshake");
 
     // How big are the FIFO buffers supposed to be?  Sizes are determined
     // in the hardware configuration and communicated in the CTRL.  The hardware
@@ -140,9 +159,11 @@ QA_HOST_CHANNELS_DEVICE_CLASS::Init()
         printf("FIFO to host buffer bytes:    %d\n", readBufferBytes);
     }
 
-    // create buffers
-    readBuffer = afu.CreateSharedBuffer(readBufferBytes);
-    writeBuffer = afu.CreateSharedBuffer(writeBufferBytes);
+    // create buffers.  The ring buffers don't need to be zeroed.  The
+    // FPGA fills read buffer lines before advancing the newest index and
+    // the host fills write buffer lines before advancing its own index.
+    readBuffer = afu.CreateSharedBuffer(readBufferBytes, false);
+    writeBuffer = afu.CreateSharedBuffer(writeBufferBytes, false);
 
     if (readBuffer == NULL)
     {
@@ -156,6 +177,8 @@ QA_HOST_CHANNELS_DEVICE_CLASS::Init()
         exit(1);
     }
 
+    afu.MarkStartupPhase("Channel ring buffers allocated");
+
     // Initialize pointers to the buffers
     readBufferStart = (uint8_t *)readBuffer->virtualAddress;
     readBufferEnd = (uint8_t *)(readBuffer->virtualAddress + readBufferBytes);
@@ -189,10 +212,11 @@ QA_HOST_CHANNELS_DEVICE_CLASS::Init()
     initReadComplete = true;
     initWriteComplete = true;
     
+    afu.MarkStartupPhase("Channel ring buffers configured");
+
     // Run AFU tests
     afu.RunTests(this);
 
-    sleep(1);
     if (enableTests)
     {
         TestSend();
@@ -200,8 +224,16 @@ QA_HOST_CHANNELS_DEVICE_CLASS::Init()
         TestLoopback();
     }
 
+    if (replayTrace != NULL)
+    {
+        Replay(replayTrace, replayRealTime);
+    }
+
     // Enable AFU (including user connection)
     afu.WriteCSR(CSR_HC_BASE_ADDR + CSR_HC_EN, 3);
+
+    afu.MarkStartupPhase("Channel enabled");
+    afu.PrintStartupTimeline();
 }
 
 void
@@ -268,9 +300,10 @@ QA_HOST_CHANNELS_DEVICE_CLASS::Read(
         return nBytes;
     }
 
+    uint32_t trips = 0;
     while (!initReadComplete)
     {
-        sleep(1);
+        qaBackoff(trips);
     }
 
     if (QA_HOST_CHANNELS_DEBUG)
@@ -321,6 +354,53 @@ QA_HOST_CHANNELS_DEVICE_CLASS::Read(
 }
 
 
+//
+// Return a pointer to the available data without consuming it.
+//
+size_t
+QA_HOST_CHANNELS_DEVICE_CLASS::ReadPeek(
+    const void** buf,
+    bool block)
+{
+    *buf = readNext;
+
+    if (readBytesAvail != 0)
+    {
+        return readBytesAvail;
+    }
+
+    uint32_t trips = 0;
+    while (!initReadComplete)
+    {
+        if (! block) return 0;
+        qaBackoff(trips);
+    }
+
+    while (! Probe())
+    {
+        if (! block) return 0;
+    }
+
+    // Only the contiguous region up to the end of the ring is returned.
+    // Data following a wrap is found by the next call.
+    if (readNext <= readFillNext)
+    {
+        readBytesAvail = readFillNext - readNext;
+    }
+    else
+    {
+        readBytesAvail = readBufferEnd - readNext;
+    }
+
+    if (QA_HOST_CHANNELS_DEBUG)
+    {
+        printf("READ PEEK %d bytes at %p\n", readBytesAvail, readNext);
+    }
+
+    return readBytesAvail;
+}
+
+
 //
 // Write a message to the FPGA.
 //
@@ -331,14 +411,13 @@ QA_HOST_CHANNELS_DEVICE_CLASS::Write(
 {
     if (nBytes == 0) return;
 
+    uint32_t trips = 0;
     while (!initWriteComplete)
     {
-        if (QA_HOST_CHANNELS_DEBUG)
+        if (qaBackoff(trips) && QA_HOST_CHANNELS_DEBUG)
         {
             printf("WRITE: waiting for init complete\n");
         }
-
-        sleep(1);
     }
 
     if (QA_HOST_CHANNELS_DEBUG)
@@ -631,6 +710,136 @@ QA_HOST_CHANNELS_DEVICE_CLASS::TestLoopback()
 }
 
 
+//
+// Replay --
+//   Send the outbound messages in a recorded trace to the FPGA.  The FPGA
+//   is put in SINK mode and drops the data.  Inbound traffic can't be
+//   regenerated by the FPGA, so inbound records are only counted.
+//
+//   The recorded bytes are sent unmodified and the channel is flushed
+//   where the recording flushed.  SINK mode is given the total line
+//   count to find the end of the trace instead of a marker bit.
+//
+void
+QA_HOST_CHANNELS_DEVICE_CLASS::Replay(
+    const char* tracePath,
+    bool realTime)
+{
+    QA_CHANNEL_TRACE_READER_CLASS trace;
+    if (! trace.Open(tracePath)) return;
+
+    QA_CHANNEL_TRACE_RECORD_HDR hdr;
+    std::vector<uint8_t> data;
+
+    // Count the lines the trace will fill, starting from a line boundary
+    Flush();
+
+    uint64_t ring_bytes = 0;
+    while (trace.Next(hdr, data))
+    {
+        if (hdr.direction == QA_CHANNEL_TRACE_OUTBOUND)
+        {
+            ring_bytes += hdr.nBytes;
+        }
+        else if (hdr.direction == QA_CHANNEL_TRACE_FLUSH)
+        {
+            ring_bytes = (ring_bytes + CL(1) - 1) & ~uint64_t(CL(1) - 1);
+        }
+    }
+    uint64_t lines = (ring_bytes + CL(1) - 1) / CL(1);
+
+    trace.Close();
+    if (lines == 0)
+    {
+        printf("REPLAY %s: no outbound traffic\n", tracePath);
+        return;
+    }
+
+    if (lines >= (uint64_t(1) << 30))
+    {
+        printf("REPLAY %s: trace is too large (%ld lines)\n", tracePath, lines);
+        return;
+    }
+
+    if (! trace.Open(tracePath)) return;
+
+    printf("REPLAY %s to FPGA (%s)...\n", tracePath,
+           realTime ? "recorded timing" : "maximum speed");
+
+    // The FPGA will write to CTRL line 0.  Clear it first.
+    memset((void*)CTRLAddress(0), 0, CL(1));
+
+    // Put the FPGA in SINK mode, ending after the trace's lines.
+    afu.WriteCSR(CSR_HC_BASE_ADDR + CSR_HC_ENABLE_TEST, (lines << 2) | 1);
+
+    // Wait for mode change.
+    while (ReadCTRL32(0) == 0) ;
+
+    uint64_t out_msgs = 0;
+    uint64_t out_bytes = 0;
+    uint64_t in_records = 0;
+    uint64_t in_bytes = 0;
+    uint64_t first_time = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t start_ns = uint64_t(start.tv_sec) * 1000000000 + start.tv_nsec;
+
+    while (trace.Next(hdr, data))
+    {
+        if (hdr.direction == QA_CHANNEL_TRACE_FLUSH)
+        {
+            Flush();
+            continue;
+        }
+
+        if (hdr.direction != QA_CHANNEL_TRACE_OUTBOUND)
+        {
+            in_records += 1;
+            in_bytes += hdr.nBytes;
+            continue;
+        }
+
+        if (out_msgs == 0)
+        {
+            first_time = hdr.timeNs;
+        }
+
+        if (realTime)
+        {
+            uint64_t target = start_ns + (hdr.timeNs - first_time);
+            struct timespec now;
+            do
+            {
+                clock_gettime(CLOCK_MONOTONIC, &now);
+            }
+            while (uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec < target);
+        }
+
+        Write(&data[0], hdr.nBytes);
+
+        out_msgs += 1;
+        out_bytes += hdr.nBytes;
+    }
+
+    Flush();
+
+    // The FPGA sends one message when it has consumed the last line
+    uint64_t *msg = new uint64_t[CL(1) / sizeof(uint64_t)];
+    Read(msg, CL(1));
+    delete[] msg;
+
+    struct timespec finish;
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    uint64_t finish_ns = uint64_t(finish.tv_sec) * 1000000000 + finish.tv_nsec;
+
+    double t = (finish_ns - start_ns) / 1000000000.0;
+    printf(" *** Replayed %ld messages, %ld bytes in %.6f seconds (%.3f GB/s)\n",
+           out_msgs, out_bytes, t, (out_bytes / 1073741824.0) / t);
+    printf(" *** Trace also held %ld inbound records, %ld bytes (not replayed)\n",
+           in_records, in_bytes);
+}
+
 static void* LoopbackTestRecv(void *arg)
 {
     QA_HOST_CHANNELS_DEVICE dev = QA_HOST_CHANNELS_DEVICE(arg);
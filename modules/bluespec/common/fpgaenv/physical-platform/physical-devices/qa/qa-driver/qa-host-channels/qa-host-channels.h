@@ -38,6 +38,8 @@
 
 #include "tbb/atomic.h"
 
+#include "qa-host-channels-trace.h"
+
 
 //
 // CTRL offsets for various state.  THESE MUST MATCH THE VALUES IN
@@ -98,6 +100,10 @@ class QA_HOST_CHANNELS_DEVICE_CLASS: public PLATFORMS_MODULE_CLASS
 
     bool        enableTests;
 
+    // Trace to replay during Init()
+    const char* replayTrace;
+    bool        replayRealTime;
+
   public:
     QA_HOST_CHANNELS_DEVICE_CLASS(PLATFORMS_MODULE p, AFU_CLASS& afuDev);
     ~QA_HOST_CHANNELS_DEVICE_CLASS();
@@ -110,12 +116,27 @@ class QA_HOST_CHANNELS_DEVICE_CLASS: public PLATFORMS_MODULE_CLASS
     // Run tests during Init()
     void EnableTests() { enableTests = true; }
 
+    // Replay a recorded trace during Init()
+    void EnableReplay(const char* tracePath, bool realTime)
+    {
+        replayTrace = tracePath;
+        replayRealTime = realTime;
+    }
+
     // Read nBytes from the FPGA.  If block is true then the call blocks
     // until all requested bytes have been received.  If block is false
     // then return whatever data is available.  The returned value is
     // the number of bytes actually read.
     size_t Read(void* buf, size_t nBytes, bool block = true);
 
+    // Zero-copy read.  ReadPeek() returns in *buf a pointer to all the
+    // contiguous data already available in the ring, without consuming
+    // it, and the number of bytes available.  When block is true the call
+    // waits for at least one line.  Data is consumed and credit returned
+    // to the FPGA with a single ReadConsume() for the whole span.
+    size_t ReadPeek(const void** buf, bool block = true);
+    void ReadConsume(size_t nBytes) { UpdateReadPtr(nBytes); }
+
     // Write to the channel.  nBytes must be a multiple of a cache line.
     void Write(const void* buf, size_t nBytes);
 
@@ -128,6 +149,12 @@ class QA_HOST_CHANNELS_DEVICE_CLASS: public PLATFORMS_MODULE_CLASS
     void TestRecv();                    // Test receiving from FPGA
     void TestLoopback();                // Test send and receive
 
+    // Send the outbound traffic in a trace recorded by the physical
+    // channel to the FPGA, which discards it.  When realTime is true the
+    // recorded inter-message timing is preserved.  Otherwise the trace is
+    // sent as fast as the channel allows.
+    void Replay(const char* tracePath, bool realTime);
+
   private:
     //
     // Convert a line offset to an address.
@@ -40,7 +40,8 @@ package qa_drv_hc_csr_types;
     // driver.
     typedef struct packed
     {
-        // Count of messages to send for SOURCE mode test.
+        // Count of messages to send for SOURCE mode test.  In SINK mode
+        // a non-zero count ends the test after that many lines.
         logic [29:0] count;
         // Test -- must match t_STATE in qa_drv_tester.
         logic [1:0]  test_state;
@@ -82,7 +82,7 @@ module qa_drv_hc_tester
 
     t_STATE state;
 
-    // SOURCE state
+    // SOURCE state and line-counted SINK state
     logic [30:0] source_count;
 
     // Signal completed operation
@@ -112,8 +112,17 @@ module qa_drv_hc_tester
                 rx_fifo_rdy = 1'b0;             // Disable client
                 rx_enable = rx_rdy && tx_rdy;   // Sink!
 
-                // Done if bit 0 of received data is 1
-                test_done = (rx_enable && (rx_data[0] == 1'b1));
+                // With no line count the test is done when bit 0 of
+                // received data is 1.  Otherwise it is done after the
+                // requested number of lines, whatever their contents.
+                if (source_count == 0)
+                begin
+                    test_done = (rx_enable && (rx_data[0] == 1'b1));
+                end
+                else
+                begin
+                    test_done = (rx_enable && (source_count == 1));
+                end
 
                 tx_fifo_rdy = 1'b0;             // Disable client
                 tx_enable = test_done;          // Send one message when the test
@@ -172,15 +181,20 @@ module qa_drv_hc_tester
 
 
     //
-    // Update source data when in SOURCE mode.
+    // Update source data when in SOURCE mode and the remaining line
+    // count in SINK mode.
     //
     always_ff @(posedge clk)
     begin
-        if (state != SOURCE)
+        if ((state != SOURCE) && (state != SINK))
         begin
             source_count <= csr.hc_enable_test.count;
         end
-        else if (tx_rdy)
+        else if ((state == SOURCE) && tx_rdy)
+        begin
+            source_count <= source_count - 1;
+        end
+        else if ((state == SINK) && rx_enable && (source_count != 0))
         begin
             source_count <= source_count - 1;
         end
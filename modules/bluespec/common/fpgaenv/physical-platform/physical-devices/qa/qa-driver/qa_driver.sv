@@ -264,17 +264,31 @@ module qa_driver
     cci_mpf_if fiu_main(.clk);
     t_csr_afu_state csr;
 
+    logic sreg_snapshot_wr_valid;
+    logic sreg_snapshot_wr_is_data;
+    t_cci_clAddr sreg_snapshot_wr_line;
+    t_cci_clData sreg_snapshot_wr_data;
+    logic sreg_snapshot_wr_accept;
+    logic sreg_snapshot_wr_rsp;
+
     qa_driver_main_fiu_tap
       #(
         .AFU_ID(AFU_ID),
-        .QA_DRIVER_WRITE_TAG((1 << CCI_PLATFORM_MDATA_WIDTH) - 1)
+        .QA_DRIVER_WRITE_TAG((1 << CCI_PLATFORM_MDATA_WIDTH) - 1),
+        .QA_DRIVER_SNAPSHOT_TAG((1 << CCI_PLATFORM_MDATA_WIDTH) - 2)
         )
       tap
        (
         .clk,
         .fiu,
         .afu(fiu_main),
-        .csr
+        .csr,
+        .sreg_snapshot_wr_valid,
+        .sreg_snapshot_wr_is_data,
+        .sreg_snapshot_wr_line,
+        .sreg_snapshot_wr_data,
+        .sreg_snapshot_wr_accept,
+        .sreg_snapshot_wr_rsp
         );
 
 
@@ -295,6 +309,9 @@ module qa_driver
     // CSR read responses, generated by csr_mgr_rd
     t_if_cci_c2_Tx afu_csr_rd_rsp;
 
+    logic csr_rd_sreg_req_rdy;
+    logic csr_rd_sreg_rsp_enable;
+
     // Reads from host from FPGA CSRs
     qa_driver_csr_rd
        #(
@@ -305,13 +322,42 @@ module qa_driver
         .clk,
         .fiu(fiu_main),
         .c2Tx(afu_csr_rd_rsp),
-        .sreg_req_rdy,
+        .sreg_req_rdy(csr_rd_sreg_req_rdy),
+        .sreg_rsp,
+        .sreg_rsp_enable(csr_rd_sreg_rsp_enable)
+        );
+
+    // Bulk status register reads, written to DSM
+    logic sreg_snapshot_active;
+    t_sreg_addr sreg_snapshot_req_addr;
+    logic sreg_snapshot_req_rdy;
+
+    qa_driver_sreg_snapshot
+      sreg_snapshot
+       (
+        .clk,
+        .reset(fiu_main.reset),
+        .csr,
+        .active(sreg_snapshot_active),
+        .sreg_req_addr(sreg_snapshot_req_addr),
+        .sreg_req_rdy(sreg_snapshot_req_rdy),
         .sreg_rsp,
-        .sreg_rsp_enable
+        .sreg_rsp_enable,
+        .wr_valid(sreg_snapshot_wr_valid),
+        .wr_is_data(sreg_snapshot_wr_is_data),
+        .wr_line(sreg_snapshot_wr_line),
+        .wr_data(sreg_snapshot_wr_data),
+        .wr_accept(sreg_snapshot_wr_accept),
+        .wr_rsp(sreg_snapshot_wr_rsp)
         );
 
-    // Forward status register read requests
-    assign sreg_req_addr = csr.afu_sreg_addr;
+    // Forward status register read requests.  The host must not use
+    // CSR_AFU_SREG_READ while a snapshot is active, so responses go
+    // to whichever requester owns the port.
+    assign sreg_req_addr = sreg_snapshot_active ? sreg_snapshot_req_addr :
+                                                  csr.afu_sreg_addr;
+    assign sreg_req_rdy = sreg_snapshot_req_rdy || csr_rd_sreg_req_rdy;
+    assign csr_rd_sreg_rsp_enable = sreg_rsp_enable && ! sreg_snapshot_active;
 
 
     // ====================================================================    
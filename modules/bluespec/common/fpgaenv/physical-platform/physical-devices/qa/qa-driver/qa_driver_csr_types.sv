@@ -56,7 +56,10 @@ package qa_driver_csr_types;
 
         // MMIO read compatibility for CCI-S.  Writes here are treated
         // as a CSR read request.
-        CSR_AFU_MMIO_READ_COMPAT   = 16'h1a14
+        CSR_AFU_MMIO_READ_COMPAT   = 16'h1a14,
+
+        // Bulk status register snapshot.  See qa_driver_sreg_snapshot.sv.
+        CSR_AFU_SREG_SNAPSHOT      = 16'h1a18
     }
     t_ccis_csr_afu_map;
 
@@ -66,6 +69,19 @@ package qa_driver_csr_types;
     typedef logic [31:0] t_sreg_addr;
     typedef logic [63:0] t_sreg;
 
+    //
+    // Status register snapshots are written to DSM.  The header line is
+    // written last, after all data lines have been committed.  Both
+    // offsets are in lines relative to the DSM base and must match
+    // AFU_csr.h.  Lines 0 and 1 hold the AFU ID and CCI-S MMIO read
+    // compatibility responses.
+    //
+    parameter QA_SREG_SNAPSHOT_DSM_HDR_LINE = 2;
+    parameter QA_SREG_SNAPSHOT_DSM_DATA_LINE = 3;
+
+    typedef logic [15:0] t_sreg_snapshot_num;
+    typedef logic [15:0] t_sreg_snapshot_tag;
+
     // Compare CSR address in a message header to the map above.  The CCI
     // header is 18 bits.
     function automatic logic csrAddrMatches(
@@ -87,6 +103,12 @@ package qa_driver_csr_types;
 
         // Client status register read request.  Enable is held for one cycle.
         t_sreg_addr afu_sreg_addr;
+
+        // Status register snapshot request.  Enable is held for one cycle.
+        logic afu_sreg_snapshot_en;
+        t_sreg_addr afu_sreg_snapshot_first;
+        t_sreg_snapshot_num afu_sreg_snapshot_num;
+        t_sreg_snapshot_tag afu_sreg_snapshot_tag;
     }
     t_csr_afu_state;
 
@@ -93,4 +93,27 @@ module qa_driver_csr_wr
         end
     end
 
+
+    //
+    // Status register snapshot request.  The 64 bit CSR holds:
+    //   [15:0]  - number of registers
+    //   [47:16] - first register address
+    //   [63:48] - tag, returned in the DSM header when the snapshot is done
+    //
+    always_ff @(posedge clk) begin
+        csr.afu_sreg_snapshot_en <= csrMatches(CSR_AFU_SREG_SNAPSHOT);
+
+        if (csrMatches(CSR_AFU_SREG_SNAPSHOT))
+        begin
+            csr.afu_sreg_snapshot_num <= t_sreg_snapshot_num'(fiu.c0Rx.data[15:0]);
+            csr.afu_sreg_snapshot_first <= t_sreg_addr'(fiu.c0Rx.data[47:16]);
+            csr.afu_sreg_snapshot_tag <= t_sreg_snapshot_tag'(fiu.c0Rx.data[63:48]);
+        end
+
+        if (reset)
+        begin
+            csr.afu_sreg_snapshot_en <= 1'b0;
+        end
+    end
+
 endmodule
@@ -44,7 +44,14 @@ module qa_driver_main_fiu_tap
     // When the driver injects write requests they will be tagged with this
     // value in Mdata. Write responses matching the tag are dropped here.
     //
-    QA_DRIVER_WRITE_TAG = 0
+    QA_DRIVER_WRITE_TAG = 0,
+
+    //
+    // Status register snapshot data writes are tagged with this value so
+    // that their responses can be counted apart from other driver writes.
+    // These responses are also dropped here.
+    //
+    QA_DRIVER_SNAPSHOT_TAG = 1
     )
    (
     input  logic clk,
@@ -56,7 +63,19 @@ module qa_driver_main_fiu_tap
     cci_mpf_if.to_afu afu,
 
     // CSR monitoring
-    input t_csr_afu_state csr
+    input t_csr_afu_state csr,
+
+    // Status register snapshot writes to DSM.  The line is an offset from
+    // the DSM base.  Snapshot writes have the lowest priority.  Writes with
+    // sreg_snapshot_wr_is_data set are tagged QA_DRIVER_SNAPSHOT_TAG.
+    input  logic sreg_snapshot_wr_valid,
+    input  logic sreg_snapshot_wr_is_data,
+    input  t_cci_clAddr sreg_snapshot_wr_line,
+    input  t_cci_clData sreg_snapshot_wr_data,
+    output logic sreg_snapshot_wr_accept,
+
+    // A write response tagged QA_DRIVER_SNAPSHOT_TAG arrived
+    output logic sreg_snapshot_wr_rsp
     );
 
     logic reset;
@@ -98,7 +117,8 @@ module qa_driver_main_fiu_tap
     begin
         // Is an injected write pending?
         c1_need_write = ((! did_afu_id_write && csr.afu_dsm_base_valid) ||
-                         mmio_read_rsp_q.mmioRdValid);
+                         mmio_read_rsp_q.mmioRdValid ||
+                         sreg_snapshot_wr_valid);
 
         // Request channels to host
         fiu.c0Tx = afu.c0Tx;
@@ -111,6 +131,7 @@ module qa_driver_main_fiu_tap
         fiu.c2Tx = afu.c2Tx;
 
         did_mmio_read_rsp = 1'b0;
+        sreg_snapshot_wr_accept = 1'b0;
 
         //
         // Inject memory writes for special cases:
@@ -151,6 +172,19 @@ module qa_driver_main_fiu_tap
                 fiu.c1Tx.data[64] = 1'b1;
             end
 `endif
+            else if (sreg_snapshot_wr_valid)
+            begin
+                sreg_snapshot_wr_accept = 1'b1;
+
+                fiu.c1Tx.valid = 1'b1;
+                fiu.c1Tx.hdr = cci_mpf_c1_genReqHdr(eREQ_WRLINE_I,
+                                                    csr.afu_dsm_base + sreg_snapshot_wr_line,
+                                                    (sreg_snapshot_wr_is_data ?
+                                                         t_cci_mdata'(QA_DRIVER_SNAPSHOT_TAG) :
+                                                         t_cci_mdata'(QA_DRIVER_WRITE_TAG)),
+                                                    cci_mpf_defaultReqHdrParams(0));
+                fiu.c1Tx.data = sreg_snapshot_wr_data;
+            end
         end
 
 
@@ -159,8 +193,13 @@ module qa_driver_main_fiu_tap
         afu.c1Rx = fiu.c1Rx;
 
         // Drop the driver write responses
+        sreg_snapshot_wr_rsp =
+            cci_c1Rx_isWriteRsp(fiu.c1Rx) &&
+            (fiu.c1Rx.hdr.mdata == t_cci_mdata'(QA_DRIVER_SNAPSHOT_TAG));
+
         if (cci_c1Rx_isWriteRsp(fiu.c1Rx) &&
-            (fiu.c1Rx.hdr.mdata == t_cci_mdata'(QA_DRIVER_WRITE_TAG)))
+            ((fiu.c1Rx.hdr.mdata == t_cci_mdata'(QA_DRIVER_WRITE_TAG)) ||
+             sreg_snapshot_wr_rsp))
         begin
             afu.c1Rx.rspValid = 1'b0;
         end
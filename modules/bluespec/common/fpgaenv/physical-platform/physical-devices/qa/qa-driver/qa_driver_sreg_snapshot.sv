@@ -0,0 +1,245 @@
+//
+// Copyright (c) 2016, Intel Corporation
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// Neither the name of the Intel Corporation nor the names of its contributors
+// may be used to endorse or promote products derived from this software
+// without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+`include "cci_mpf_if.vh"
+`include "qa_driver_csr.vh"
+
+
+//
+// Bulk status register snapshot.  When the host writes
+// CSR_AFU_SREG_SNAPSHOT, read a range of status registers from the client
+// and write them to DSM, 8 registers per line, starting at
+// QA_SREG_SNAPSHOT_DSM_DATA_LINE.  Once all data writes have been
+// committed a header line is written to QA_SREG_SNAPSHOT_DSM_HDR_LINE:
+//
+//   [15:0]  - tag from the request
+//   [31:16] - number of registers written
+//   [32]    - 1 (valid)
+//
+// The host polls the header for its tag.  Only one status register read
+// may be in flight, so the host must not use CSR_AFU_SREG_READ while a
+// snapshot is active.
+//
+
+module qa_driver_sreg_snapshot
+   (
+    input  logic clk,
+    input  logic reset,
+
+    input  t_csr_afu_state csr,
+
+    // Snapshot owns the status register request port while active
+    output logic active,
+    output t_sreg_addr sreg_req_addr,
+    output logic sreg_req_rdy,
+    input  t_sreg sreg_rsp,
+    input  logic sreg_rsp_enable,
+
+    // DSM line write request.  wr_line is the line offset from the DSM base.
+    // wr_is_data marks data lines, which are tagged so that their write
+    // responses can be counted.
+    output logic wr_valid,
+    output logic wr_is_data,
+    output t_cci_clAddr wr_line,
+    output t_cci_clData wr_data,
+    input  logic wr_accept,
+
+    // A response to a snapshot data line write arrived
+    input  logic wr_rsp
+    );
+
+    typedef enum logic [2:0]
+    {
+        STATE_IDLE,
+        STATE_REQ,
+        STATE_WAIT,
+        STATE_WRITE,
+        STATE_HDR
+    }
+    t_state;
+
+    t_state state;
+
+    t_sreg_addr first;
+    t_sreg_snapshot_num num;
+    t_sreg_snapshot_tag tag;
+
+    // Index of the next register to request
+    t_sreg_snapshot_num idx;
+
+    // Registers collected for the current line
+    t_sreg line_buf[0:7];
+    logic [2:0] lane;
+
+    // Next DSM data line
+    t_cci_clAddr line_idx;
+
+    // Data writes not yet committed
+    logic [15:0] n_outstanding;
+
+    assign active = (state != STATE_IDLE);
+
+    assign sreg_req_addr = first + t_sreg_addr'(idx);
+    assign sreg_req_rdy = (state == STATE_REQ);
+
+    always_comb
+    begin
+        wr_valid = ((state == STATE_WRITE) ||
+                    ((state == STATE_HDR) && (n_outstanding == 0)));
+        wr_is_data = (state == STATE_WRITE);
+
+        wr_data = t_cci_clData'(0);
+        if (state == STATE_HDR)
+        begin
+            wr_line = t_cci_clAddr'(QA_SREG_SNAPSHOT_DSM_HDR_LINE);
+            wr_data[15:0] = tag;
+            wr_data[31:16] = num;
+            wr_data[32] = 1'b1;
+        end
+        else
+        begin
+            wr_line = t_cci_clAddr'(QA_SREG_SNAPSHOT_DSM_DATA_LINE) + line_idx;
+            for (int i = 0; i < 8; i = i + 1)
+            begin
+                wr_data[64 * i +: 64] = line_buf[i];
+            end
+        end
+    end
+
+    always_ff @(posedge clk)
+    begin
+        case (state)
+          STATE_IDLE:
+            begin
+                if (csr.afu_sreg_snapshot_en)
+                begin
+                    first <= csr.afu_sreg_snapshot_first;
+                    num <= csr.afu_sreg_snapshot_num;
+                    tag <= csr.afu_sreg_snapshot_tag;
+                    idx <= 0;
+                    lane <= 0;
+                    line_idx <= 0;
+
+                    for (int i = 0; i < 8; i = i + 1)
+                    begin
+                        line_buf[i] <= t_sreg'(0);
+                    end
+
+                    // An empty snapshot just writes the header
+                    state <= (csr.afu_sreg_snapshot_num == 0) ? STATE_HDR :
+                                                                STATE_REQ;
+                end
+            end
+
+          STATE_REQ:
+            begin
+                // Request is a single cycle pulse
+                state <= STATE_WAIT;
+            end
+
+          STATE_WAIT:
+            begin
+                if (sreg_rsp_enable)
+                begin
+                    line_buf[lane] <= sreg_rsp;
+                    lane <= lane + 1;
+                    idx <= idx + 1;
+
+                    if ((lane == 3'd7) || (idx + 1 == num))
+                    begin
+                        state <= STATE_WRITE;
+                    end
+                    else
+                    begin
+                        state <= STATE_REQ;
+                    end
+                end
+            end
+
+          STATE_WRITE:
+            begin
+                if (wr_accept)
+                begin
+                    line_idx <= line_idx + 1;
+                    lane <= 0;
+
+                    for (int i = 0; i < 8; i = i + 1)
+                    begin
+                        line_buf[i] <= t_sreg'(0);
+                    end
+
+                    state <= (idx == num) ? STATE_HDR : STATE_REQ;
+                end
+            end
+
+          STATE_HDR:
+            begin
+                // The header is written only after all data writes commit
+                if (wr_accept)
+                begin
+                    state <= STATE_IDLE;
+                end
+            end
+        endcase
+
+        if (reset)
+        begin
+            state <= STATE_IDLE;
+        end
+    end
+
+
+    //
+    // Count uncommitted data writes.  Only responses to data line writes
+    // are signalled on wr_rsp.
+    //
+    always_ff @(posedge clk)
+    begin
+        if (reset)
+        begin
+            n_outstanding <= 0;
+        end
+        else
+        begin
+            if ((state == STATE_WRITE) && wr_accept)
+            begin
+                if (! wr_rsp)
+                begin
+                    n_outstanding <= n_outstanding + 1;
+                end
+            end
+            else if (wr_rsp)
+            begin
+                n_outstanding <= n_outstanding - 1;
+            end
+        end
+    end
+
+endmodule // qa_driver_sreg_snapshot
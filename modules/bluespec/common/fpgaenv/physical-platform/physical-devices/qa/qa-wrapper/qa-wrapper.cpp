@@ -77,16 +77,36 @@ static const char* QA_AFU_ID = "13572468-0D82-4272-9AEF-FE5F84570612";
 //           Class member functions
 // ============================================
 
+COMMAND_SWITCH_DICTIONARY QA_DEVICE_WRAPPER_CLASS::deviceSwitch = NULL;
+QA_CHAN_TESTS_SWITCH_CLASS* QA_DEVICE_WRAPPER_CLASS::testSwitch = NULL;
+QA_CHAN_REPLAY_SWITCH_CLASS* QA_DEVICE_WRAPPER_CLASS::replaySwitch = NULL;
+QA_CHAN_REPLAY_REALTIME_SWITCH_CLASS* QA_DEVICE_WRAPPER_CLASS::replayRealTimeSwitch = NULL;
+QA_MEMTEST_SWITCH_CLASS* QA_DEVICE_WRAPPER_CLASS::memTestSwitch = NULL;
+QA_MPF_CLOCK_SWITCH_CLASS* QA_DEVICE_WRAPPER_CLASS::mpfClockSwitch = NULL;
+QA_TEST_SECOND_DEVICE_SWITCH_CLASS* QA_DEVICE_WRAPPER_CLASS::secondDeviceSwitch = NULL;
+QA_TEST_VM_BUFFERS_SWITCH_CLASS* QA_DEVICE_WRAPPER_CLASS::vmBuffersSwitch = NULL;
+
 // constructor: set up hardware partition
 QA_DEVICE_WRAPPER_CLASS::QA_DEVICE_WRAPPER_CLASS(
-    PLATFORMS_MODULE p) :
+    PLATFORMS_MODULE p,
+    int pciBus) :
         PLATFORMS_MODULE_CLASS(p),
-        afu(QA_AFU_ID),
+        afu(QA_AFU_ID, 4096, pciBus),
         channelDev(p, afu),
         bytesLeftInPacket(0),
         nextReadHeader(0)
 {
-    deviceSwitch = new COMMAND_SWITCH_DICTIONARY_CLASS("DEVICE_DICTIONARY");
+    if (deviceSwitch == NULL)
+    {
+        deviceSwitch = new COMMAND_SWITCH_DICTIONARY_CLASS("DEVICE_DICTIONARY");
+        testSwitch = new QA_CHAN_TESTS_SWITCH_CLASS();
+        replaySwitch = new QA_CHAN_REPLAY_SWITCH_CLASS();
+        replayRealTimeSwitch = new QA_CHAN_REPLAY_REALTIME_SWITCH_CLASS();
+        memTestSwitch = new QA_MEMTEST_SWITCH_CLASS();
+        mpfClockSwitch = new QA_MPF_CLOCK_SWITCH_CLASS();
+        secondDeviceSwitch = new QA_TEST_SECOND_DEVICE_SWITCH_CLASS();
+        vmBuffersSwitch = new QA_TEST_VM_BUFFERS_SWITCH_CLASS();
+    }
 
     //
     // Check required properties
@@ -110,10 +130,65 @@ QA_DEVICE_WRAPPER_CLASS::~QA_DEVICE_WRAPPER_CLASS()
 void
 QA_DEVICE_WRAPPER_CLASS::Init()
 {
-    if (testSwitch.Value() != 0)
+    if (testSwitch->Value() != 0)
     {
         channelDev.EnableTests();
     }
+
+    if (replaySwitch->Value() != NULL)
+    {
+        channelDev.EnableReplay(replaySwitch->Value(),
+                                replayRealTimeSwitch->Value() != 0);
+    }
+
+    if (memTestSwitch->Value() >= 0)
+    {
+        afu.SetMemTestLevel(QA_MEMTEST_LEVEL(memTestSwitch->Value()));
+    }
+
+    if (mpfClockSwitch->Value() > 0)
+    {
+        afu.SetMPFClockMHz(mpfClockSwitch->Value());
+    }
+
+    if (secondDeviceSwitch->Value() >= 0)
+    {
+        TestSecondDevice(secondDeviceSwitch->Value());
+    }
+
+    if (vmBuffersSwitch->Value() != 0)
+    {
+        printf("VM buffer test...\n");
+        if (! afu.TestSharedBufferInVM())
+        {
+            fprintf(stderr, "ERROR: VM buffer test failed\n");
+            exit(1);
+        }
+        printf("VM buffer test complete\n");
+    }
+}
+
+
+//
+// TestSecondDevice --
+//   Allocate a second AFU on another FPGA, bring up its host channels and
+//   run the channel tests on it.  The AFU is released when the test ends.
+//   This device stays allocated throughout, exercising the shared AAL
+//   runtime and per-AFU buffers, VTP and channel state.
+//
+void
+QA_DEVICE_WRAPPER_CLASS::TestSecondDevice(int pciBus)
+{
+    printf("Second device test on PCI bus %d...\n", pciBus);
+
+    AFU_CLASS second_afu(QA_AFU_ID, 4096, pciBus);
+    QA_HOST_CHANNELS_DEVICE_CLASS second_channel(NULL, second_afu);
+
+    second_channel.EnableTests();
+    second_channel.Init();
+    second_channel.Uninit();
+
+    printf("Second device test complete\n");
 }
 
 
@@ -64,6 +64,141 @@ class QA_CHAN_TESTS_SWITCH_CLASS : public COMMAND_SWITCH_INT_CLASS
 };
 
 
+class QA_CHAN_REPLAY_SWITCH_CLASS : public COMMAND_SWITCH_STRING_CLASS
+{
+  private:
+    string tracePath;
+
+  public:
+    ~QA_CHAN_REPLAY_SWITCH_CLASS() {};
+    QA_CHAN_REPLAY_SWITCH_CLASS() :
+        COMMAND_SWITCH_STRING_CLASS("qa-chan-replay"),
+        tracePath()
+    {};
+
+    void ProcessSwitchString(const char *arg) { tracePath = arg; };
+    void ShowSwitch(std::ostream& ostr, const string& prefix)
+    {
+        ostr << prefix << "[--qa-chan-replay=<file>] Replay outbound traffic from a --qa-chan-record trace" << endl;
+    };
+
+    const char* Value(void) const { return tracePath.empty() ? NULL : tracePath.c_str(); }
+};
+
+
+class QA_CHAN_REPLAY_REALTIME_SWITCH_CLASS : public COMMAND_SWITCH_INT_CLASS
+{
+  private:
+    UINT32 realTime;
+
+  public:
+    ~QA_CHAN_REPLAY_REALTIME_SWITCH_CLASS() {};
+    QA_CHAN_REPLAY_REALTIME_SWITCH_CLASS() :
+        COMMAND_SWITCH_INT_CLASS("qa-chan-replay-realtime"),
+        realTime(0)
+    {};
+
+    void ProcessSwitchInt(int arg) { realTime = arg; };
+    void ShowSwitch(std::ostream& ostr, const string& prefix)
+    {
+        ostr << prefix << "[--qa-chan-replay-realtime=<n>] Preserve recorded timing during replay if non-zero" << endl;
+    };
+
+    int Value(void) const { return realTime; }
+};
+
+
+class QA_MEMTEST_SWITCH_CLASS : public COMMAND_SWITCH_INT_CLASS
+{
+  private:
+    int level;
+
+  public:
+    ~QA_MEMTEST_SWITCH_CLASS() {};
+    QA_MEMTEST_SWITCH_CLASS() :
+        COMMAND_SWITCH_INT_CLASS("qa-memtest"),
+        level(-1)
+    {};
+
+    void ProcessSwitchInt(int arg) { level = arg; };
+    void ShowSwitch(std::ostream& ostr, const string& prefix)
+    {
+        ostr << prefix << "[--qa-memtest=<n>]      Host memory benchmark (0 off, 1 quick, 2 sweep sizes)" << endl;
+    };
+
+    // Negative if not set
+    int Value(void) const { return level; }
+};
+
+
+class QA_MPF_CLOCK_SWITCH_CLASS : public COMMAND_SWITCH_INT_CLASS
+{
+  private:
+    int mhz;
+
+  public:
+    ~QA_MPF_CLOCK_SWITCH_CLASS() {};
+    QA_MPF_CLOCK_SWITCH_CLASS() :
+        COMMAND_SWITCH_INT_CLASS("qa-mpf-clock-mhz"),
+        mhz(0)
+    {};
+
+    void ProcessSwitchInt(int arg) { mhz = arg; };
+    void ShowSwitch(std::ostream& ostr, const string& prefix)
+    {
+        ostr << prefix << "[--qa-mpf-clock-mhz=<n>] MPF clock (MHz) for sampled busy fractions" << endl;
+    };
+
+    // Zero if not set
+    int Value(void) const { return mhz; }
+};
+
+
+class QA_TEST_SECOND_DEVICE_SWITCH_CLASS : public COMMAND_SWITCH_INT_CLASS
+{
+  private:
+    int pciBus;
+
+  public:
+    ~QA_TEST_SECOND_DEVICE_SWITCH_CLASS() {};
+    QA_TEST_SECOND_DEVICE_SWITCH_CLASS() :
+        COMMAND_SWITCH_INT_CLASS("qa-test-second-device"),
+        pciBus(-1)
+    {};
+
+    void ProcessSwitchInt(int arg) { pciBus = arg; };
+    void ShowSwitch(std::ostream& ostr, const string& prefix)
+    {
+        ostr << prefix << "[--qa-test-second-device=<bus>] Run channel tests on a second FPGA at PCI bus <bus>" << endl;
+    };
+
+    // Negative if not set
+    int Value(void) const { return pciBus; }
+};
+
+
+class QA_TEST_VM_BUFFERS_SWITCH_CLASS : public COMMAND_SWITCH_INT_CLASS
+{
+  private:
+    int enable;
+
+  public:
+    ~QA_TEST_VM_BUFFERS_SWITCH_CLASS() {};
+    QA_TEST_VM_BUFFERS_SWITCH_CLASS() :
+        COMMAND_SWITCH_INT_CLASS("qa-test-vm-buffers"),
+        enable(0)
+    {};
+
+    void ProcessSwitchInt(int arg) { enable = arg; };
+    void ShowSwitch(std::ostream& ostr, const string& prefix)
+    {
+        ostr << prefix << "[--qa-test-vm-buffers=<0|1>] Test translation of buffers allocated in VTP space" << endl;
+    };
+
+    int Value(void) const { return enable; }
+};
+
+
 // ========================================================================
 //
 //   QA device wrapper.  Allocate/initialize the AFU driver.  After
@@ -75,9 +210,20 @@ typedef class QA_DEVICE_WRAPPER_CLASS* QA_DEVICE_WRAPPER;
 class QA_DEVICE_WRAPPER_CLASS: public PLATFORMS_MODULE_CLASS
 {
   private:
-    // switches for acquiring device uniquifier
-    COMMAND_SWITCH_DICTIONARY deviceSwitch;
-    QA_CHAN_TESTS_SWITCH_CLASS testSwitch;
+    // Switches are shared by all devices in the process.  The first
+    // device creates them so each switch is registered once.
+    static COMMAND_SWITCH_DICTIONARY deviceSwitch;
+    static QA_CHAN_TESTS_SWITCH_CLASS* testSwitch;
+    static QA_CHAN_REPLAY_SWITCH_CLASS* replaySwitch;
+    static QA_CHAN_REPLAY_REALTIME_SWITCH_CLASS* replayRealTimeSwitch;
+    static QA_MEMTEST_SWITCH_CLASS* memTestSwitch;
+    static QA_MPF_CLOCK_SWITCH_CLASS* mpfClockSwitch;
+    static QA_TEST_SECOND_DEVICE_SWITCH_CLASS* secondDeviceSwitch;
+    static QA_TEST_VM_BUFFERS_SWITCH_CLASS* vmBuffersSwitch;
+
+    // Bring up a second FPGA in this process and run the channel tests
+    // on it while this device remains allocated.
+    void TestSecondDevice(int pciBus);
 
     // Handles to AFU context.
     AFU_CLASS afu;
@@ -91,7 +237,8 @@ class QA_DEVICE_WRAPPER_CLASS: public PLATFORMS_MODULE_CLASS
     UMF_CHUNK nextReadHeader;
 
   public:
-    QA_DEVICE_WRAPPER_CLASS(PLATFORMS_MODULE);
+    // pciBus selects the FPGA when a process drives more than one.
+    QA_DEVICE_WRAPPER_CLASS(PLATFORMS_MODULE, int pciBus = QA_ANY_PCI_BUS);
     ~QA_DEVICE_WRAPPER_CLASS();
 
     void Init();
@@ -101,6 +248,10 @@ class QA_DEVICE_WRAPPER_CLASS: public PLATFORMS_MODULE_CLASS
     bool Probe();                               // probe for data
     size_t Read(void* buf, size_t nBytes, bool block = true);
 
+    // Zero-copy read of all available data.  See QA_HOST_CHANNELS_DEVICE.
+    size_t ReadPeek(const void** buf, bool block = true);
+    void ReadConsume(size_t nBytes);
+
     inline void Write(const void* buf, size_t nBytes); // write
     inline void Flush();                        // Complete pending writes
 
@@ -109,6 +260,9 @@ class QA_DEVICE_WRAPPER_CLASS: public PLATFORMS_MODULE_CLASS
     // The driver implements a status register space in the FPGA.
     // The protocol is very slow -- the registers are intended for debugging.
     inline uint64_t ReadSREG64(uint32_t n);
+
+    // The AFU driven by this device
+    AFU GetAFU() { return &afu; }
 };
 
 
@@ -130,6 +284,23 @@ QA_DEVICE_WRAPPER_CLASS::Read(
 }
 
 
+inline size_t
+QA_DEVICE_WRAPPER_CLASS::ReadPeek(
+    const void** buf,
+    bool block)
+{
+    return channelDev.ReadPeek(buf, block);
+}
+
+
+inline void
+QA_DEVICE_WRAPPER_CLASS::ReadConsume(
+    size_t nBytes)
+{
+    channelDev.ReadConsume(nBytes);
+}
+
+
 //
 // Write a message to the FPGA.
 //
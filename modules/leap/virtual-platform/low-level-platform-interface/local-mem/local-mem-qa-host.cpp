@@ -70,7 +70,9 @@ LOCAL_MEM_QA_SERVER_CLASS::Uninit()
 uint64_t
 LOCAL_MEM_QA_SERVER_CLASS::Alloc(uint64_t size)
 {
-    AFU afu = AFU_CLASS::GetInstance();
+    // Memory is allocated in the VTP space of the FPGA running this model
+    AFU afu = AFU_CLASS::GetInstance(LOCAL_MEM_QA_DEVICE);
+    assert(afu != NULL);
 
     // The incoming "size" is the index of the last word in the buffer.
     // Convert to bytes.
@@ -39,6 +39,8 @@
 #include <sys/wait.h>
 #include <signal.h>
 #include <string.h>
+#include <time.h>
+#include <sched.h>
 #include <iostream>
 #include "tbb/concurrent_queue.h"
 
@@ -47,25 +49,57 @@
 
 using namespace std;
 
+static inline uint64_t
+qaNowNs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return uint64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
 // ============================================
 //               Physical Channel              
 // ============================================
 
+QA_CHAN_RECORD_SWITCH_CLASS* QA_PHYSICAL_CHANNEL_CLASS::recordSwitch = NULL;
+
 // constructor
 QA_PHYSICAL_CHANNEL_CLASS::QA_PHYSICAL_CHANNEL_CLASS(
-    PLATFORMS_MODULE     p
+    PLATFORMS_MODULE     p,
+    int                  pciBus
     ) :
     PHYSICAL_CHANNEL_CLASS(p),
     writeQ(),
     uninitialized(),
-    qaDevice((PLATFORMS_MODULE) (PHYSICAL_CHANNEL) this)
+    qaDevice((PLATFORMS_MODULE) (PHYSICAL_CHANNEL) this, pciBus),
+    trace()
     
 {
+    if (recordSwitch == NULL)
+    {
+        recordSwitch = new QA_CHAN_RECORD_SWITCH_CLASS();
+    }
+    recordSwitch->AddTrace(&trace);
+
     incomingMessage = NULL;
     umfFactory = new UMF_FACTORY_CLASS(); //Use a default umf factory, but allow an external device to set it later...
 
     uninitialized = 0;
 
+    pthread_mutex_init(&writerLock, NULL);
+    pthread_cond_init(&writerCond, NULL);
+    writerIdle = false;
+
+    if (QA_CHANNEL_WRITEQ_MAX_MSGS != 0)
+    {
+        writeQ.set_capacity(QA_CHANNEL_WRITEQ_MAX_MSGS);
+    }
+    writeQBytes = 0;
+
+    bulkSampleMsg = NULL;
+    bulkSampleEnqTime = 0;
+    ResetStats();
+
     // Start up write thread
     void ** writerArgs = NULL;
     writerArgs = (void**) malloc(2*sizeof(void*));
@@ -85,15 +119,23 @@ QA_PHYSICAL_CHANNEL_CLASS::QA_PHYSICAL_CHANNEL_CLASS(
 QA_PHYSICAL_CHANNEL_CLASS::~QA_PHYSICAL_CHANNEL_CLASS()
 {
     Uninit();
+    recordSwitch->RemoveTrace(&trace);
+
+    pthread_cond_destroy(&writerCond);
+    pthread_mutex_destroy(&writerLock);
 }
 
 void QA_PHYSICAL_CHANNEL_CLASS::Uninit()
 {
     if (!uninitialized.fetch_and_store(1))
     {
-        // Tear down writer thread
-        writeQ.push(NULL); 
+        // Tear down writer thread.  It exits once both outbound queues
+        // are drained.  Signalling out of band keeps teardown from
+        // blocking behind a full writeQ.
+        wakeWriter();
         pthread_join(writerThread, NULL);
+
+        trace.Close();
     }
 }
 
@@ -103,41 +145,33 @@ UMF_MESSAGE
 QA_PHYSICAL_CHANNEL_CLASS::Read()
 {
     // blocking loop
-    while (true)
+    while (readyMessages.empty())
     {
-        // check if message is ready
-        if (incomingMessage && !incomingMessage->CanAppend())
-        {
-            // message is ready!
-            UMF_MESSAGE msg = incomingMessage;
-            incomingMessage = NULL;
-            return msg;
-        }
-
         // block-read data from pipe
         readPipe();
     }
 
-    // shouldn't be here
-    return NULL;
+    // message is ready!
+    UMF_MESSAGE msg = readyMessages.front();
+    readyMessages.pop_front();
+    return msg;
 }
 
 // non-blocking read
 UMF_MESSAGE
 QA_PHYSICAL_CHANNEL_CLASS::TryRead()
 {
-
     // if there's fresh data on the pipe, update
-    if (qaDevice.Probe())
+    if (readyMessages.empty())
     {
-        readPipe();
+        readPipe(false);
     }
 
     // now see if we have a complete message
-    if (incomingMessage && !incomingMessage->CanAppend())
+    if (! readyMessages.empty())
     {
-        UMF_MESSAGE msg = incomingMessage;
-        incomingMessage = NULL;
+        UMF_MESSAGE msg = readyMessages.front();
+        readyMessages.pop_front();
         return msg;
     }
 
@@ -150,38 +184,321 @@ void
 QA_PHYSICAL_CHANNEL_CLASS::Write(
     UMF_MESSAGE message)
 {
-    writeQ.push(message);
+    uint64_t msg_bytes = writeQMsgBytes(message);
+    uint64_t blocked_ns = 0;
+    reserveWriteQBytes(msg_bytes, true, &blocked_ns);
+
+    // Time this message if no other bulk message is being timed
+    if (bulkSampleMsg == NULL)
+    {
+        uint64_t now = qaNowNs();
+        if (bulkSampleMsg.compare_and_swap(message, NULL) == NULL)
+        {
+            bulkSampleEnqTime = now;
+        }
+    }
+
+    if (! writeQ.try_push(message))
+    {
+        // Full.  Wait for the writer thread to make room.
+        uint64_t start = qaNowNs();
+        writeQ.push(message);
+        blocked_ns += qaNowNs() - start;
+    }
+
+    // One blocked event per message, whichever limit it waited on
+    if (blocked_ns != 0)
+    {
+        statWriteBlocked += 1;
+        statWriteBlockedNs += blocked_ns;
+    }
+
+    noteWriteQDepth();
+    wakeWriter();
+}
+
+// non-blocking write
+bool
+QA_PHYSICAL_CHANNEL_CLASS::TryWrite(
+    UMF_MESSAGE message)
+{
+    uint64_t msg_bytes = writeQMsgBytes(message);
+    if (! reserveWriteQBytes(msg_bytes, false, NULL))
+    {
+        statWriteRejected += 1;
+        return false;
+    }
+
+    if (! writeQ.try_push(message))
+    {
+        releaseWriteQBytes(msg_bytes);
+        statWriteRejected += 1;
+        return false;
+    }
+
+    noteWriteQDepth();
+    wakeWriter();
+    return true;
+}
+
+bool
+QA_PHYSICAL_CHANNEL_CLASS::reserveWriteQBytes(
+    uint64_t msgBytes,
+    bool canBlock,
+    uint64_t *blockedNs)
+{
+    if (QA_CHANNEL_WRITEQ_MAX_BYTES == 0)
+    {
+        writeQBytes += msgBytes;
+        return true;
+    }
+
+    uint64_t start = 0;
+    uint32_t backoff = 1;
+
+    while (true)
+    {
+        uint64_t cur = writeQBytes;
+
+        // A message larger than the limit is admitted when the queue is
+        // empty so that it can't be blocked forever.
+        if ((cur == 0) || (cur + msgBytes <= QA_CHANNEL_WRITEQ_MAX_BYTES))
+        {
+            if (writeQBytes.compare_and_swap(cur + msgBytes, cur) == cur)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        if (! canBlock)
+        {
+            return false;
+        }
+
+        if (start == 0)
+        {
+            start = qaNowNs();
+        }
+
+        // Spin briefly, then back off to sleeping while the FPGA drains
+        // the queue.
+        if (backoff < 64)
+        {
+            backoff <<= 1;
+            sched_yield();
+        }
+        else
+        {
+            struct timespec ts = { 0, 10000 };
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    if ((start != 0) && (blockedNs != NULL))
+    {
+        *blockedNs += qaNowNs() - start;
+    }
+
+    return true;
+}
+
+void
+QA_PHYSICAL_CHANNEL_CLASS::releaseWriteQBytes(
+    uint64_t msgBytes)
+{
+    // Every path onto writeQ reserves its bytes first
+    ASSERTX(writeQBytes >= msgBytes);
+    writeQBytes -= msgBytes;
 }
 
-// read un-processed data on the pipe
 void
-QA_PHYSICAL_CHANNEL_CLASS::readPipe()
+QA_PHYSICAL_CHANNEL_CLASS::noteWriteQDepth()
 {
-    // determine if we are starting a new message
-    if (incomingMessage == NULL)
+    uint64_t depth = writeQ.size();
+    uint64_t cur;
+    while (depth > (cur = statWriteQMaxMsgs))
     {
-        // new message: read header
-        UMF_CHUNK header;
-        qaDevice.Read(&header, sizeof(header));
+        statWriteQMaxMsgs.compare_and_swap(depth, cur);
+    }
 
-        // If header is 0 then it was just filler on the channel.
-        if (header != 0)
+    uint64_t bytes = writeQBytes;
+    while (bytes > (cur = statWriteQMaxBytes))
+    {
+        statWriteQMaxBytes.compare_and_swap(bytes, cur);
+    }
+}
+
+// write, ahead of bulk traffic
+void
+QA_PHYSICAL_CHANNEL_CLASS::WritePriority(
+    UMF_MESSAGE message)
+{
+    QA_PRIORITY_ENTRY e;
+    e.msg = message;
+    e.enqTime = qaNowNs();
+    priorityWriteQ.push(e);
+
+    wakeWriter();
+}
+
+void
+QA_PHYSICAL_CHANNEL_CLASS::wakeWriter()
+{
+    // Pairs with the barrier in waitForWriterWork().  Either the writer
+    // sees the new message when it checks the queues or this thread sees
+    // writerIdle set.
+    __sync_synchronize();
+
+    if (writerIdle)
+    {
+        pthread_mutex_lock(&writerLock);
+        pthread_cond_signal(&writerCond);
+        pthread_mutex_unlock(&writerLock);
+    }
+}
+
+void
+QA_PHYSICAL_CHANNEL_CLASS::waitForWriterWork()
+{
+    pthread_mutex_lock(&writerLock);
+
+    writerIdle = true;
+    __sync_synchronize();
+
+    while (writeQ.empty() && priorityWriteQ.empty() && ! uninitialized)
+    {
+        pthread_cond_wait(&writerCond, &writerLock);
+    }
+
+    writerIdle = false;
+    pthread_mutex_unlock(&writerLock);
+}
+
+void
+QA_PHYSICAL_CHANNEL_CLASS::RegisterInboundQueue(
+    uint32_t channelID,
+    QA_INBOUND_QUEUE q,
+    uint32_t serviceID)
+{
+    ASSERTX(q != NULL);
+
+    tbb::spin_rw_mutex::scoped_lock lock(inboundQueuesLock, true);
+    inboundQueues[inboundKey(channelID, serviceID)] = q;
+}
+
+void
+QA_PHYSICAL_CHANNEL_CLASS::UnregisterInboundQueue(
+    uint32_t channelID,
+    uint32_t serviceID)
+{
+    tbb::spin_rw_mutex::scoped_lock lock(inboundQueuesLock, true);
+    inboundQueues.erase(inboundKey(channelID, serviceID));
+}
+
+bool
+QA_PHYSICAL_CHANNEL_CLASS::routeInbound(
+    UMF_MESSAGE msg)
+{
+    QA_INBOUND_QUEUE q = NULL;
+
+    {
+        tbb::spin_rw_mutex::scoped_lock lock(inboundQueuesLock, false);
+
+        // Common case: nothing registered
+        if (inboundQueues.empty()) return false;
+
+        std::map<uint64_t, QA_INBOUND_QUEUE>::iterator it;
+        it = inboundQueues.find(inboundKey(msg->GetChannelID(),
+                                           msg->GetServiceID()));
+        if (it == inboundQueues.end())
         {
-            // create a new message
-            incomingMessage = umfFactory->createUMFMessage();
-            incomingMessage->DecodeHeader(header);
+            it = inboundQueues.find(inboundKey(msg->GetChannelID(),
+                                               QA_ANY_SERVICE_ID));
         }
+
+        if (it == inboundQueues.end()) return false;
+        q = it->second;
     }
-    else if (incomingMessage->CanAppend())
+
+    q->push(msg);
+    return true;
+}
+
+// read un-processed data on the pipe
+void
+QA_PHYSICAL_CHANNEL_CLASS::readPipe(bool block)
+{
+    //
+    // Decode everything already available in the ring in one pass,
+    // reading directly from the ring buffer.  The data is consumed and
+    // credit returned to the FPGA once for the whole span.
+    //
+    const uint8_t* buf;
+    size_t avail = qaDevice.ReadPeek((const void**)&buf, block);
+    if (avail == 0) return;
+
+    // The FPGA writes whole UMF_CHUNKs
+    ASSERTX((avail & (sizeof(UMF_CHUNK) - 1)) == 0);
+
+    if (trace.IsOpen())
     {
-        size_t n_bytes = incomingMessage->BytesUnwritten();
+        trace.Record(QA_CHANNEL_TRACE_INBOUND, buf, avail);
+    }
 
-        // Read in the message.  Once the header has been received the
-        // rest of the data is guaranteed to follow.
-        void* dst = incomingMessage->AppendGetRawPtr();
-        qaDevice.Read(dst, n_bytes);
-        incomingMessage->AppendUpdateRawPtr(n_bytes);
+    size_t pos = 0;
+    while (pos < avail)
+    {
+        // determine if we are starting a new message
+        if (incomingMessage == NULL)
+        {
+            // Skip runs of zero headers.  They are just filler on the
+            // channel, padding the end of a line.
+            const UMF_CHUNK* chunk = (const UMF_CHUNK*)(buf + pos);
+            while ((pos < avail) && (*chunk == 0))
+            {
+                chunk += 1;
+                pos += sizeof(UMF_CHUNK);
+            }
+
+            if (pos == avail) break;
+
+            // new message: decode header
+            incomingMessage = umfFactory->createUMFMessage();
+            incomingMessage->DecodeHeader(*chunk);
+            pos += sizeof(UMF_CHUNK);
+        }
+
+        if (incomingMessage->CanAppend())
+        {
+            // Copy as much of the body as is available.  The rest will
+            // arrive on a later pass.
+            size_t n_bytes = incomingMessage->BytesUnwritten();
+            if (n_bytes > avail - pos)
+            {
+                n_bytes = avail - pos;
+            }
+
+            memcpy(incomingMessage->AppendGetRawPtr(), buf + pos, n_bytes);
+            incomingMessage->AppendUpdateRawPtr(n_bytes);
+            pos += n_bytes;
+        }
+
+        if (! incomingMessage->CanAppend())
+        {
+            // Messages claimed by a registered queue are not returned
+            // by Read().
+            if (! routeInbound(incomingMessage))
+            {
+                readyMessages.push_back(incomingMessage);
+            }
+
+            incomingMessage = NULL;
+        }
     }
+
+    qaDevice.ReadConsume(avail);
 }
 
 
@@ -197,24 +514,69 @@ QA_PHYSICAL_CHANNEL_CLASS::WriterThread(void *argv)
     while (1)
     {
         UMF_MESSAGE message;
-        incomingQ->pop(message);
+        bool is_priority = false;
 
-        // Check to see if we're being torn down -- this is
-        // done by passing a special message through the writeQ
+        // Priority messages go first
+        QA_PRIORITY_ENTRY pe;
+        if (physicalChannel->priorityWriteQ.try_pop(pe))
+        {
+            message = pe.msg;
+            is_priority = true;
 
-        if (message == NULL)
+            uint64_t delay = qaNowNs() - pe.enqTime;
+            physicalChannel->statPriorityMsgs += 1;
+            physicalChannel->statPriorityDelayNs += delay;
+            if (delay > physicalChannel->statPriorityMaxDelayNs)
+            {
+                physicalChannel->statPriorityMaxDelayNs = delay;
+            }
+        }
+        else
         {
-            if (!physicalChannel->uninitialized)
+            if (! incomingQ->try_pop(message))
+            {
+                // Exit once both queues are drained during teardown
+                if (physicalChannel->uninitialized)
+                {
+                    if (physicalChannel->priorityWriteQ.empty())
+                    {
+                        pthread_exit(0);
+                    }
+                    continue;
+                }
+
+                // Nothing to send.  Sleep until a producer arrives.
+                physicalChannel->waitForWriterWork();
+                continue;
+            }
+
+            if (message == NULL)
             {
                 cerr << "QA_PHYSICAL_CHANNEL got an unexpected NULL value" << endl;
+                continue;
             }
 
-            pthread_exit(0);
+            physicalChannel->statBulkMsgs += 1;
+
+            // Is this the message being timed?
+            if (message == physicalChannel->bulkSampleMsg)
+            {
+                uint64_t delay = qaNowNs() - physicalChannel->bulkSampleEnqTime;
+                physicalChannel->statBulkSamples += 1;
+                physicalChannel->statBulkDelayNs += delay;
+                if (delay > physicalChannel->statBulkMaxDelayNs)
+                {
+                    physicalChannel->statBulkMaxDelayNs = delay;
+                }
+
+                physicalChannel->bulkSampleMsg = NULL;
+            }
         }
 
         // The FPGA side detects NULLs inserted for alignment by looking at the
         // length field.  Having a length of 0 would break the protocol.
         ASSERTX(message->GetLength() != 0);
+        uint64_t msg_bytes = writeQMsgBytes(message);
 
         // construct header
         UMF_CHUNK header = 0;
@@ -226,16 +588,110 @@ QA_PHYSICAL_CHANNEL_CLASS::WriterThread(void *argv)
         // Round up to multiple of UMF_CHUNK size
         n_bytes = (n_bytes + sizeof(UMF_CHUNK) - 1) & ~(sizeof(UMF_CHUNK) - 1);
 
+        if (physicalChannel->trace.IsOpen())
+        {
+            physicalChannel->trace.Record(QA_CHANNEL_TRACE_OUTBOUND,
+                                          &header, sizeof(header),
+                                          message->ExtractGetRawPtr(), n_bytes);
+        }
+
         qaDevice->Write(message->ExtractGetRawPtr(), n_bytes);
         message->ExtractUpdateRawPtr(n_bytes);
 
+        // Bulk messages leave the byte-limited queue
+        if (! is_priority)
+        {
+            physicalChannel->releaseWriteQBytes(msg_bytes);
+        }
+
         // de-allocate message
         delete message;
 
         // Flush output channel if there isn't another message ready.
-        if (incomingQ->empty())
+        // Priority messages are always pushed out immediately.
+        if (is_priority ||
+            (incomingQ->empty() && physicalChannel->priorityWriteQ.empty()))
         {
             qaDevice->Flush();
+
+            if (physicalChannel->trace.IsOpen())
+            {
+                physicalChannel->trace.Record(QA_CHANNEL_TRACE_FLUSH, NULL, 0);
+            }
         }
     }
 }
+
+
+//
+// Statistics
+//
+
+void
+QA_PHYSICAL_CHANNEL_CLASS::EmitStats(ofstream &statsFile)
+{
+    statsFile << "QA_CHANNEL_PRIORITY_MSGS,"
+              << "\"QA channel priority messages sent\","
+              << statPriorityMsgs
+              << endl;
+    statsFile << "QA_CHANNEL_PRIORITY_AVG_DELAY_NS,"
+              << "\"QA channel priority message average queueing delay (ns)\","
+              << (statPriorityMsgs ? statPriorityDelayNs / statPriorityMsgs : 0)
+              << endl;
+    statsFile << "QA_CHANNEL_PRIORITY_MAX_DELAY_NS,"
+              << "\"QA channel priority message maximum queueing delay (ns)\","
+              << statPriorityMaxDelayNs
+              << endl;
+
+    statsFile << "QA_CHANNEL_BULK_MSGS,"
+              << "\"QA channel bulk messages sent\","
+              << statBulkMsgs
+              << endl;
+    statsFile << "QA_CHANNEL_BULK_AVG_DELAY_NS,"
+              << "\"QA channel bulk message average queueing delay (ns, sampled)\","
+              << (statBulkSamples ? statBulkDelayNs / statBulkSamples : 0)
+              << endl;
+    statsFile << "QA_CHANNEL_BULK_MAX_DELAY_NS,"
+              << "\"QA channel bulk message maximum queueing delay (ns, sampled)\","
+              << statBulkMaxDelayNs
+              << endl;
+
+    statsFile << "QA_CHANNEL_WRITEQ_MAX_MSGS,"
+              << "\"QA channel outbound queue high-water mark (messages)\","
+              << statWriteQMaxMsgs
+              << endl;
+    statsFile << "QA_CHANNEL_WRITEQ_MAX_BYTES,"
+              << "\"QA channel outbound queue high-water mark (bytes)\","
+              << statWriteQMaxBytes
+              << endl;
+    statsFile << "QA_CHANNEL_WRITE_BLOCKED,"
+              << "\"QA channel writes blocked by a full outbound queue\","
+              << statWriteBlocked
+              << endl;
+    statsFile << "QA_CHANNEL_WRITE_BLOCKED_NS,"
+              << "\"QA channel time writers spent blocked (ns)\","
+              << statWriteBlockedNs
+              << endl;
+    statsFile << "QA_CHANNEL_WRITE_REJECTED,"
+              << "\"QA channel TryWrite calls rejected by a full outbound queue\","
+              << statWriteRejected
+              << endl;
+}
+
+void
+QA_PHYSICAL_CHANNEL_CLASS::ResetStats()
+{
+    statPriorityMsgs = 0;
+    statPriorityDelayNs = 0;
+    statPriorityMaxDelayNs = 0;
+    statBulkMsgs = 0;
+    statBulkSamples = 0;
+    statBulkDelayNs = 0;
+    statBulkMaxDelayNs = 0;
+
+    statWriteQMaxMsgs = 0;
+    statWriteQMaxBytes = 0;
+    statWriteBlocked = 0;
+    statWriteBlockedNs = 0;
+    statWriteRejected = 0;
+}
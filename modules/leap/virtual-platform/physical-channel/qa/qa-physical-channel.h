@@ -36,15 +36,72 @@
 #include "awb/provides/physical_platform_utils.h"
 #include "awb/provides/qa_device.h"
 #include "awb/provides/qa_driver.h"
+#include "awb/provides/qa_driver_host_channels.h"
+#include "awb/provides/command_switches.h"
+#include "awb/restricted/stats-emitter.h"
 #include "tbb/concurrent_queue.h"
 #include "tbb/atomic.h"
+#include "tbb/spin_rw_mutex.h"
 #include <pthread.h>
+#include <map>
+#include <deque>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+// Queue to which inbound messages for a registered channel are delivered
+typedef class tbb::concurrent_bounded_queue<UMF_MESSAGE> QA_INBOUND_QUEUE_CLASS;
+typedef QA_INBOUND_QUEUE_CLASS* QA_INBOUND_QUEUE;
+
+// Wildcard service ID for RegisterInboundQueue()
+#define QA_ANY_SERVICE_ID (~uint32_t(0))
+
+//
+// Record channel traffic to a trace file (--qa-chan-record=<file>).  One
+// switch serves every channel in the process.  The first channel records
+// to <file> and later channels to <file>.<n>.
+//
+class QA_CHAN_RECORD_SWITCH_CLASS : public COMMAND_SWITCH_STRING_CLASS
+{
+  private:
+    std::vector<QA_CHANNEL_TRACE_WRITER_CLASS*> traces;
+
+  public:
+    ~QA_CHAN_RECORD_SWITCH_CLASS() {};
+    QA_CHAN_RECORD_SWITCH_CLASS() :
+        COMMAND_SWITCH_STRING_CLASS("qa-chan-record"),
+        traces()
+    {};
+
+    void AddTrace(QA_CHANNEL_TRACE_WRITER_CLASS* t) { traces.push_back(t); }
+    void RemoveTrace(QA_CHANNEL_TRACE_WRITER_CLASS* t)
+    {
+        traces.erase(std::remove(traces.begin(), traces.end(), t), traces.end());
+    }
+
+    void ProcessSwitchString(const char *arg)
+    {
+        for (size_t i = 0; i < traces.size(); i++)
+        {
+            ostringstream path;
+            path << arg;
+            if (i != 0) path << "." << i;
+            traces[i]->Open(path.str().c_str());
+        }
+    };
+    void ShowSwitch(std::ostream& ostr, const string& prefix)
+    {
+        ostr << prefix << "[--qa-chan-record=<file>] Record host/FPGA channel traffic to a binary trace" << endl;
+    };
+};
+
 
 // ============================================
 //               Physical Channel              
 // ============================================
 typedef class QA_PHYSICAL_CHANNEL_CLASS* QA_PHYSICAL_CHANNEL;
-class QA_PHYSICAL_CHANNEL_CLASS: public PHYSICAL_CHANNEL_CLASS
+class QA_PHYSICAL_CHANNEL_CLASS: public PHYSICAL_CHANNEL_CLASS,
+                                 public STATS_EMITTER_CLASS
 {
   private:
     // our lower-level physical device.
@@ -53,31 +110,157 @@ class QA_PHYSICAL_CHANNEL_CLASS: public PHYSICAL_CHANNEL_CLASS
     // queue for storing messages 
     class tbb::concurrent_bounded_queue<UMF_MESSAGE> writeQ;
 
+    //
+    // Outbound back-pressure.  writeQ capacity is limited to
+    // QA_CHANNEL_WRITEQ_MAX_MSGS messages and the total size of queued
+    // messages to QA_CHANNEL_WRITEQ_MAX_BYTES.
+    //
+    class tbb::atomic<uint64_t> writeQBytes;
+
+    // Wait until a message of msgBytes fits under the byte limit.
+    // Returns false if the message doesn't fit and canBlock is false.
+    // Time spent waiting for space is added to *blockedNs.
+    bool reserveWriteQBytes(uint64_t msgBytes, bool canBlock, uint64_t *blockedNs);
+    void releaseWriteQBytes(uint64_t msgBytes);
+    void noteWriteQDepth();
+
+    static uint64_t writeQMsgBytes(UMF_MESSAGE msg)
+    {
+        return sizeof(UMF_CHUNK) + msg->GetLength();
+    }
+
+    //
+    // Latency-critical outbound messages.  The writer thread drains this
+    // queue before taking the next message from writeQ, so priority messages
+    // pass bulk traffic at message boundaries.  Entries carry their enqueue
+    // time for queueing delay statistics.
+    //
+    typedef struct
+    {
+        UMF_MESSAGE msg;
+        uint64_t    enqTime;
+    }
+    QA_PRIORITY_ENTRY;
+
+    class tbb::concurrent_queue<QA_PRIORITY_ENTRY> priorityWriteQ;
+
+    //
+    // Bulk queueing delay is sampled, tracking one message at a time.
+    // The slot holds the message being timed and its enqueue time.
+    //
+    class tbb::atomic<UMF_MESSAGE> bulkSampleMsg;
+    uint64_t bulkSampleEnqTime;
+
+    // Statistics, updated only by the writer thread
+    uint64_t statPriorityMsgs;
+    uint64_t statPriorityDelayNs;
+    uint64_t statPriorityMaxDelayNs;
+    uint64_t statBulkMsgs;
+    uint64_t statBulkSamples;
+    uint64_t statBulkDelayNs;
+    uint64_t statBulkMaxDelayNs;
+
+    // Statistics, updated by producers
+    class tbb::atomic<uint64_t> statWriteQMaxMsgs;
+    class tbb::atomic<uint64_t> statWriteQMaxBytes;
+    class tbb::atomic<uint64_t> statWriteBlocked;
+    class tbb::atomic<uint64_t> statWriteBlockedNs;
+    class tbb::atomic<uint64_t> statWriteRejected;
+
     // incomplete incoming read message
     UMF_MESSAGE incomingMessage;
 
+    // Complete messages decoded by readPipe() and not yet returned.
+    // A single pass may decode several messages.  Only the reader
+    // thread touches this queue.
+    std::deque<UMF_MESSAGE> readyMessages;
+
+    // Per-channel inbound queues.  The key is built from the channel ID
+    // and service ID in the message header.  Messages with no registered
+    // queue are returned by Read() and TryRead().
+    std::map<uint64_t, QA_INBOUND_QUEUE> inboundQueues;
+    tbb::spin_rw_mutex inboundQueuesLock;
+
     // internal methods
-    void readPipe();
+    void readPipe(bool block = true);
+
+    // Forward a complete message to its registered inbound queue.
+    // Returns false if no queue is registered for the message.
+    bool routeInbound(UMF_MESSAGE msg);
+
+    static uint64_t inboundKey(uint32_t channelID, uint32_t serviceID)
+    {
+        return (uint64_t(channelID) << 32) | serviceID;
+    }
 
     UMF_FACTORY umfFactory;
 
     pthread_t writerThread;
 
+    //
+    // The writer thread sleeps on writerCond when both outbound queues
+    // are empty.  Producers signal it only when writerIdle is set.
+    // Uninit() sets uninitialized and signals the same way, stopping the
+    // writer once the queues drain.
+    //
+    pthread_mutex_t writerLock;
+    pthread_cond_t writerCond;
+    volatile bool writerIdle;
+
+    void wakeWriter();
+    // Block the writer thread until an outbound queue is non-empty.
+    void waitForWriterWork();
+
     class tbb::atomic<bool> uninitialized;
 
+    // Optional record of all traffic
+    QA_CHANNEL_TRACE_WRITER_CLASS trace;
+
+    // Created by the first channel and shared by all
+    static QA_CHAN_RECORD_SWITCH_CLASS* recordSwitch;
+
   public:
-    QA_PHYSICAL_CHANNEL_CLASS(PLATFORMS_MODULE);
+    // pciBus selects the FPGA when a process drives more than one.
+    QA_PHYSICAL_CHANNEL_CLASS(PLATFORMS_MODULE, int pciBus = QA_ANY_PCI_BUS);
     ~QA_PHYSICAL_CHANNEL_CLASS();
 
     static void * WriterThread(void *argv);
 
     UMF_MESSAGE Read();             // blocking read
     UMF_MESSAGE TryRead();          // non-blocking read
-    void        Write(UMF_MESSAGE); // write
+    void        Write(UMF_MESSAGE); // write, blocking when the queue is full
+
+    // Non-blocking write.  Returns false, leaving the message owned by
+    // the caller, when the outbound queue is full.
+    bool        TryWrite(UMF_MESSAGE);
+
+    // Write a latency-critical message (e.g. an RRR response on which the
+    // FPGA is stalled).  The message is sent ahead of queued bulk traffic
+    // and the channel is flushed immediately after it.
+    void        WritePriority(UMF_MESSAGE);
+
     void        Uninit(); 
-    class tbb::concurrent_bounded_queue<UMF_MESSAGE> *GetWriteQ() { return &writeQ; }
+
+    //
+    // Deliver all inbound messages for channelID directly to q as they
+    // arrive instead of returning them from Read().  Each service may then
+    // consume its own queue from a separate thread without being blocked
+    // behind other services.  Passing a serviceID restricts the queue
+    // to a single service on the channel.  Exact channel/service matches
+    // take priority over QA_ANY_SERVICE_ID.
+    //
+    void RegisterInboundQueue(uint32_t channelID,
+                              QA_INBOUND_QUEUE q,
+                              uint32_t serviceID = QA_ANY_SERVICE_ID);
+    void UnregisterInboundQueue(uint32_t channelID,
+                                uint32_t serviceID = QA_ANY_SERVICE_ID);
+
     void SetUMFFactory(UMF_FACTORY factoryInit) { umfFactory = factoryInit; };
     void RegisterLogicalDeviceName(string name) { qaDevice.RegisterLogicalDeviceName(name); }
+
+    // STATS_EMITTER_CLASS virtual functions
+    void EmitStats(ofstream &statsFile);
+    void ResetStats();
 };
 
 #endif